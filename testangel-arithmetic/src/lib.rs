@@ -1,188 +1,246 @@
-use std::sync::Mutex;
+use std::error::Error;
 
 use lazy_static::lazy_static;
 use testangel_engine::*;
 
+/// The number of values combined at once by the list instructions, so that their loops can be
+/// vectorised.
+const LANES: usize = 8;
+
 #[derive(Default)]
 struct State {
     counter: i32,
 }
 
 lazy_static! {
-    static ref ENGINE: Mutex<Engine<'static, State>> = Mutex::new(Engine::new("Arithmetic", env!("CARGO_PKG_VERSION"))
-    .with_instruction(
-        Instruction::new(
-            "arithmetic-int-add",
-            "Add (Integer)",
-            "Add together two integers.",
-        )
-        .with_parameter("val1", "A", ParameterKind::Integer)
-        .with_parameter("val2", "B", ParameterKind::Integer)
-        .with_output("result", "A + B", ParameterKind::Integer),
-        |_state, params, output, _evidence| {
-            let val1 = params["val1"].value_i32();
-            let val2 = params["val2"].value_i32();
-
-            // Produce output and evidence
-            let result = val1 + val2;
-            output.insert("result".to_owned(), ParameterValue::Integer(result));
-            Ok(())
-        })
-    .with_instruction(
-        Instruction::new(
-            "arithmetic-int-sub",
-            "Subtract (Integer)",
-            "Subtract two integers.",
-        )
-        .with_parameter("val1", "A", ParameterKind::Integer)
-        .with_parameter("val2", "B", ParameterKind::Integer)
-        .with_output("result", "A - B", ParameterKind::Integer),
-        |_state, params, output, _evidence| {
-            let val1 = params["val1"].value_i32();
-            let val2 = params["val2"].value_i32();
-
-            // Produce output and evidence
-            let result = val1 - val2;
-            output.insert("result".to_owned(), ParameterValue::Integer(result));
-            Ok(())
-        })
-    .with_instruction(
-        Instruction::new(
-            "arithmetic-int-mul",
-            "Multiply (Integer)",
-            "Multiply two integers.",
-        )
-        .with_parameter("val1", "A", ParameterKind::Integer)
-        .with_parameter("val2", "B", ParameterKind::Integer)
-        .with_output("result", "A × B", ParameterKind::Integer),
-        |_state, params, output, _evidence| {
-            let val1 = params["val1"].value_i32();
-            let val2 = params["val2"].value_i32();
-
-            // Produce output and evidence
-            let result = val1 * val2;
-            output.insert("result".to_owned(), ParameterValue::Integer(result));
-            Ok(())
-        })
-    .with_instruction(
-        Instruction::new(
-            "arithmetic-int-div",
-            "Divide (Integer)",
-            "Divide two integers, returning the floored result.",
-        )
-        .with_parameter("val1", "A", ParameterKind::Integer)
-        .with_parameter("val2", "B", ParameterKind::Integer)
-        .with_output("result", "A ÷ B", ParameterKind::Integer),
-        |_state, params, output, _evidence| {
-            let val1 = params["val1"].value_i32();
-            let val2 = params["val2"].value_i32();
-
-            // Produce output and evidence
-            let result = val1 / val2;
-            output.insert("result".to_owned(), ParameterValue::Integer(result));
-            Ok(())
-        })
-    .with_instruction(
-        Instruction::new(
-            "arithmetic-dec-add",
-            "Add (Decimal)",
-            "Add together two decimals.",
-        )
-        .with_parameter("val1", "A", ParameterKind::Decimal)
-        .with_parameter("val2", "B", ParameterKind::Decimal)
-        .with_output("result", "A + B", ParameterKind::Decimal),
-        |_state, params, output, _evidence| {
-            let val1 = params["val1"].value_f32();
-            let val2 = params["val2"].value_f32();
-
-            // Produce output and evidence
-            let result = val1 + val2;
-            output.insert("result".to_owned(), ParameterValue::Decimal(result));
-            Ok(())
-        })
-    .with_instruction(
-        Instruction::new(
-            "arithmetic-dec-sub",
-            "Subtract (Decimal)",
-            "Subtract two decimals.",
-        )
-        .with_parameter("val1", "A", ParameterKind::Decimal)
-        .with_parameter("val2", "B", ParameterKind::Decimal)
-        .with_output("result", "A - B", ParameterKind::Decimal),
-        |_state, params, output, _evidence| {
-            let val1 = params["val1"].value_f32();
-            let val2 = params["val2"].value_f32();
-
-            // Produce output and evidence
-            let result = val1 - val2;
-            output.insert("result".to_owned(), ParameterValue::Decimal(result));
-            Ok(())
-        })
-    .with_instruction(
-        Instruction::new(
-            "arithmetic-dec-mul",
-            "Multiply (Decimal)",
-            "Multiply two decimals.",
-        )
-        .with_parameter("val1", "A", ParameterKind::Decimal)
-        .with_parameter("val2", "B", ParameterKind::Decimal)
-        .with_output("result", "A × B", ParameterKind::Decimal),
-        |_state, params, output, _evidence| {
-            let val1 = params["val1"].value_f32();
-            let val2 = params["val2"].value_f32();
-
-            // Produce output and evidence
-            let result = val1 * val2;
-            output.insert("result".to_owned(), ParameterValue::Decimal(result));
-            Ok(())
-        })
-    .with_instruction(
-        Instruction::new(
-            "arithmetic-dec-div",
-            "Divide (Decimal)",
-            "Divide two decimals, returning the result.",
-        )
-        .with_parameter("val1", "A", ParameterKind::Decimal)
-        .with_parameter("val2", "B", ParameterKind::Decimal)
-        .with_output("result", "A ÷ B", ParameterKind::Decimal),
-        |_state, params, output, _evidence| {
-            let val1 = params["val1"].value_f32();
-            let val2 = params["val2"].value_f32();
+    static ref ENGINE: Engine<'static, State> =
+        Engine::new("Arithmetic", env!("CARGO_PKG_VERSION"))
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-int-add",
+                    "Add (Integer)",
+                    "Add together two integers.",
+                )
+                .pure(),
+                [("val1", "A"), ("val2", "B")],
+                [("result", "A + B")],
+                |_state, (val1, val2): (i32, i32), _evidence| Ok((val1 + val2,))
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-int-sub",
+                    "Subtract (Integer)",
+                    "Subtract two integers.",
+                )
+                .pure(),
+                [("val1", "A"), ("val2", "B")],
+                [("result", "A - B")],
+                |_state, (val1, val2): (i32, i32), _evidence| Ok((val1 - val2,))
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-int-mul",
+                    "Multiply (Integer)",
+                    "Multiply two integers.",
+                )
+                .pure(),
+                [("val1", "A"), ("val2", "B")],
+                [("result", "A × B")],
+                |_state, (val1, val2): (i32, i32), _evidence| Ok((val1 * val2,))
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-int-div",
+                    "Divide (Integer)",
+                    "Divide two integers, returning the floored result.",
+                )
+                .pure(),
+                [("val1", "A"), ("val2", "B")],
+                [("result", "A ÷ B")],
+                |_state, (val1, val2): (i32, i32), _evidence| Ok((val1 / val2,))
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-dec-add",
+                    "Add (Decimal)",
+                    "Add together two decimals.",
+                )
+                .pure(),
+                [("val1", "A"), ("val2", "B")],
+                [("result", "A + B")],
+                |_state, (val1, val2): (f32, f32), _evidence| Ok((val1 + val2,))
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-dec-sub",
+                    "Subtract (Decimal)",
+                    "Subtract two decimals.",
+                )
+                .pure(),
+                [("val1", "A"), ("val2", "B")],
+                [("result", "A - B")],
+                |_state, (val1, val2): (f32, f32), _evidence| Ok((val1 - val2,))
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-dec-mul",
+                    "Multiply (Decimal)",
+                    "Multiply two decimals.",
+                )
+                .pure(),
+                [("val1", "A"), ("val2", "B")],
+                [("result", "A × B")],
+                |_state, (val1, val2): (f32, f32), _evidence| Ok((val1 * val2,))
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-dec-div",
+                    "Divide (Decimal)",
+                    "Divide two decimals, returning the result.",
+                )
+                .pure(),
+                [("val1", "A"), ("val2", "B")],
+                [("result", "A ÷ B")],
+                |_state, (val1, val2): (f32, f32), _evidence| Ok((val1 / val2,))
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-int-sum",
+                    "Sum (Integer List)",
+                    "Add together every integer in a list.",
+                )
+                .pure(),
+                [("values", "Values")],
+                [("result", "Sum")],
+                |_state, (values,): (Vec<i32>,), _evidence| Ok((sum_i32(&values)?,))
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-int-min",
+                    "Minimum (Integer List)",
+                    "Find the smallest integer in a list.",
+                )
+                .pure(),
+                [("values", "Values")],
+                [("result", "Minimum")],
+                |_state, (values,): (Vec<i32>,), _evidence| Ok((reduce(&values, i32::min)?,))
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-int-max",
+                    "Maximum (Integer List)",
+                    "Find the largest integer in a list.",
+                )
+                .pure(),
+                [("values", "Values")],
+                [("result", "Maximum")],
+                |_state, (values,): (Vec<i32>,), _evidence| Ok((reduce(&values, i32::max)?,))
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-dec-sum",
+                    "Sum (Decimal List)",
+                    "Add together every decimal in a list.",
+                )
+                .pure(),
+                [("values", "Values")],
+                [("result", "Sum")],
+                |_state, (values,): (Vec<f32>,), _evidence| Ok((sum_f32(&values),))
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-dec-min",
+                    "Minimum (Decimal List)",
+                    "Find the smallest decimal in a list.",
+                )
+                .pure(),
+                [("values", "Values")],
+                [("result", "Minimum")],
+                |_state, (values,): (Vec<f32>,), _evidence| Ok((reduce(&values, f32::min)?,))
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-dec-max",
+                    "Maximum (Decimal List)",
+                    "Find the largest decimal in a list.",
+                )
+                .pure(),
+                [("values", "Values")],
+                [("result", "Maximum")],
+                |_state, (values,): (Vec<f32>,), _evidence| Ok((reduce(&values, f32::max)?,))
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-counter-inc",
+                    "Increase Counter",
+                    "Increase a counter.",
+                ),
+                [],
+                [("value", "Counter Value")],
+                |state: &mut State, (): (), _evidence| {
+                    state.counter += 1;
+                    Ok((state.counter,))
+                }
+            )
+            .with_typed_instruction(
+                Instruction::new(
+                    "arithmetic-counter-dec",
+                    "Decrease Counter",
+                    "Decrease a counter.",
+                ),
+                [],
+                [("value", "Counter Value")],
+                |state: &mut State, (): (), _evidence| {
+                    state.counter -= 1;
+                    Ok((state.counter,))
+                }
+            );
+}
 
-            // Produce output and evidence
-            let result = val1 / val2;
-            output.insert("result".to_owned(), ParameterValue::Decimal(result));
-            Ok(())
-        })
-    .with_instruction(
-        Instruction::new(
-            "arithmetic-counter-inc",
-            "Increase Counter",
-            "Increase a counter.",
-        )
-        .with_output("value", "Counter Value", ParameterKind::Integer),
-        |state: &mut State, _params, output, _evidence| {
-            // Produce output and evidence
-            state.counter += 1;
+expose_engine!(ENGINE);
 
-            output.insert("value".to_owned(), ParameterValue::Integer(state.counter));
-            Ok(())
-        })
-    .with_instruction(
-        Instruction::new(
-            "arithmetic-counter-dec",
-            "Decrease Counter",
-            "Decrease a counter.",
-        )
-        .with_output("value", "Counter Value", ParameterKind::Integer),
-        |state: &mut State, _params, output, _evidence| {
-            // Produce output and evidence
-            state.counter -= 1;
+/// Add together a list of integers, summing `LANES` at a time.
+fn sum_i32(values: &[i32]) -> Result<i32, Box<dyn Error>> {
+    // The lanes are wide enough that they can't overflow, so this only needs checking once.
+    let mut lanes = [0i64; LANES];
+    let chunks = values.chunks_exact(LANES);
+    let rest = chunks.remainder();
+    for chunk in chunks {
+        for (lane, value) in lanes.iter_mut().zip(chunk) {
+            *lane += i64::from(*value);
+        }
+    }
+    let sum = lanes.iter().sum::<i64>() + rest.iter().map(|v| i64::from(*v)).sum::<i64>();
+    i32::try_from(sum).map_err(|_| "The sum is too large to be an integer.".into())
+}
 
-            output.insert("value".to_owned(), ParameterValue::Integer(state.counter));
-            Ok(())
-        })
-    );
+/// Add together a list of decimals, summing `LANES` at a time.
+fn sum_f32(values: &[f32]) -> f32 {
+    let mut lanes = [0f32; LANES];
+    let chunks = values.chunks_exact(LANES);
+    let rest = chunks.remainder();
+    for chunk in chunks {
+        for (lane, value) in lanes.iter_mut().zip(chunk) {
+            *lane += *value;
+        }
+    }
+    lanes.iter().sum::<f32>() + rest.iter().sum::<f32>()
 }
 
-expose_engine!(ENGINE);
+/// Combine a list of values with `f`, such as to find the minimum, `LANES` at a time. `f`
+/// must give the same result however the values are grouped. Fails if the list is empty.
+fn reduce<T: Copy>(values: &[T], f: impl Fn(T, T) -> T) -> Result<T, Box<dyn Error>> {
+    let Some(first) = values.first() else {
+        return Err("The list is empty.".into());
+    };
+    let mut lanes = [*first; LANES];
+    let chunks = values.chunks_exact(LANES);
+    let rest = chunks.remainder();
+    for chunk in chunks {
+        for (lane, value) in lanes.iter_mut().zip(chunk) {
+            *lane = f(*lane, *value);
+        }
+    }
+    let combined = lanes.into_iter().reduce(&f).unwrap_or(*first);
+    Ok(rest.iter().fold(combined, |acc, value| f(acc, *value)))
+}
@@ -1,10 +1,12 @@
-use std::sync::Mutex;
-
 use lazy_static::lazy_static;
 use testangel_engine::*;
 
+/// The number of values compared at once by the list instructions, so that their loops can be
+/// vectorised.
+const LANES: usize = 8;
+
 lazy_static! {
-    static ref ENGINE: Mutex<Engine<'static, ()>> = Mutex::new(Engine::new("Compare", env!("CARGO_PKG_VERSION"))
+    static ref ENGINE: Engine<'static, ()> = Engine::new("Compare", env!("CARGO_PKG_VERSION"))
     .with_instruction(
         Instruction::new(
             "compare-eq-ints",
@@ -13,7 +15,8 @@ lazy_static! {
         )
         .with_parameter("val1", "A", ParameterKind::Integer)
         .with_parameter("val2", "B", ParameterKind::Integer)
-        .with_output("result", "A = B", ParameterKind::Boolean),
+        .with_output("result", "A = B", ParameterKind::Boolean)
+        .pure(),
         |_state, params, output, _evidence| {
             let val1 = params["val1"].value_i32();
             let val2 = params["val2"].value_i32();
@@ -31,7 +34,8 @@ lazy_static! {
         )
         .with_parameter("val1", "A", ParameterKind::Decimal)
         .with_parameter("val2", "B", ParameterKind::Decimal)
-        .with_output("result", "A = B", ParameterKind::Boolean),
+        .with_output("result", "A = B", ParameterKind::Boolean)
+        .pure(),
         |_state, params, output, _evidence| {
             let val1 = params["val1"].value_f32();
             let val2 = params["val2"].value_f32();
@@ -49,7 +53,8 @@ lazy_static! {
         )
         .with_parameter("val1", "A", ParameterKind::String)
         .with_parameter("val2", "B", ParameterKind::String)
-        .with_output("result", "A = B", ParameterKind::Boolean),
+        .with_output("result", "A = B", ParameterKind::Boolean)
+        .pure(),
         |_state, params, output, _evidence| {
             let val1 = params["val1"].value_string();
             let val2 = params["val2"].value_string();
@@ -67,7 +72,8 @@ lazy_static! {
         )
         .with_parameter("val1", "A", ParameterKind::Boolean)
         .with_parameter("val2", "B", ParameterKind::Boolean)
-        .with_output("result", "A = B", ParameterKind::Boolean),
+        .with_output("result", "A = B", ParameterKind::Boolean)
+        .pure(),
         |_state, params, output, _evidence| {
             let val1 = params["val1"].value_bool();
             let val2 = params["val2"].value_bool();
@@ -84,7 +90,8 @@ lazy_static! {
             "If fed true, returns false, if fed false, returns true.",
         )
         .with_parameter("val1", "A", ParameterKind::Boolean)
-        .with_output("result", "not A", ParameterKind::Boolean),
+        .with_output("result", "not A", ParameterKind::Boolean)
+        .pure(),
         |_state, params, output, _evidence| {
             let val1 = params["val1"].value_bool();
 
@@ -101,7 +108,8 @@ lazy_static! {
         )
         .with_parameter("val1", "A", ParameterKind::Boolean)
         .with_parameter("val2", "B", ParameterKind::Boolean)
-        .with_output("result", "A and B", ParameterKind::Boolean),
+        .with_output("result", "A and B", ParameterKind::Boolean)
+        .pure(),
         |_state, params, output, _evidence| {
             let val1 = params["val1"].value_bool();
             let val2 = params["val2"].value_bool();
@@ -119,7 +127,8 @@ lazy_static! {
         )
         .with_parameter("val1", "A", ParameterKind::Boolean)
         .with_parameter("val2", "B", ParameterKind::Boolean)
-        .with_output("result", "not A", ParameterKind::Boolean),
+        .with_output("result", "not A", ParameterKind::Boolean)
+        .pure(),
         |_state, params, output, _evidence| {
             let val1 = params["val1"].value_bool();
             let val2 = params["val2"].value_bool();
@@ -129,7 +138,104 @@ lazy_static! {
             output.insert("result".to_owned(), ParameterValue::Boolean(result));
             Ok(())
         })
-    );
+    .with_typed_instruction(
+        Instruction::new(
+            "compare-all-eq-ints",
+            "All Equal (Integer List)",
+            "Returns true if every integer in a list is equal to a value.",
+        )
+        .pure(),
+        [("values", "Values"), ("val", "Value")],
+        [("result", "All = Value")],
+        |_state, (values, val): (Vec<i32>, i32), _evidence| Ok((all(&values, |v| v == val),)))
+    .with_typed_instruction(
+        Instruction::new(
+            "compare-any-eq-ints",
+            "Any Equal (Integer List)",
+            "Returns true if any integer in a list is equal to a value.",
+        )
+        .pure(),
+        [("values", "Values"), ("val", "Value")],
+        [("result", "Any = Value")],
+        |_state, (values, val): (Vec<i32>, i32), _evidence| Ok((!all(&values, |v| v != val),)))
+    .with_typed_instruction(
+        Instruction::new(
+            "compare-all-eq-decs",
+            "All Equal (Decimal List)",
+            "Returns true if every decimal in a list is equal to a value.",
+        )
+        .pure(),
+        [("values", "Values"), ("val", "Value")],
+        [("result", "All = Value")],
+        |_state, (values, val): (Vec<f32>, f32), _evidence| Ok((all(&values, |v| v == val),)))
+    .with_typed_instruction(
+        Instruction::new(
+            "compare-any-eq-decs",
+            "Any Equal (Decimal List)",
+            "Returns true if any decimal in a list is equal to a value.",
+        )
+        .pure(),
+        [("values", "Values"), ("val", "Value")],
+        [("result", "Any = Value")],
+        |_state, (values, val): (Vec<f32>, f32), _evidence| Ok((!all(&values, |v| v != val),)))
+    .with_typed_instruction(
+        Instruction::new(
+            "compare-eq-int-lists",
+            "Equal (Integer List)",
+            "Compare two lists of integers, element by element.",
+        )
+        .pure(),
+        [("val1", "A"), ("val2", "B")],
+        [("result", "A = B"), ("mismatches", "Mismatches")],
+        |_state, (val1, val2): (Vec<i32>, Vec<i32>), _evidence| Ok(compare_lists(&val1, &val2)))
+    .with_typed_instruction(
+        Instruction::new(
+            "compare-eq-dec-lists",
+            "Equal (Decimal List)",
+            "Compare two lists of decimals, element by element.",
+        )
+        .pure(),
+        [("val1", "A"), ("val2", "B")],
+        [("result", "A = B"), ("mismatches", "Mismatches")],
+        |_state, (val1, val2): (Vec<f32>, Vec<f32>), _evidence| Ok(compare_lists(&val1, &val2)));
 }
 
 expose_engine!(ENGINE);
+
+/// Returns true if `f` is true for every value, checking `LANES` values at a time without
+/// stopping early within them.
+fn all<T: Copy>(values: &[T], f: impl Fn(T) -> bool) -> bool {
+    let chunks = values.chunks_exact(LANES);
+    let rest = chunks.remainder();
+    for chunk in chunks {
+        if !chunk.iter().fold(true, |acc, v| acc & f(*v)) {
+            return false;
+        }
+    }
+    rest.iter().all(|v| f(*v))
+}
+
+/// Compare two lists element by element, returning whether they are equal and the number of
+/// positions at which they differ. Positions beyond the end of the shorter list differ.
+fn compare_lists<T: Copy + PartialEq>(a: &[T], b: &[T]) -> (bool, i32) {
+    let len = a.len().min(b.len());
+    let mut lanes = [0usize; LANES];
+    let a_chunks = a[..len].chunks_exact(LANES);
+    let b_chunks = b[..len].chunks_exact(LANES);
+    let rest = a_chunks
+        .remainder()
+        .iter()
+        .zip(b_chunks.remainder())
+        .filter(|(a, b)| a != b)
+        .count();
+    for (a, b) in a_chunks.zip(b_chunks) {
+        for ((lane, a), b) in lanes.iter_mut().zip(a).zip(b) {
+            *lane += usize::from(a != b);
+        }
+    }
+    let mismatches = lanes.iter().sum::<usize>() + rest + a.len().abs_diff(b.len());
+    (
+        mismatches == 0,
+        i32::try_from(mismatches).unwrap_or(i32::MAX),
+    )
+}
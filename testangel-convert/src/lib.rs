@@ -1,4 +1,4 @@
-use std::{collections::HashMap, sync::Mutex};
+use std::collections::HashMap;
 
 use interpolator::{format, Formattable};
 use lazy_static::lazy_static;
@@ -10,7 +10,7 @@ struct State {
 }
 
 lazy_static! {
-    static ref ENGINE: Mutex<Engine<'static, State>> = Mutex::new(Engine::new("Convert", env!("CARGO_PKG_VERSION"))
+    static ref ENGINE: Engine<'static, State> = Engine::new("Convert", env!("CARGO_PKG_VERSION"))
     .with_instruction(
         Instruction::new(
             "convert-int-string",
@@ -18,7 +18,8 @@ lazy_static! {
             "Convert an integer into a string.",
         )
         .with_parameter("val1", "Integer input", ParameterKind::Integer)
-        .with_output("result", "String output", ParameterKind::String),
+        .with_output("result", "String output", ParameterKind::String)
+        .pure(),
         |_state, params, output, _evidence| {
             let val1 = params["val1"].value_i32();
 
@@ -34,7 +35,8 @@ lazy_static! {
             "Convert a decimal into a string.",
         )
         .with_parameter("val1", "Decimal input", ParameterKind::Decimal)
-        .with_output("result", "String output", ParameterKind::String),
+        .with_output("result", "String output", ParameterKind::String)
+        .pure(),
         |_state, params, output, _evidence| {
             let val1 = params["val1"].value_f32();
 
@@ -51,7 +53,8 @@ lazy_static! {
         )
         .with_parameter("val1", "StringA", ParameterKind::String)
         .with_parameter("val2", "StringB", ParameterKind::String)
-        .with_output("result", "StringAStringB", ParameterKind::String),
+        .with_output("result", "StringAStringB", ParameterKind::String)
+        .pure(),
         |_state, params, output, _evidence| {
             let val1 = params["val1"].value_string();
             let val2 = params["val2"].value_string();
@@ -96,8 +99,7 @@ lazy_static! {
             let result = format(&template, &values)?;
             output.insert("result".to_owned(), ParameterValue::String(result));
             Ok(())
-        })
-    );
+        });
 }
 
 expose_engine!(ENGINE);
@@ -24,7 +24,7 @@ pub fn expose_engine(stream: TokenStream) -> TokenStream {
                     reason: format!("The IPC message was invalid. ({{:?}})", e),
                 }}
                 .to_json(),
-                Ok(request) => {engine_name}.lock().expect("must be able to lock engine").process_request(request).to_json(),
+                Ok(request) => EngineHandle::handle_request(&*{engine_name}, request).to_json(),
             }};
             let c_response = ::std::ffi::CString::new(response).expect("valid response");
             c_response.into_raw()
@@ -36,5 +36,28 @@ pub fn expose_engine(stream: TokenStream) -> TokenStream {
                 drop(::std::ffi::CString::from_raw(input));
             }}
         }}
+
+        #[no_mangle]
+        pub unsafe extern "C" fn ta_call_bin(input: *const u8, input_len: usize, output_len: *mut usize) -> *mut u8 {{
+            let input = ::std::slice::from_raw_parts(input, input_len);
+            let response = match Request::try_from(input) {{
+                Err(e) => Response::Error {{
+                    kind: ErrorKind::FailedToParseIPCJson,
+                    reason: format!("The IPC message was invalid. ({{:?}})", e),
+                }}
+                .to_msgpack(),
+                Ok(request) => EngineHandle::handle_request(&*{engine_name}, request).to_msgpack(),
+            }};
+            let response = response.into_boxed_slice();
+            *output_len = response.len();
+            ::std::boxed::Box::into_raw(response) as *mut u8
+        }}
+
+        #[no_mangle]
+        pub unsafe extern "C" fn ta_release_bin(output: *mut u8, output_len: usize) {{
+            if !output.is_null() {{
+                drop(::std::boxed::Box::from_raw(::std::ptr::slice_from_raw_parts_mut(output, output_len)));
+            }}
+        }}
     "#).parse().unwrap()
 }
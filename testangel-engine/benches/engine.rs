@@ -0,0 +1,167 @@
+use std::{
+    collections::HashMap,
+    ffi::{CStr, CString},
+};
+
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use lazy_static::lazy_static;
+use testangel_engine::*;
+
+#[derive(Default)]
+struct State {
+    counter: i32,
+}
+
+lazy_static! {
+    static ref ENGINE: Engine<'static, State> = Engine::new("Benchmark", env!("CARGO_PKG_VERSION"))
+        .with_instruction(
+            Instruction::new("bench-add", "Add", "Add together two integers.",)
+                .with_parameter("val1", "A", ParameterKind::Integer)
+                .with_parameter("val2", "B", ParameterKind::Integer)
+                .with_output("result", "A + B", ParameterKind::Integer),
+            |_state, params, output, _evidence| {
+                let result = params["val1"].value_i32() + params["val2"].value_i32();
+                output.insert("result".to_owned(), ParameterValue::Integer(result));
+                Ok(())
+            }
+        )
+        .with_instruction(
+            Instruction::new(
+                "bench-count",
+                "Count",
+                "Increase a counter and produce it as evidence.",
+            )
+            .with_output("value", "Value", ParameterKind::Integer),
+            |state: &mut State, _params, output, evidence| {
+                state.counter += 1;
+                output.insert("value".to_owned(), ParameterValue::Integer(state.counter));
+                evidence.push(Evidence {
+                    label: String::from("Counter"),
+                    content: EvidenceContent::Textual(state.counter.to_string()),
+                });
+                Ok(())
+            }
+        );
+}
+
+expose_engine!(ENGINE);
+
+/// The number of instructions in each request to the engines with [`engine_with`].
+const DISPATCHED: usize = 500;
+
+/// An engine with `count` instructions, `bench-add-0` onwards, each adding together two
+/// integers.
+fn engine_with(count: usize) -> Engine<'static, State> {
+    (0..count).fold(
+        Engine::new("Benchmark", env!("CARGO_PKG_VERSION")),
+        |engine, i| {
+            engine.with_instruction(
+                Instruction::new(
+                    format!("bench-add-{i}"),
+                    format!("Add {i}"),
+                    String::from("Add together two integers."),
+                )
+                .with_parameter("val1", "A", ParameterKind::Integer)
+                .with_parameter("val2", "B", ParameterKind::Integer)
+                .with_output("result", "A + B", ParameterKind::Integer),
+                |_state, params, output, _evidence| {
+                    let result = params["val1"].value_i32() + params["val2"].value_i32();
+                    output.insert("result".to_owned(), ParameterValue::Integer(result));
+                    Ok(())
+                },
+            )
+        },
+    )
+}
+
+/// A request to run [`DISPATCHED`] instructions on an engine from [`engine_with`], calling each
+/// of its `count` instructions in turn.
+fn dispatch_request(count: usize, handles: bool) -> Request {
+    Request::RunInstructions {
+        instructions: (0..DISPATCHED)
+            .map(|i| InstructionWithParameters {
+                instruction: format!("bench-add-{}", i % count),
+                instruction_handle: handles.then_some(i % count),
+                parameters: HashMap::from([
+                    (String::from("val1"), ParameterValue::Integer(i as i32)),
+                    (String::from("val2"), ParameterValue::Integer(2)),
+                ]),
+            })
+            .collect(),
+        session: None,
+    }
+}
+
+/// A request to run `count` instructions, alternating between the two instructions.
+fn run_request(count: usize, handles: bool) -> Request {
+    Request::RunInstructions {
+        instructions: (0..count)
+            .map(|i| {
+                if i % 2 == 0 {
+                    InstructionWithParameters {
+                        instruction: String::from("bench-add"),
+                        instruction_handle: handles.then_some(0),
+                        parameters: HashMap::from([
+                            (String::from("val1"), ParameterValue::Integer(i as i32)),
+                            (String::from("val2"), ParameterValue::Integer(2)),
+                        ]),
+                    }
+                } else {
+                    InstructionWithParameters {
+                        instruction: String::from("bench-count"),
+                        instruction_handle: handles.then_some(1),
+                        parameters: HashMap::new(),
+                    }
+                }
+            })
+            .collect(),
+        session: None,
+    }
+}
+
+fn process_request(c: &mut Criterion) {
+    let mut group = c.benchmark_group("process_request");
+    group.throughput(Throughput::Elements(DISPATCHED as u64));
+    for count in [10, 500] {
+        let engine = engine_with(count);
+        for (name, handles) in [("by handle", true), ("by id", false)] {
+            let request = dispatch_request(count, handles);
+            group.bench_with_input(BenchmarkId::new(name, count), &request, |b, request| {
+                b.iter(|| engine.process_request(black_box(request.clone())))
+            });
+        }
+    }
+    group.finish();
+}
+
+fn ffi_call(c: &mut Criterion) {
+    let mut group = c.benchmark_group("ta_call");
+    for count in [10, 500] {
+        group.throughput(Throughput::Elements(count as u64));
+        let request = run_request(count, true);
+
+        let json = CString::new(request.to_json()).unwrap();
+        group.bench_with_input(BenchmarkId::new("json", count), &json, |b, json| {
+            b.iter(|| unsafe {
+                let response = ta_call(black_box(json.as_ptr()));
+                let len = CStr::from_ptr(response).to_bytes().len();
+                ta_release(response);
+                len
+            })
+        });
+
+        let bin = request.to_msgpack();
+        group.bench_with_input(BenchmarkId::new("msgpack", count), &bin, |b, bin| {
+            b.iter(|| unsafe {
+                let mut len = 0;
+                let response = ta_call_bin(black_box(bin.as_ptr()), bin.len(), &mut len);
+                ta_release_bin(response, len);
+                len
+            })
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(benches, process_request, ffi_call);
+criterion_main!(benches);
@@ -1,7 +1,17 @@
-use std::{collections::HashMap, error::Error};
+use std::{
+    collections::HashMap,
+    error::Error,
+    sync::{
+        atomic::{AtomicU64, Ordering},
+        Arc, Mutex, RwLock,
+    },
+};
 
 pub use testangel_engine_macros::expose_engine;
 pub use testangel_ipc::prelude::*;
+pub use typed::{Outputs, ParameterType, Parameters};
+
+mod typed;
 
 pub type ParameterMap = HashMap<String, ParameterValue>;
 pub type OutputMap = HashMap<String, ParameterValue>;
@@ -16,8 +26,18 @@ pub struct Engine<'a, T: Default + Send + Sync> {
     name: String,
     version: String,
     instructions: Vec<Instruction>,
-    functions: HashMap<String, Box<FnEngineInstruction<'a, T>>>,
-    state: T,
+    /// The function for each instruction, in the same order as `instructions`.
+    functions: Vec<Box<FnEngineInstruction<'a, T>>>,
+    /// The validator for each instruction, in the same order as `instructions`.
+    validators: Vec<ParameterValidator>,
+    /// A lookup from instruction ID to the index of that instruction.
+    dispatch: HashMap<String, usize>,
+    /// The state used when a request doesn't specify a session.
+    state: Mutex<T>,
+    /// The state of each open session. Each session has its own lock, so sessions can run at
+    /// the same time.
+    sessions: RwLock<HashMap<u64, Arc<Mutex<T>>>>,
+    next_session: AtomicU64,
 }
 
 impl<'a, T: Default + Send + Sync> Engine<'a, T> {
@@ -28,7 +48,11 @@ impl<'a, T: Default + Send + Sync> Engine<'a, T> {
             version: version.as_ref().to_string(),
             instructions: vec![],
             state: Default::default(),
-            functions: HashMap::new(),
+            functions: Vec::new(),
+            validators: Vec::new(),
+            dispatch: HashMap::new(),
+            sessions: Default::default(),
+            next_session: AtomicU64::new(1),
         }
     }
 
@@ -45,18 +69,121 @@ impl<'a, T: Default + Send + Sync> Engine<'a, T> {
                 &mut EvidenceList,
             ) -> Result<(), Box<dyn Error>>,
     {
-        self.functions
-            .insert(instruction.id().clone(), Box::new(execute));
+        self.dispatch
+            .insert(instruction.id().clone(), self.instructions.len());
+        self.functions.push(Box::new(execute));
+        self.validators.push(instruction.validator());
         self.instructions.push(instruction);
         self
     }
 
-    /// Process a request and produce a response
-    pub fn process_request(&mut self, request: Request) -> Response {
+    /// Add an instruction whose function takes its parameters as a tuple and returns its
+    /// outputs as a tuple, instead of working with maps. The parameters and outputs are added to
+    /// `instruction` with the IDs and friendly names given, in the order of the tuples, and with
+    /// the kinds of the types the function uses, so they can't disagree with the function.
+    ///
+    /// ```ignore
+    /// .with_typed_instruction(
+    ///     Instruction::new("arithmetic-int-add", "Add (Integer)", "Add together two integers."),
+    ///     [("val1", "A"), ("val2", "B")],
+    ///     [("result", "A + B")],
+    ///     |_state, (val1, val2): (i32, i32), _evidence| Ok((val1 + val2,)),
+    /// )
+    /// ```
+    pub fn with_typed_instruction<P, O, F, const NP: usize, const NO: usize>(
+        self,
+        instruction: Instruction,
+        parameters: [(&str, &str); NP],
+        outputs: [(&str, &str); NO],
+        execute: F,
+    ) -> Self
+    where
+        P: Parameters<NP>,
+        O: Outputs<NO>,
+        F: 'a + Send + Sync + Fn(&mut T, P, &mut EvidenceList) -> Result<O, Box<dyn Error>>,
+    {
+        let mut instruction = instruction;
+        for ((id, friendly_name), kind) in parameters.iter().zip(P::KINDS) {
+            instruction = instruction.with_parameter(*id, *friendly_name, kind);
+        }
+        for ((id, friendly_name), kind) in outputs.iter().zip(O::KINDS) {
+            instruction = instruction.with_output(*id, *friendly_name, kind);
+        }
+        let parameter_ids = parameters.map(|(id, _)| id.to_string());
+        let output_ids = outputs.map(|(id, _)| id.to_string());
+
+        self.with_instruction(instruction, move |state, mut params, output, evidence| {
+            // The parameters have already been validated against the instruction, so this can
+            // only fail if the same ID was given for two parameters.
+            let params = P::take(&parameter_ids, &mut params)
+                .ok_or("The parameters given weren't of the kinds expected.")?;
+            let values = execute(state, params, evidence)?;
+            output.reserve(NO);
+            for (id, value) in output_ids.iter().zip(values.into_values()) {
+                output.insert(id.clone(), value);
+            }
+            Ok(())
+        })
+    }
+
+    /// Find the index of the requested instruction, using the handle if it is provided and
+    /// valid, otherwise looking up the ID.
+    fn resolve_instruction(&self, iwp: &InstructionWithParameters) -> Option<usize> {
+        iwp.instruction_handle
+            .filter(|handle| {
+                self.instructions
+                    .get(*handle)
+                    .is_some_and(|instruction| *instruction.id() == iwp.instruction)
+            })
+            .or_else(|| self.dispatch.get(&iwp.instruction).copied())
+    }
+
+    /// Get the state of a session.
+    fn session(&self, session: u64) -> Option<Arc<Mutex<T>>> {
+        self.sessions.read().unwrap().get(&session).cloned()
+    }
+
+    /// Run a closure with the state for a session, or the default state if no session is given.
+    fn with_state(&self, session: Option<u64>, f: impl FnOnce(&mut T) -> Response) -> Response {
+        match session {
+            None => f(&mut self.state.lock().unwrap_or_else(|e| e.into_inner())),
+            Some(session) => match self.session(session) {
+                Some(state) => f(&mut state.lock().unwrap_or_else(|e| e.into_inner())),
+                None => Response::Error {
+                    kind: ErrorKind::InvalidSession,
+                    reason: format!("The session {session} isn't open."),
+                },
+            },
+        }
+    }
+
+    /// Process a request and produce a response. Requests for different sessions can be
+    /// processed at the same time.
+    pub fn process_request(&self, request: Request) -> Response {
         match request {
-            Request::ResetState => {
-                self.state = Default::default();
+            Request::ResetState { session } => self.with_state(session, |state| {
+                *state = Default::default();
                 Response::StateReset
+            }),
+
+            Request::OpenSession => {
+                let session = self.next_session.fetch_add(1, Ordering::Relaxed);
+                self.sessions
+                    .write()
+                    .unwrap()
+                    .insert(session, Default::default());
+                Response::SessionOpened { session }
+            }
+
+            Request::CloseSession { session } => {
+                if self.sessions.write().unwrap().remove(&session).is_some() {
+                    Response::SessionClosed
+                } else {
+                    Response::Error {
+                        kind: ErrorKind::InvalidSession,
+                        reason: format!("The session {session} isn't open."),
+                    }
+                }
             }
 
             Request::Instructions => {
@@ -71,58 +198,77 @@ impl<'a, T: Default + Send + Sync> Engine<'a, T> {
 
             Request::RunInstructions {
                 instructions: requested_instructions,
-            } => {
-                let mut output = Vec::new();
-                let mut evidence = Vec::new();
-                'request_loop: for requested_instruction_with_params in requested_instructions {
-                    for instruction in &self.instructions {
-                        if requested_instruction_with_params.instruction == *instruction.id() {
-                            // run this instruction
-                            // Validate parameters
-                            if let Err((kind, reason)) =
-                                instruction.validate(&requested_instruction_with_params)
-                            {
-                                return Response::Error { kind, reason };
-                            }
-
-                            let parameters = requested_instruction_with_params.parameters;
-
-                            // Execute instruction
-                            let f = &self.functions[instruction.id()];
-                            let mut this_instruction_output = OutputMap::new();
-                            let mut this_instruction_evidence = EvidenceList::new();
-                            let instruction_result = f(
-                                &mut self.state,
-                                parameters,
-                                &mut this_instruction_output,
-                                &mut this_instruction_evidence,
-                            );
-                            if let Err(e) = instruction_result {
-                                return Response::Error {
-                                    kind: ErrorKind::EngineProcessingError,
-                                    reason: format!("{e}"),
-                                };
-                            }
-
-                            evidence.push(this_instruction_evidence);
-                            output.push(this_instruction_output);
-
-                            continue 'request_loop;
-                        }
+                session,
+            } => self.with_state(session, |state| {
+                let mut output = Vec::with_capacity(requested_instructions.len());
+                let mut evidence = Vec::with_capacity(requested_instructions.len());
+                for requested_instruction_with_params in requested_instructions {
+                    let Some(index) = self.resolve_instruction(&requested_instruction_with_params)
+                    else {
+                        // If the requested instruction doesn't match:
+                        return Response::Error {
+                            kind: ErrorKind::InvalidInstruction,
+                            reason: format!(
+                                "The requested instruction {} could not be handled by this engine.",
+                                requested_instruction_with_params.instruction
+                            ),
+                        };
+                    };
+
+                    // Validate parameters
+                    if let Err((kind, reason)) =
+                        self.validators[index].validate(&requested_instruction_with_params)
+                    {
+                        return Response::Error { kind, reason };
                     }
 
-                    // If the requested instruction doesn't match:
-                    return Response::Error {
-                        kind: ErrorKind::InvalidInstruction,
-                        reason: format!(
-                            "The requested instruction {} could not be handled by this engine.",
-                            requested_instruction_with_params.instruction
-                        ),
-                    };
+                    let parameters = requested_instruction_with_params.parameters;
+
+                    // Execute instruction
+                    let f = &self.functions[index];
+                    let mut this_instruction_output = OutputMap::new();
+                    let mut this_instruction_evidence = EvidenceList::new();
+                    let instruction_result = f(
+                        state,
+                        parameters,
+                        &mut this_instruction_output,
+                        &mut this_instruction_evidence,
+                    );
+                    if let Err(e) = instruction_result {
+                        return Response::Error {
+                            kind: ErrorKind::EngineProcessingError,
+                            reason: format!("{e}"),
+                        };
+                    }
+
+                    evidence.push(this_instruction_evidence);
+                    output.push(this_instruction_output);
                 }
 
                 Response::ExecutionOutput { output, evidence }
-            }
+            }),
         }
     }
 }
+
+/// Something that can process requests on behalf of an engine. This is implemented for
+/// [`Engine`] and for a [`Mutex`] holding an [`Engine`], so either can be exposed with
+/// [`expose_engine!`].
+pub trait EngineHandle {
+    /// Process a request and produce a response.
+    fn handle_request(&self, request: Request) -> Response;
+}
+
+impl<'a, T: Default + Send + Sync> EngineHandle for Engine<'a, T> {
+    fn handle_request(&self, request: Request) -> Response {
+        self.process_request(request)
+    }
+}
+
+impl<'a, T: Default + Send + Sync> EngineHandle for Mutex<Engine<'a, T>> {
+    fn handle_request(&self, request: Request) -> Response {
+        self.lock()
+            .expect("must be able to lock engine")
+            .process_request(request)
+    }
+}
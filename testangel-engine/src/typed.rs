@@ -0,0 +1,159 @@
+//! Typed parameters and outputs for instructions, so that an instruction's function can take
+//! its parameters as Rust values and return its outputs, rather than working with maps.
+
+use testangel_ipc::prelude::*;
+
+use crate::ParameterMap;
+
+/// A Rust type that a parameter or output of an instruction can have.
+pub trait ParameterType: Sized {
+    /// The kind of parameter this type is.
+    const KIND: ParameterKind;
+
+    /// Take the value of a parameter, if it is of this kind.
+    fn from_value(value: ParameterValue) -> Option<Self>;
+
+    /// Convert this into the value of an output.
+    fn into_value(self) -> ParameterValue;
+}
+
+impl ParameterType for String {
+    const KIND: ParameterKind = ParameterKind::String;
+
+    fn from_value(value: ParameterValue) -> Option<Self> {
+        match value {
+            ParameterValue::String(v) => Some(v),
+            _ => None,
+        }
+    }
+
+    fn into_value(self) -> ParameterValue {
+        ParameterValue::String(self)
+    }
+}
+
+impl ParameterType for i32 {
+    const KIND: ParameterKind = ParameterKind::Integer;
+
+    fn from_value(value: ParameterValue) -> Option<Self> {
+        match value {
+            ParameterValue::Integer(v) => Some(v),
+            _ => None,
+        }
+    }
+
+    fn into_value(self) -> ParameterValue {
+        ParameterValue::Integer(self)
+    }
+}
+
+impl ParameterType for f32 {
+    const KIND: ParameterKind = ParameterKind::Decimal;
+
+    fn from_value(value: ParameterValue) -> Option<Self> {
+        match value {
+            ParameterValue::Decimal(v) => Some(v),
+            _ => None,
+        }
+    }
+
+    fn into_value(self) -> ParameterValue {
+        ParameterValue::Decimal(self)
+    }
+}
+
+impl ParameterType for bool {
+    const KIND: ParameterKind = ParameterKind::Boolean;
+
+    fn from_value(value: ParameterValue) -> Option<Self> {
+        match value {
+            ParameterValue::Boolean(v) => Some(v),
+            _ => None,
+        }
+    }
+
+    fn into_value(self) -> ParameterValue {
+        ParameterValue::Boolean(self)
+    }
+}
+
+impl ParameterType for Vec<i32> {
+    const KIND: ParameterKind = ParameterKind::IntegerList;
+
+    fn from_value(value: ParameterValue) -> Option<Self> {
+        match value {
+            ParameterValue::IntegerList(v) => Some(v),
+            _ => None,
+        }
+    }
+
+    fn into_value(self) -> ParameterValue {
+        ParameterValue::IntegerList(self)
+    }
+}
+
+impl ParameterType for Vec<f32> {
+    const KIND: ParameterKind = ParameterKind::DecimalList;
+
+    fn from_value(value: ParameterValue) -> Option<Self> {
+        match value {
+            ParameterValue::DecimalList(v) => Some(v),
+            _ => None,
+        }
+    }
+
+    fn into_value(self) -> ParameterValue {
+        ParameterValue::DecimalList(self)
+    }
+}
+
+/// A tuple of `N` parameters of an instruction, in the order they are declared.
+pub trait Parameters<const N: usize>: Sized {
+    /// The kind of each parameter.
+    const KINDS: [ParameterKind; N];
+
+    /// Take the parameters with the given IDs out of a request's parameters, if they are all
+    /// present and of the right kinds. Strings are moved rather than cloned.
+    fn take(ids: &[String; N], parameters: &mut ParameterMap) -> Option<Self>;
+}
+
+/// A tuple of `N` outputs of an instruction, in the order they are declared.
+pub trait Outputs<const N: usize> {
+    /// The kind of each output.
+    const KINDS: [ParameterKind; N];
+
+    /// Convert the outputs into their values.
+    fn into_values(self) -> [ParameterValue; N];
+}
+
+macro_rules! impl_tuples {
+    ($n:literal; $($t:ident $idx:tt),*) => {
+        impl<$($t: ParameterType),*> Parameters<$n> for ($($t,)*) {
+            const KINDS: [ParameterKind; $n] = [$($t::KIND),*];
+
+            #[allow(unused_variables)]
+            fn take(ids: &[String; $n], parameters: &mut ParameterMap) -> Option<Self> {
+                Some(($($t::from_value(parameters.remove(&ids[$idx])?)?,)*))
+            }
+        }
+
+        impl<$($t: ParameterType),*> Outputs<$n> for ($($t,)*) {
+            const KINDS: [ParameterKind; $n] = [$($t::KIND),*];
+
+            #[allow(clippy::unused_unit)]
+            fn into_values(self) -> [ParameterValue; $n] {
+                [$(self.$idx.into_value()),*]
+            }
+        }
+    };
+}
+
+impl_tuples!(0;);
+impl_tuples!(1; A 0);
+impl_tuples!(2; A 0, B 1);
+impl_tuples!(3; A 0, B 1, C 2);
+impl_tuples!(4; A 0, B 1, C 2, D 3);
+impl_tuples!(5; A 0, B 1, C 2, D 3, E 4);
+impl_tuples!(6; A 0, B 1, C 2, D 3, E 4, F 5);
+impl_tuples!(7; A 0, B 1, C 2, D 3, E 4, F 5, G 6);
+impl_tuples!(8; A 0, B 1, C 2, D 3, E 4, F 5, G 6, H 7);
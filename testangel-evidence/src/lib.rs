@@ -1,10 +1,8 @@
-use std::sync::Mutex;
-
 use lazy_static::lazy_static;
 use testangel_engine::*;
 
 lazy_static! {
-    static ref ENGINE: Mutex<Engine<'static, ()>> = Mutex::new(Engine::new("Evidence", env!("CARGO_PKG_VERSION"))
+    static ref ENGINE: Engine<'static, ()> = Engine::new("Evidence", env!("CARGO_PKG_VERSION"))
     .with_instruction(
         Instruction::new(
             "evidence-add-text",
@@ -23,8 +21,7 @@ lazy_static! {
                 content: EvidenceContent::Textual(content),
             });
             Ok(())
-        })
-    );
+        });
 }
 
 expose_engine!(ENGINE);
@@ -0,0 +1,96 @@
+use std::collections::HashMap;
+
+use base64::Engine;
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use testangel_ipc::prelude::*;
+
+/// A request to run `count` instructions, each with a few parameters.
+fn run_request(count: usize) -> Request {
+    Request::RunInstructions {
+        instructions: (0..count)
+            .map(|i| InstructionWithParameters {
+                instruction: String::from("arithmetic-int-add"),
+                instruction_handle: Some(0),
+                parameters: HashMap::from([
+                    (String::from("val1"), ParameterValue::Integer(i as i32)),
+                    (String::from("val2"), ParameterValue::Integer(2)),
+                    (
+                        String::from("label"),
+                        ParameterValue::String(format!("Instruction {i}")),
+                    ),
+                ]),
+            })
+            .collect(),
+        session: Some(1),
+    }
+}
+
+/// A response to `count` instructions, each producing an output and an image of `image_size`
+/// bytes as evidence.
+fn output_response(count: usize, image_size: usize) -> Response {
+    let image: Vec<u8> = (0..image_size).map(|i| (i % 251) as u8).collect();
+    let base64 = base64::engine::general_purpose::STANDARD.encode(&image);
+    Response::ExecutionOutput {
+        output: (0..count)
+            .map(|i| HashMap::from([(String::from("result"), ParameterValue::Integer(i as i32))]))
+            .collect(),
+        evidence: (0..count)
+            .map(|i| {
+                vec![
+                    Evidence {
+                        label: format!("Step {i}"),
+                        content: EvidenceContent::Textual(String::from("Some text evidence.")),
+                    },
+                    Evidence {
+                        label: format!("Screenshot {i}"),
+                        content: EvidenceContent::ImageAsPngBase64(base64.clone()),
+                    },
+                ]
+            })
+            .collect(),
+    }
+}
+
+fn request_round_trip(c: &mut Criterion) {
+    let mut group = c.benchmark_group("request round trip");
+    for count in [1, 50, 500] {
+        let request = run_request(count);
+        group.throughput(Throughput::Elements(count as u64));
+        group.bench_with_input(BenchmarkId::new("json", count), &request, |b, request| {
+            b.iter(|| Request::try_from(black_box(request.to_json())).unwrap())
+        });
+        group.bench_with_input(
+            BenchmarkId::new("msgpack", count),
+            &request,
+            |b, request| {
+                b.iter(|| Request::try_from(black_box(request.to_msgpack().as_slice())).unwrap())
+            },
+        );
+    }
+    group.finish();
+}
+
+fn response_round_trip(c: &mut Criterion) {
+    let mut group = c.benchmark_group("response round trip");
+    // Small evidence, and evidence the size of a typical screenshot.
+    for image_size in [1024, 1024 * 1024] {
+        let response = output_response(4, image_size);
+        group.throughput(Throughput::Bytes((4 * image_size) as u64));
+        group.bench_with_input(
+            BenchmarkId::new("json", image_size),
+            &response,
+            |b, response| b.iter(|| Response::try_from(black_box(response.to_json())).unwrap()),
+        );
+        group.bench_with_input(
+            BenchmarkId::new("msgpack", image_size),
+            &response,
+            |b, response| {
+                b.iter(|| Response::try_from(black_box(response.to_msgpack().as_slice())).unwrap())
+            },
+        );
+    }
+    group.finish();
+}
+
+criterion_group!(benches, request_round_trip, response_round_trip);
+criterion_main!(benches);
@@ -21,4 +21,66 @@ pub enum EvidenceContent {
     Textual(String),
     /// A PNG encoded image encoded as a base64 string.
     ImageAsPngBase64(String),
+    /// A PNG encoded image. Over binary wire formats this is sent as raw bytes, and over JSON
+    /// as a base64 string.
+    ImageAsPng(
+        #[serde(with = "image_bytes")]
+        #[cfg_attr(feature = "schemas", schemars(with = "String"))]
+        Vec<u8>,
+    ),
+}
+
+/// (De)serialise image data as raw bytes for binary formats, and as base64 for human-readable
+/// formats.
+mod image_bytes {
+    use std::fmt;
+
+    use base64::Engine;
+    use serde::{de, Deserializer, Serializer};
+
+    pub fn serialize<S: Serializer>(data: &[u8], serializer: S) -> Result<S::Ok, S::Error> {
+        if serializer.is_human_readable() {
+            serializer.serialize_str(&base64::engine::general_purpose::STANDARD.encode(data))
+        } else {
+            serializer.serialize_bytes(data)
+        }
+    }
+
+    pub fn deserialize<'de, D: Deserializer<'de>>(deserializer: D) -> Result<Vec<u8>, D::Error> {
+        // Accept any representation, as the enum tagging may have buffered the content and lost
+        // track of whether the format is human-readable.
+        deserializer.deserialize_any(ImageBytesVisitor)
+    }
+
+    struct ImageBytesVisitor;
+
+    impl<'de> de::Visitor<'de> for ImageBytesVisitor {
+        type Value = Vec<u8>;
+
+        fn expecting(&self, f: &mut fmt::Formatter) -> fmt::Result {
+            write!(f, "image bytes or a base64 encoded string")
+        }
+
+        fn visit_str<E: de::Error>(self, v: &str) -> Result<Self::Value, E> {
+            base64::engine::general_purpose::STANDARD
+                .decode(v)
+                .map_err(E::custom)
+        }
+
+        fn visit_bytes<E: de::Error>(self, v: &[u8]) -> Result<Self::Value, E> {
+            Ok(v.to_vec())
+        }
+
+        fn visit_byte_buf<E: de::Error>(self, v: Vec<u8>) -> Result<Self::Value, E> {
+            Ok(v)
+        }
+
+        fn visit_seq<A: de::SeqAccess<'de>>(self, mut seq: A) -> Result<Self::Value, A::Error> {
+            let mut data = Vec::with_capacity(seq.size_hint().unwrap_or(0));
+            while let Some(byte) = seq.next_element()? {
+                data.push(byte);
+            }
+            Ok(data)
+        }
+    }
 }
@@ -22,6 +22,10 @@ pub struct Instruction {
     parameter_order: Vec<String>,
     /// The outputs this instruction produces, with a friendly name
     outputs: HashMap<String, (String, ParameterKind)>,
+    /// Whether this instruction always produces the same outputs from the same parameters,
+    /// without depending on or changing any state or producing evidence.
+    #[serde(default)]
+    pure: bool,
 }
 
 impl Instruction {
@@ -37,6 +41,7 @@ impl Instruction {
             parameters: HashMap::new(),
             parameter_order: Vec::new(),
             outputs: HashMap::new(),
+            pure: false,
         }
     }
 
@@ -66,29 +71,34 @@ impl Instruction {
         self
     }
 
+    /// Mark this instruction as pure, so that it always produces the same outputs from the same
+    /// parameters, without depending on or changing any state or producing evidence. The
+    /// results of pure instructions may be reused instead of calling them again.
+    pub fn pure(mut self) -> Self {
+        self.pure = true;
+        self
+    }
+
     pub fn validate(&self, iwp: &InstructionWithParameters) -> Result<(), (ErrorKind, String)> {
         for (id, (_, kind)) in &self.parameters {
-            if !iwp.parameters.contains_key(id) {
-                return Err((
-                    ErrorKind::MissingParameter,
-                    format!("Missing parameter {id} from call to {}", iwp.instruction),
-                ));
-            }
-
-            if iwp.parameters[id].kind() != *kind {
-                return Err((
-                    ErrorKind::InvalidParameterType,
-                    format!(
-                        "Invalid kind of parameter {id} from call to {}",
-                        iwp.instruction
-                    ),
-                ));
-            }
+            check_parameter(iwp, id, *kind)?;
         }
 
         Ok(())
     }
 
+    /// Build a validator for calls to this instruction, so that the parameters don't need to be
+    /// gathered from the instruction for every call.
+    pub fn validator(&self) -> ParameterValidator {
+        ParameterValidator {
+            parameters: self
+                .parameter_order
+                .iter()
+                .filter_map(|id| self.parameters.get(id).map(|(_, kind)| (id.clone(), *kind)))
+                .collect(),
+        }
+    }
+
     /// Get the ID of this instruction
     pub fn id(&self) -> &String {
         &self.id
@@ -113,6 +123,56 @@ impl Instruction {
     pub fn outputs(&self) -> &HashMap<String, (String, ParameterKind)> {
         &self.outputs
     }
+
+    /// Returns true if this instruction is pure, so its results can be reused.
+    pub fn is_pure(&self) -> bool {
+        self.pure
+    }
+}
+
+/// Checks the parameters of calls to an instruction. This is built from an instruction with
+/// [`Instruction::validator`].
+#[derive(Clone, Debug, PartialEq)]
+pub struct ParameterValidator {
+    /// The ID and kind of each parameter of the instruction, in order.
+    parameters: Box<[(String, ParameterKind)]>,
+}
+
+impl ParameterValidator {
+    /// Check that a call has each parameter of the instruction, of the right kind.
+    pub fn validate(&self, iwp: &InstructionWithParameters) -> Result<(), (ErrorKind, String)> {
+        for (id, kind) in self.parameters.iter() {
+            check_parameter(iwp, id, *kind)?;
+        }
+
+        Ok(())
+    }
+}
+
+/// Check that a call has a parameter of the right kind.
+fn check_parameter(
+    iwp: &InstructionWithParameters,
+    id: &str,
+    kind: ParameterKind,
+) -> Result<(), (ErrorKind, String)> {
+    let Some(value) = iwp.parameters.get(id) else {
+        return Err((
+            ErrorKind::MissingParameter,
+            format!("Missing parameter {id} from call to {}", iwp.instruction),
+        ));
+    };
+
+    if value.kind() != kind {
+        return Err((
+            ErrorKind::InvalidParameterType,
+            format!(
+                "Invalid kind of parameter {id} from call to {}",
+                iwp.instruction
+            ),
+        ));
+    }
+
+    Ok(())
 }
 
 /// An instruction with it's parameters.
@@ -121,6 +181,11 @@ impl Instruction {
 pub struct InstructionWithParameters {
     /// The ID of the instruction to run.
     pub instruction: String,
+    /// The index of the instruction in the list the engine returned for
+    /// [`Request::Instructions`](crate::Request::Instructions). If this is provided and refers to
+    /// the same instruction ID, the engine can dispatch to it without searching for the ID.
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    pub instruction_handle: Option<usize>,
     /// The parameters for the instruction.
     pub parameters: HashMap<String, ParameterValue>,
 }
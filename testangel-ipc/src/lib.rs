@@ -5,7 +5,7 @@ use serde::{Deserialize, Serialize};
 /// A prelude module to quickly import common imports.
 pub mod prelude {
     pub use crate::evidence::{Evidence, EvidenceContent};
-    pub use crate::instruction::{Instruction, InstructionWithParameters};
+    pub use crate::instruction::{Instruction, InstructionWithParameters, ParameterValidator};
     pub use crate::value::{ParameterKind, ParameterValue};
     pub use crate::{ErrorKind, Request, Response};
 }
@@ -18,7 +18,7 @@ use prelude::*;
 #[cfg(feature = "schemas")]
 use schemars::JsonSchema;
 
-/// The possible request messages that could be sent over the JSON IPC channel.
+/// The possible request messages that could be sent over the IPC channel.
 #[derive(Serialize, Deserialize, Clone, Debug, PartialEq)]
 #[cfg_attr(feature = "schemas", derive(JsonSchema))]
 #[serde(tag = "type")]
@@ -28,9 +28,22 @@ pub enum Request {
     /// Run the list of instructions given in the order they are listed.
     RunInstructions {
         instructions: Vec<InstructionWithParameters>,
+        /// The session to run these instructions in. If not provided, the engine's default
+        /// state is used.
+        #[serde(default, skip_serializing_if = "Option::is_none")]
+        session: Option<u64>,
     },
     /// Reset the state of this engine to the default.
-    ResetState,
+    ResetState {
+        /// The session to reset. If not provided, the engine's default state is reset.
+        #[serde(default, skip_serializing_if = "Option::is_none")]
+        session: Option<u64>,
+    },
+    /// Open a new session with its own state, so that more than one flow can use this engine
+    /// at the same time.
+    OpenSession,
+    /// Close a session, discarding its state.
+    CloseSession { session: u64 },
 }
 
 impl Request {
@@ -38,6 +51,11 @@ impl Request {
     pub fn to_json(&self) -> String {
         serde_json::to_string(self).unwrap()
     }
+
+    /// Convert this request to the binary (MessagePack) wire format
+    pub fn to_msgpack(&self) -> Vec<u8> {
+        rmp_serde::to_vec_named(self).unwrap()
+    }
 }
 
 impl TryFrom<String> for Request {
@@ -48,7 +66,15 @@ impl TryFrom<String> for Request {
     }
 }
 
-/// The possible response messages that could be sent over the JSON IPC channel.
+impl TryFrom<&[u8]> for Request {
+    type Error = rmp_serde::decode::Error;
+
+    fn try_from(value: &[u8]) -> Result<Self, Self::Error> {
+        rmp_serde::from_slice(value)
+    }
+}
+
+/// The possible response messages that could be sent over the IPC channel.
 #[derive(Serialize, Deserialize, Clone, Debug, PartialEq)]
 #[cfg_attr(feature = "schemas", derive(JsonSchema))]
 #[serde(tag = "type")]
@@ -73,6 +99,10 @@ pub enum Response {
     },
     /// The state of this engine has been reset.
     StateReset,
+    /// A session has been opened with the ID provided.
+    SessionOpened { session: u64 },
+    /// The session has been closed.
+    SessionClosed,
     /// An error occured.
     Error { kind: ErrorKind, reason: String },
 }
@@ -82,6 +112,11 @@ impl Response {
     pub fn to_json(&self) -> String {
         serde_json::to_string(self).unwrap()
     }
+
+    /// Convert this response to the binary (MessagePack) wire format
+    pub fn to_msgpack(&self) -> Vec<u8> {
+        rmp_serde::to_vec_named(self).unwrap()
+    }
 }
 
 impl TryFrom<String> for Response {
@@ -92,10 +127,18 @@ impl TryFrom<String> for Response {
     }
 }
 
+impl TryFrom<&[u8]> for Response {
+    type Error = rmp_serde::decode::Error;
+
+    fn try_from(value: &[u8]) -> Result<Self, <Self as TryFrom<&[u8]>>::Error> {
+        rmp_serde::from_slice(value)
+    }
+}
+
 #[derive(Serialize, Deserialize, Clone, Debug, PartialEq, Eq)]
 #[cfg_attr(feature = "schemas", derive(JsonSchema))]
 pub enum ErrorKind {
-    /// The IPC JSON request couldn't be parsed.
+    /// The IPC request couldn't be parsed. This is used for both the JSON and binary wire formats.
     FailedToParseIPCJson,
     /// You have asked this engine to run an instruction that it is not able to run.
     InvalidInstruction,
@@ -105,4 +148,6 @@ pub enum ErrorKind {
     InvalidParameterType,
     /// An error occurred within the engine whilst processing the request.
     EngineProcessingError,
+    /// The session requested isn't open.
+    InvalidSession,
 }
@@ -17,6 +17,10 @@ pub enum ParameterKind {
     Decimal,
     /// A boolean value.
     Boolean,
+    /// A list of integers.
+    IntegerList,
+    /// A list of decimal numbers.
+    DecimalList,
 }
 impl ParameterKind {
     pub fn default_value(&self) -> ParameterValue {
@@ -25,6 +29,8 @@ impl ParameterKind {
             Self::Integer => ParameterValue::Integer(0),
             Self::Decimal => ParameterValue::Decimal(0.),
             Self::Boolean => ParameterValue::Boolean(false),
+            Self::IntegerList => ParameterValue::IntegerList(vec![]),
+            Self::DecimalList => ParameterValue::DecimalList(vec![]),
         }
     }
 }
@@ -36,6 +42,8 @@ impl fmt::Display for ParameterKind {
             Self::Integer => write!(f, "Integer"),
             Self::Decimal => write!(f, "Decimal"),
             Self::Boolean => write!(f, "Boolean"),
+            Self::IntegerList => write!(f, "Integer List"),
+            Self::DecimalList => write!(f, "Decimal List"),
         }
     }
 }
@@ -53,6 +61,10 @@ pub enum ParameterValue {
     Decimal(f32),
     /// A boolean value
     Boolean(bool),
+    /// A list of integers, each a 32-bit signed integer.
+    IntegerList(Vec<i32>),
+    /// A list of decimal numbers, each a 32-bit float.
+    DecimalList(Vec<f32>),
 }
 
 impl ParameterValue {
@@ -88,6 +100,22 @@ impl ParameterValue {
         }
     }
 
+    /// Returns the value as a slice of i32s, or panics if it isn't an integer list.
+    pub fn value_i32_list(&self) -> &[i32] {
+        match self {
+            Self::IntegerList(v) => v,
+            _ => panic!("value isn't an integer list"),
+        }
+    }
+
+    /// Returns the value as a slice of f32s, or panics if it isn't a decimal list.
+    pub fn value_f32_list(&self) -> &[f32] {
+        match self {
+            Self::DecimalList(v) => v,
+            _ => panic!("value isn't a decimal list"),
+        }
+    }
+
     /// Get the kind of this parameter
     pub fn kind(&self) -> ParameterKind {
         match self {
@@ -95,6 +123,25 @@ impl ParameterValue {
             Self::Integer(_) => ParameterKind::Integer,
             Self::String(_) => ParameterKind::String,
             Self::Boolean(_) => ParameterKind::Boolean,
+            Self::IntegerList(_) => ParameterKind::IntegerList,
+            Self::DecimalList(_) => ParameterKind::DecimalList,
+        }
+    }
+
+    /// Parse a list of the given kind from its values separated by commas, as it is displayed.
+    /// Returns `None` if `kind` isn't a list kind or a value isn't valid.
+    pub fn parse_list(kind: ParameterKind, text: &str) -> Option<Self> {
+        let values = text.split(',').map(str::trim).filter(|v| !v.is_empty());
+        match kind {
+            ParameterKind::IntegerList => values
+                .map(|v| v.parse().ok())
+                .collect::<Option<_>>()
+                .map(Self::IntegerList),
+            ParameterKind::DecimalList => values
+                .map(|v| v.parse().ok())
+                .collect::<Option<_>>()
+                .map(Self::DecimalList),
+            _ => None,
         }
     }
 
@@ -130,6 +177,19 @@ impl fmt::Display for ParameterValue {
             Self::Decimal(a) => write!(f, "{a}"),
             Self::String(a) => write!(f, "{a}"),
             Self::Boolean(b) => write!(f, "{b}"),
+            Self::IntegerList(values) => write_list(f, values),
+            Self::DecimalList(values) => write_list(f, values),
+        }
+    }
+}
+
+/// Write the values of a list separated by commas.
+fn write_list<T: fmt::Display>(f: &mut fmt::Formatter<'_>, values: &[T]) -> fmt::Result {
+    for (idx, value) in values.iter().enumerate() {
+        if idx > 0 {
+            write!(f, ", ")?;
         }
+        write!(f, "{value}")?;
     }
+    Ok(())
 }
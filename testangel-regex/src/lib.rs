@@ -1,4 +1,4 @@
-use std::sync::Mutex;
+use std::collections::HashMap;
 
 use lazy_static::lazy_static;
 use regex::Regex;
@@ -11,8 +11,45 @@ pub enum EngineError {
     InvalidRegex(#[from] regex::Error),
 }
 
+/// The number of compiled regular expressions kept in each state.
+const CACHE_CAPACITY: usize = 64;
+
+#[derive(Default)]
+struct State {
+    /// Compiled regular expressions by pattern, with when each was last used.
+    cache: HashMap<String, (Regex, u64)>,
+    uses: u64,
+}
+
+impl State {
+    /// Get a compiled regular expression, compiling it if it isn't cached. If the cache is full,
+    /// the least recently used expression is dropped from it.
+    fn regex(&mut self, pattern: &str) -> Result<Regex, EngineError> {
+        self.uses += 1;
+        if let Some((regex, last_used)) = self.cache.get_mut(pattern) {
+            *last_used = self.uses;
+            return Ok(regex.clone());
+        }
+
+        let regex = Regex::new(pattern)?;
+        if self.cache.len() >= CACHE_CAPACITY {
+            let oldest = self
+                .cache
+                .iter()
+                .min_by_key(|(_, (_, last_used))| *last_used)
+                .map(|(pattern, _)| pattern.clone());
+            if let Some(oldest) = oldest {
+                self.cache.remove(&oldest);
+            }
+        }
+        self.cache
+            .insert(pattern.to_string(), (regex.clone(), self.uses));
+        Ok(regex)
+    }
+}
+
 lazy_static! {
-    static ref ENGINE: Mutex<Engine<'static, ()>> = Mutex::new(Engine::new("Regular Expressions", env!("CARGO_PKG_VERSION"))
+    static ref ENGINE: Engine<'static, State> = Engine::new("Regular Expressions", env!("CARGO_PKG_VERSION"))
     .with_instruction(
         Instruction::new(
             "regex-validate",
@@ -22,12 +59,12 @@ lazy_static! {
         .with_parameter("regex", "Regular Expression", ParameterKind::String)
         .with_parameter("input", "Input", ParameterKind::String)
         .with_parameter("error", "Error Message", ParameterKind::String),
-        |_state, params, _output, _evidence| {
+        |state: &mut State, params, _output, _evidence| {
             let regex = params["regex"].value_string();
             let input = params["input"].value_string();
             let error = params["error"].value_string();
 
-            let regex = Regex::new(&regex).map_err(EngineError::InvalidRegex)?;
+            let regex = state.regex(&regex)?;
             if !regex.is_match(&input) {
                 return Err(error.into())
             }
@@ -42,19 +79,59 @@ lazy_static! {
         )
         .with_parameter("regex", "Regular Expression", ParameterKind::String)
         .with_parameter("input", "Input", ParameterKind::String)
-        .with_output("match", "Input matches?", ParameterKind::Boolean),
-        |_state, params, output, _evidence| {
+        .with_output("match", "Input matches?", ParameterKind::Boolean)
+        .pure(),
+        |state: &mut State, params, output, _evidence| {
             let regex = params["regex"].value_string();
             let input = params["input"].value_string();
 
-            let regex = Regex::new(&regex).map_err(EngineError::InvalidRegex)?;
+            let regex = state.regex(&regex)?;
             output.insert(
                 "match".to_string(),
                 ParameterValue::Boolean(regex.is_match(&input)),
             );
             Ok(())
         })
-    );
+    .with_instruction(
+        Instruction::new(
+            "regex-match-list",
+            "Match List with Regular Expression",
+            "Matches each item of a delimited list against a regular expression, returning how many matched and the position of each match, starting from 1.",
+        )
+        .with_parameter("regex", "Regular Expression", ParameterKind::String)
+        .with_parameter("input", "Input List", ParameterKind::String)
+        .with_parameter("delimiter", "Delimiter", ParameterKind::String)
+        .with_output("count", "Number of matches", ParameterKind::Integer)
+        .with_output("matches", "Positions of matches (comma-separated)", ParameterKind::String)
+        .pure(),
+        |state: &mut State, params, output, _evidence| {
+            let regex = params["regex"].value_string();
+            let input = params["input"].value_string();
+            let delimiter = params["delimiter"].value_string();
+
+            let regex = state.regex(&regex)?;
+            let items: Vec<&str> = if delimiter.is_empty() {
+                input.lines().collect()
+            } else {
+                input.split(delimiter.as_str()).collect()
+            };
+            let matches: Vec<String> = items
+                .iter()
+                .enumerate()
+                .filter(|(_, item)| regex.is_match(item))
+                .map(|(idx, _)| (idx + 1).to_string())
+                .collect();
+
+            output.insert(
+                "count".to_string(),
+                ParameterValue::Integer(matches.len() as i32),
+            );
+            output.insert(
+                "matches".to_string(),
+                ParameterValue::String(matches.join(",")),
+            );
+            Ok(())
+        });
 }
 
 expose_engine!(ENGINE);
@@ -1,5 +1,3 @@
-use std::sync::Mutex;
-
 use lazy_static::lazy_static;
 use testangel_engine::*;
 use thiserror::Error;
@@ -13,7 +11,7 @@ pub enum FlowTermination {
 }
 
 lazy_static! {
-    static ref ENGINE: Mutex<Engine<'static, ()>> = Mutex::new(Engine::new("User Interaction", env!("CARGO_PKG_VERSION"))
+    static ref ENGINE: Engine<'static, ()> = Engine::new("User Interaction", env!("CARGO_PKG_VERSION"))
     .with_instruction(
         Instruction::new(
             "user-interaction-wait",
@@ -95,8 +93,7 @@ lazy_static! {
                 .show();
 
             Err(FlowTermination::StepTerminated.into())
-        })
-    );
+        });
 }
 
 expose_engine!(ENGINE);
@@ -0,0 +1,128 @@
+//! Benchmarks of loading and executing actions. These need the arithmetic engine, so build it
+//! and point `TA_ENGINE_DIR` at it first, for example:
+//!
+//! ```sh
+//! cargo build --release -p testangel-arithmetic
+//! TA_ENGINE_DIR=target/release cargo bench -p testangel --no-default-features
+//! ```
+
+use std::{collections::HashMap, env, fs, path::PathBuf, sync::Arc};
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use testangel::{
+    action_loader,
+    execution_plan::CompiledAction,
+    ipc::{self, EngineList, EngineSession},
+    types::{Action, ActionConfiguration, InstructionConfiguration, InstructionParameterSource},
+};
+use testangel_ipc::prelude::*;
+
+/// Load the engines, or return `None` if the arithmetic engine isn't available.
+fn engines() -> Option<Arc<EngineList>> {
+    let engine_list = ipc::get_engines();
+    if engine_list
+        .get_instruction_by_id(&String::from("arithmetic-int-add"))
+        .is_none()
+    {
+        eprintln!("Skipping: the arithmetic engine wasn't found in TA_ENGINE_DIR.");
+        return None;
+    }
+    Some(Arc::new(engine_list))
+}
+
+/// An action of `steps` additions, each adding one to the result of the one before.
+fn chained_action(steps: usize) -> Action {
+    let instructions = (0..steps)
+        .map(|step| {
+            let val1 = match step {
+                0 => InstructionParameterSource::FromParameter(0),
+                _ => InstructionParameterSource::FromOutput(step - 1, String::from("result")),
+            };
+            InstructionConfiguration {
+                instruction_id: String::from("arithmetic-int-add"),
+                parameter_sources: HashMap::from([
+                    (String::from("val1"), val1),
+                    (String::from("val2"), InstructionParameterSource::Literal),
+                ]),
+                parameter_values: HashMap::from([
+                    (String::from("val1"), ParameterValue::Integer(0)),
+                    (String::from("val2"), ParameterValue::Integer(1)),
+                ]),
+                ..Default::default()
+            }
+        })
+        .collect();
+    let mut action = Action::default();
+    action.id = format!("bench-{steps}");
+    action.friendly_name = format!("Add {steps} times");
+    action.parameters = vec![(String::from("Start"), ParameterKind::Integer)];
+    action.outputs = vec![(
+        String::from("Result"),
+        ParameterKind::Integer,
+        InstructionParameterSource::FromOutput(steps - 1, String::from("result")),
+    )];
+    action.instructions = instructions;
+    action
+}
+
+fn execute_directly(c: &mut Criterion) {
+    let Some(engine_list) = engines() else {
+        return;
+    };
+    let session = EngineSession::open(engine_list.clone());
+
+    let mut group = c.benchmark_group("execute_directly");
+    group.sample_size(20);
+    for steps in [100, 2000] {
+        let action = CompiledAction::compile(&engine_list, &chained_action(steps)).unwrap();
+        group.throughput(Throughput::Elements(steps as u64));
+        group.bench_with_input(BenchmarkId::from_parameter(steps), &action, |b, action| {
+            // Each execution starts with an empty memo, so every addition calls the engine.
+            b.iter(|| {
+                let mut evidence = vec![];
+                ActionConfiguration::execute_directly(
+                    &session,
+                    action,
+                    HashMap::from([(0, ParameterValue::Integer(0))]),
+                    &mut evidence,
+                )
+                .unwrap()
+            })
+        });
+    }
+    group.finish();
+}
+
+fn get_actions(c: &mut Criterion) {
+    let Some(engine_list) = engines() else {
+        return;
+    };
+
+    const ACTIONS: usize = 5000;
+    let dir = env::temp_dir().join(format!("testangel-bench-actions-{}", std::process::id()));
+    fs::create_dir_all(&dir).unwrap();
+    for i in 0..ACTIONS {
+        let mut action = chained_action(10);
+        action.id = format!("bench-action-{i}");
+        let path: PathBuf = dir.join(format!("{i}.taaction"));
+        fs::write(path, ron::to_string(&action).unwrap()).unwrap();
+    }
+    env::set_var("TA_ACTION_DIR", &dir);
+
+    let mut group = c.benchmark_group("get_actions");
+    group.sample_size(10);
+    group.throughput(Throughput::Elements(ACTIONS as u64));
+    group.bench_function(BenchmarkId::from_parameter(ACTIONS), |b| {
+        b.iter(|| action_loader::get_actions(engine_list.clone()))
+    });
+    let loaded = action_loader::get_actions(engine_list.clone());
+    group.bench_function(BenchmarkId::new("reload unchanged", ACTIONS), |b| {
+        b.iter(|| action_loader::reload_actions(engine_list.clone(), &loaded))
+    });
+    group.finish();
+
+    let _ = fs::remove_dir_all(dir);
+}
+
+criterion_group!(benches, execute_directly, get_actions);
+criterion_main!(benches);
@@ -0,0 +1,74 @@
+//! Benchmarks of report generation.
+
+use std::{env, fs, io::Cursor};
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use image::{ImageOutputFormat, Rgb, RgbImage, RgbaImage};
+use testangel::report_generation::{self, EvidenceSpool, ReportFormat, SpooledEvidence};
+use testangel_ipc::prelude::*;
+
+/// Encode a generated image as a PNG. RGBA images have to be converted before they can be
+/// included in a PDF, so a mix of both is used.
+fn screenshot(i: u32, rgba: bool) -> Vec<u8> {
+    let mut data = vec![];
+    let mut cursor = Cursor::new(&mut data);
+    if rgba {
+        RgbaImage::from_fn(1280, 720, |x, y| {
+            image::Rgba([(x + i) as u8, y as u8, 128, 255])
+        })
+        .write_to(&mut cursor, ImageOutputFormat::Png)
+        .unwrap();
+    } else {
+        RgbImage::from_fn(1280, 720, |x, y| Rgb([(x + i) as u8, y as u8, 128]))
+            .write_to(&mut cursor, ImageOutputFormat::Png)
+            .unwrap();
+    }
+    data
+}
+
+/// Spool `count` items of image evidence, each with a label.
+fn spool_images(count: u32) -> SpooledEvidence {
+    let mut spool = EvidenceSpool::temporary().unwrap();
+    let mut evidence = (0..count)
+        .map(|i| Evidence {
+            label: format!("Screenshot {i}"),
+            content: EvidenceContent::ImageAsPng(screenshot(i, i % 2 == 1)),
+        })
+        .collect();
+    spool.append_all(&mut evidence).unwrap();
+    spool.finish().unwrap()
+}
+
+fn save_report(c: &mut Criterion) {
+    let to = env::temp_dir().join(format!("testangel-bench-report-{}", std::process::id()));
+    let formats = [
+        ReportFormat::Pdf,
+        ReportFormat::Html,
+        ReportFormat::JsonLines,
+    ];
+    let mut group = c.benchmark_group("save_report");
+    group.sample_size(10);
+    for count in [10, 100] {
+        let evidence = spool_images(count);
+        group.throughput(Throughput::Elements(u64::from(count)));
+        for format in formats {
+            group.bench_with_input(
+                BenchmarkId::new(format.to_string(), count),
+                &evidence,
+                |b, evidence| {
+                    b.iter(|| report_generation::save_report(&to, format, evidence).unwrap())
+                },
+            );
+        }
+    }
+    group.finish();
+
+    for format in formats {
+        let report = to.with_extension(format.extension());
+        let _ = fs::remove_file(&report);
+        let _ = fs::remove_dir_all(&report);
+    }
+}
+
+criterion_group!(benches, save_report);
+criterion_main!(benches);
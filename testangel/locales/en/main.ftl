@@ -5,6 +5,7 @@ ok = Ok
 save = Save
 discard = Discard
 value = Value
+value-list = Values, separated by commas
 nothing-open = Nothing is Open
 delete = Delete
 
@@ -22,10 +23,15 @@ kind-string = Text
 kind-integer = Integer
 kind-decimal = Decimal
 kind-boolean = Boolean
+kind-integer-list = Integer List
+kind-decimal-list = Decimal List
 
 tab-flows = Flows
 tab-actions = Actions
 
+loading-engines = Loading engines…
+loading-actions = Loading actions…
+
 variable-row-edit-param = Edit Parameter
 variable-row-subtitle = { $kind }
 variable-row-subtitle-with-value = { $kind }, { $source }: { $value }
@@ -71,6 +77,14 @@ flow-save-open-error-flow-not-version-compatible = The flow you tried to load is
 flow-save-open-error-missing-action = The action for step { $step } (with internal ID: { $error }) in this flow is missing.
 
 flow-execution-running = Flow running...
+flow-execution-running-step = Running step { $step } of { $total }...
+flow-execution-step-running = Running...
+flow-execution-step-finished = Finished in { $time } ms with { $evidence } evidence
+flow-execution-step-failed = Failed
+flow-execution-cancel = Cancel
+flow-execution-cancelling = Cancelling...
+flow-execution-cancelled = Flow cancelled.
+flow-execution-cancelled-message = Flow was cancelled before step { $step }.
 flow-execution-failed = Flow failed.
 flow-execution-failed-message = Flow failed at step { $step }: { $reason }
 flow-execution-save-evidence-anyway = Save Evidence Anyway
@@ -5,6 +5,7 @@ ok = Okej
 save = Spara
 discard = Kasta
 value = Värde
+value-list = Värden, separerade med kommatecken
 nothing-open = Inget är öppet
 delete = Ta bort
 
@@ -22,10 +23,15 @@ kind-string = Text
 kind-integer = Heltal
 kind-decimal = Decimal
 kind-boolean = Booleskt
+kind-integer-list = Heltalslista
+kind-decimal-list = Decimallista
 
 tab-flows = Flöder
 tab-actions = Åtgärder
 
+loading-engines = Läser in motorer…
+loading-actions = Läser in åtgärder…
+
 variable-row-edit-param = Redigera parameter
 variable-row-subtitle = { $kind }
 variable-row-subtitle-with-value = { $kind }, { $source }: { $value }
@@ -68,6 +74,14 @@ flow-save-open-error-flow-not-version-compatible = Flödet du har öppnat är in
 flow-save-open-error-missing-action = Åtgärden för steg { $step } (med internt identifierare: { $error }) i detta flöde saknas.
 
 flow-execution-running = Flöde körs...
+flow-execution-running-step = Kör steg { $step } av { $total }...
+flow-execution-step-running = Körs...
+flow-execution-step-finished = Klart på { $time } ms med { $evidence } bevis
+flow-execution-step-failed = Misslyckades
+flow-execution-cancel = Avbryt
+flow-execution-cancelling = Avbryter...
+flow-execution-cancelled = Flödet avbröts.
+flow-execution-cancelled-message = Flödet avbröts före steg { $step }.
 flow-execution-failed = Flödet misslyckades.
 flow-execution-failed-message = Flödet misslyckades på steg { $step }: { $reason }
 flow-execution-save-evidence-anyway = Spara bevis ändå
@@ -1,90 +1,261 @@
-use std::{collections::HashMap, env, fs, path::PathBuf, sync::Arc};
+use std::{
+    collections::HashMap,
+    env, fs,
+    path::{Path, PathBuf},
+    sync::{Arc, OnceLock},
+    thread,
+};
 
-use crate::ipc::EngineList;
+use crate::ipc::{EngineList, FileStamp};
+use crate::search::{SearchIndex, SearchStep};
 use crate::types::{Action, VersionedFile};
 
+/// An action file that has been parsed, kept so it doesn't need parsing again until it changes.
+#[derive(Debug)]
+struct ParsedAction {
+    /// The stamp of the file when it was parsed. If `None`, it can't be checked for changes, so
+    /// will always be parsed again.
+    stamp: Option<FileStamp>,
+    action: Arc<Action>,
+}
+
 #[derive(Debug, Default)]
-pub struct ActionMap(HashMap<PathBuf, Action>);
+pub struct ActionMap {
+    /// A lookup from action ID to action.
+    by_id: HashMap<String, Arc<Action>>,
+    /// The loaded actions, grouped by action group.
+    by_group: HashMap<String, Vec<Arc<Action>>>,
+    /// Every action file that was parsed, whether or not it could be loaded.
+    parsed: HashMap<PathBuf, ParsedAction>,
+    /// The search index of the actions, built when it is first needed.
+    search_index: OnceLock<SearchIndex>,
+}
 
 impl ActionMap {
-    /// Get an action from an action ID by iterating through available actions.
-    pub fn get_action_by_id(&self, action_id: &String) -> Option<Action> {
-        for action in self.0.values() {
-            if action.id == *action_id {
-                return Some(action.clone());
+    /// Build an action map and its indices from a set of parsed action files, keeping only the
+    /// actions that can be run with the engines available.
+    fn new(engine_list: &EngineList, parsed: HashMap<PathBuf, ParsedAction>) -> Self {
+        let mut by_id = HashMap::new();
+        let mut by_group: HashMap<String, Vec<Arc<Action>>> = HashMap::new();
+        'action_loop: for (path, ParsedAction { action, .. }) in &parsed {
+            for instruction_config in &action.instructions {
+                if engine_list
+                    .get_instruction_by_id(&instruction_config.instruction_id)
+                    .is_none()
+                {
+                    log::warn!(
+                        "Couldn't load action {} because instruction {} isn't available.",
+                        action.friendly_name,
+                        instruction_config.instruction_id,
+                    );
+                    continue 'action_loop;
+                }
             }
+
+            log::info!(
+                "Discovered action {} ({}) at {:?}",
+                action.friendly_name,
+                action.id,
+                path,
+            );
+
+            by_id.insert(action.id.clone(), action.clone());
+            by_group
+                .entry(action.group.clone())
+                .or_default()
+                .push(action.clone());
+        }
+        Self {
+            by_id,
+            by_group,
+            parsed,
+            search_index: OnceLock::new(),
         }
-        None
+    }
+
+    /// Build an action map for tests from actions that haven't been read from files.
+    #[cfg(test)]
+    pub(crate) fn from_actions(engine_list: &EngineList, actions: Vec<Action>) -> Self {
+        let parsed = actions
+            .into_iter()
+            .map(|action| {
+                let path = PathBuf::from(format!("{}.taaction", action.id));
+                let action = Arc::new(action);
+                (
+                    path,
+                    ParsedAction {
+                        stamp: None,
+                        action,
+                    },
+                )
+            })
+            .collect();
+        Self::new(engine_list, parsed)
+    }
+
+    /// Get an action from an action ID.
+    pub fn get_action_by_id(&self, action_id: &String) -> Option<Arc<Action>> {
+        self.by_id.get(action_id).cloned()
     }
 
     /// Get actions grouped by action group
-    pub fn get_by_group(&self) -> HashMap<String, Vec<Action>> {
-        let mut map = HashMap::new();
-        for action in self.0.values() {
-            map.entry(action.group.clone()).or_default();
-            map.entry(action.group.clone())
-                .and_modify(|vec: &mut Vec<Action>| vec.push(action.clone()));
+    pub fn get_by_group(&self) -> &HashMap<String, Vec<Arc<Action>>> {
+        &self.by_group
+    }
+
+    /// Get the search index of the actions, labelled `group: name`. It is built the first time
+    /// this is called, which may take a while with a large number of actions.
+    pub fn search_index(&self) -> &SearchIndex {
+        self.search_index.get_or_init(|| {
+            SearchIndex::new(self.by_id.values().map(|action| SearchStep {
+                label: format!("{}: {}", action.group, action.friendly_name),
+                value: action.id.clone(),
+                description: action.description.clone(),
+                group: action.group.clone(),
+                hidden: !action.visible,
+            }))
+        })
+    }
+}
+
+/// Read and parse an action file.
+fn parse_action(path: &Path) -> Option<Action> {
+    let Ok(res) = fs::read_to_string(path) else {
+        log::warn!("Couldn't read action {path:?}");
+        return None;
+    };
+
+    match ron::from_str::<Action>(&res) {
+        Ok(action) if action.version() == 1 => Some(action),
+        Ok(_) => {
+            log::warn!("Action {path:?} uses an incompatible file version.");
+            None
+        }
+        Err(_) => {
+            // Only check the version to explain why the action couldn't be parsed.
+            match ron::from_str::<VersionedFile>(&res) {
+                Ok(versioned_file) if versioned_file.version() != 1 => {
+                    log::warn!("Action {path:?} uses an incompatible file version.")
+                }
+                _ => log::warn!("Couldn't parse action {path:?}"),
+            }
+            None
         }
-        map
     }
 }
 
-/// Get the list of available engines.
-pub fn get_actions(engine_list: Arc<EngineList>) -> ActionMap {
-    let mut actions = HashMap::new();
+/// Get the paths of the action files in the action directory.
+pub fn action_files() -> Vec<PathBuf> {
     let action_dir = env::var("TA_ACTION_DIR").unwrap_or("./actions".to_owned());
     fs::create_dir_all(action_dir.clone()).unwrap();
-    'action_loop: for path in fs::read_dir(action_dir).unwrap() {
+
+    let mut files = Vec::new();
+    for path in fs::read_dir(action_dir).unwrap() {
         let path = path.unwrap();
-        let filename = path.file_name();
         if let Ok(meta) = path.metadata() {
             if meta.is_dir() {
                 continue;
             }
         }
 
-        if let Ok(str) = filename.into_string() {
+        if let Ok(str) = path.file_name().into_string() {
             if str.ends_with(".taaction") {
                 log::debug!("Detected possible action {str}");
-                if let Ok(res) = fs::read_to_string(path.path()) {
-                    if let Ok(versioned_file) = ron::from_str::<VersionedFile>(&res) {
-                        if versioned_file.version() != 1 {
-                            log::warn!("Action {str} uses an incompatible file version.");
-                            continue 'action_loop;
-                        }
-                    }
-
-                    if let Ok(action) = ron::from_str::<Action>(&res) {
-                        for instruction_config in &action.instructions {
-                            if engine_list
-                                .get_instruction_by_id(&instruction_config.instruction_id)
-                                .is_none()
-                            {
-                                log::warn!(
-                                    "Couldn't load action {} because instruction {} isn't available.",
-                                    action.friendly_name,
-                                    instruction_config.instruction_id,
-                                );
-                                continue 'action_loop;
-                            }
-                        }
-
-                        log::info!(
-                            "Discovered action {} ({}) at {:?}",
-                            action.friendly_name,
-                            action.id,
-                            path.path(),
-                        );
-
-                        actions.insert(path.path(), action);
-                    } else {
-                        log::warn!("Couldn't parse action");
-                    }
-                } else {
-                    log::warn!("Couldn't read action");
-                }
+                files.push(path.path());
             }
         }
     }
-    ActionMap(actions)
+    files
+}
+
+/// Build the list of available actions from actions that have already been parsed, for example
+/// from a suite bundle.
+pub fn get_actions_from(
+    engine_list: Arc<EngineList>,
+    actions: Vec<(PathBuf, Action)>,
+) -> ActionMap {
+    let parsed = actions
+        .into_iter()
+        .map(|(path, action)| {
+            let stamp = fs::metadata(&path)
+                .ok()
+                .and_then(|meta| FileStamp::new(&meta));
+            (
+                path,
+                ParsedAction {
+                    stamp,
+                    action: Arc::new(action),
+                },
+            )
+        })
+        .collect();
+    ActionMap::new(&engine_list, parsed)
+}
+
+/// Get the list of available actions.
+pub fn get_actions(engine_list: Arc<EngineList>) -> ActionMap {
+    load_actions(&engine_list, None)
+}
+
+/// Get the list of available actions again, only parsing the action files that have been
+/// added or changed since `previous` was loaded.
+pub fn reload_actions(engine_list: Arc<EngineList>, previous: &ActionMap) -> ActionMap {
+    load_actions(&engine_list, Some(previous))
+}
+
+/// Load actions, reusing those already parsed in `previous` if their files are unchanged. The
+/// remaining files are parsed in parallel.
+fn load_actions(engine_list: &EngineList, previous: Option<&ActionMap>) -> ActionMap {
+    let mut parsed = HashMap::new();
+    let mut to_parse = Vec::new();
+    for path in action_files() {
+        let stamp = fs::metadata(&path)
+            .ok()
+            .and_then(|meta| FileStamp::new(&meta));
+        let unchanged = previous
+            .and_then(|previous| previous.parsed.get(&path))
+            .filter(|prev| stamp.is_some() && stamp == prev.stamp);
+        match unchanged {
+            Some(prev) => {
+                let action = prev.action.clone();
+                parsed.insert(path, ParsedAction { stamp, action });
+            }
+            None => to_parse.push((path, stamp)),
+        }
+    }
+
+    let threads = thread::available_parallelism()
+        .map(|n| n.get())
+        .unwrap_or(1)
+        .min(to_parse.len());
+    if threads > 0 {
+        let chunk_size = to_parse.len().div_ceil(threads);
+        thread::scope(|s| {
+            let handles: Vec<_> = to_parse
+                .chunks(chunk_size)
+                .map(|chunk| {
+                    s.spawn(move || {
+                        chunk
+                            .iter()
+                            .filter_map(|(path, stamp)| {
+                                let action = parse_action(path)?;
+                                Some((
+                                    path.clone(),
+                                    ParsedAction {
+                                        stamp: *stamp,
+                                        action: Arc::new(action),
+                                    },
+                                ))
+                            })
+                            .collect::<Vec<_>>()
+                    })
+                })
+                .collect();
+            for handle in handles {
+                parsed.extend(handle.join().unwrap_or_default());
+            }
+        });
+    }
+
+    ActionMap::new(engine_list, parsed)
 }
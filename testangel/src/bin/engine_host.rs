@@ -0,0 +1,13 @@
+use std::path::PathBuf;
+
+fn main() {
+    let Some(path) = std::env::args_os().nth(1) else {
+        eprintln!("Usage: testangel-engine-host <engine>");
+        std::process::exit(1);
+    };
+
+    if let Err(e) = testangel::engine_host::serve(PathBuf::from(path)) {
+        eprintln!("Engine host failed: {e}");
+        std::process::exit(1);
+    }
+}
@@ -1,68 +1,766 @@
-use std::{collections::HashMap, fs, path::PathBuf, sync::Arc};
+use std::{
+    collections::HashMap,
+    fs::{self, File},
+    io::{self, BufRead, BufReader, BufWriter},
+    path::{Path, PathBuf},
+    process::{Command, Stdio},
+    sync::{
+        atomic::{AtomicUsize, Ordering},
+        Arc,
+    },
+    thread,
+    time::{Duration, Instant},
+};
 
 use clap::{arg, Parser};
-use testangel::{types::AutomationFlow, *};
+use serde::{Deserialize, Serialize};
+use testangel::{
+    action_loader::ActionMap,
+    bundle::{BundleError, SuiteBundle},
+    checkpoint::{Checkpoint, CheckpointError},
+    dataset::Dataset,
+    execution_plan::CompiledFlow,
+    ipc::{EngineList, EngineSession},
+    report_generation::{EvidenceDirReader, EvidenceSpool, ReportFormat, SpooledEvidence},
+    types::{Action, AutomationFlow},
+    *,
+};
 use testangel_ipc::prelude::*;
 
+/// How often to write a checkpoint while a flow is executing. One is also written when a step
+/// fails.
+const CHECKPOINT_INTERVAL: Duration = Duration::from_secs(10);
+
 #[derive(Parser)]
 
 struct Cli {
-    /// The output for the report.
+    /// The output for the report. Only used when a single flow is executed.
     #[arg(short, long, default_value = "report.pdf")]
     report: PathBuf,
 
-    /// The flow file to execute.
-    #[arg(index = 1)]
-    flow: PathBuf,
+    /// The format to write reports in: `pdf`, a self-contained `html` file, or `jsonl` for a
+    /// directory of the raw evidence files with a JSON-lines index.
+    #[arg(long, default_value_t = ReportFormat::Pdf)]
+    report_format: ReportFormat,
+
+    /// The directory to write reports to when more than one flow is executed. Each report is
+    /// named after its flow.
+    #[arg(long)]
+    report_dir: Option<PathBuf>,
+
+    /// The number of flows to execute at once. Defaults to the number of CPUs available.
+    #[arg(short, long)]
+    jobs: Option<usize>,
+
+    /// Load flows and actions from a suite bundle. Any that have changed since the bundle was
+    /// written are read from their source instead. If no flows are given, every flow in the
+    /// bundle is executed.
+    #[arg(long)]
+    bundle: Option<PathBuf>,
+
+    /// Write the flows given and every available action to a suite bundle, then exit without
+    /// executing anything.
+    #[arg(long, conflicts_with = "bundle")]
+    write_bundle: Option<PathBuf>,
+
+    /// Record how long each step, engine call and report takes. A timing summary is added to the
+    /// end of each report, and a Chrome trace is written alongside it (`report.trace.json` for
+    /// `report.pdf`).
+    #[arg(long)]
+    timings: bool,
+
+    /// Generate the report from an evidence spool kept by an earlier execution that failed, or
+    /// from a directory written with `--report-format jsonl`, then exit without executing
+    /// anything.
+    #[arg(long, conflicts_with_all = ["bundle", "write_bundle"])]
+    from_evidence: Option<PathBuf>,
+
+    /// Execute a single flow once for each row of a CSV or JSON-lines dataset, with the columns
+    /// giving values for the parameters of the flow by name. Rows are executed in `--jobs`
+    /// engine sessions at once. The report for each row is written to `--report-dir` (by
+    /// default, a directory named after `--report`), and a summary of every row to `--report`.
+    #[arg(long, conflicts_with_all = ["write_bundle", "from_evidence"])]
+    dataset: Option<PathBuf>,
+
+    /// Continue each flow from the checkpoint left by an earlier execution that failed or was
+    /// interrupted, instead of starting from the beginning. The outputs of the steps that had
+    /// finished are restored and their evidence is kept. Flows without a checkpoint are executed
+    /// from the beginning.
+    #[arg(long, conflicts_with_all = ["write_bundle", "from_evidence"])]
+    resume: bool,
+
+    /// Print a line of JSON to stdout for each flow executed, saying whether it failed. Worker
+    /// processes use this to report their results.
+    #[arg(long, hide = true)]
+    report_results: bool,
+
+    /// The flow files to execute, or directories containing flow files.
+    #[arg(
+        index = 1,
+        required_unless_present_any = ["bundle", "from_evidence"],
+        num_args = 1..
+    )]
+    flows: Vec<PathBuf>,
 }
 
 fn main() {
     pretty_env_logger::init();
 
     let cli = Cli::parse();
+    if cli.timings {
+        timing::enable();
+    }
+
+    if let Some(evidence_path) = &cli.from_evidence {
+        let result = if evidence_path.is_dir() {
+            EvidenceDirReader::open(evidence_path).and_then(|evidence| {
+                report_generation::write_report(&cli.report, cli.report_format, evidence)
+            })
+        } else {
+            SpooledEvidence::open(evidence_path)
+                .map_err(Into::into)
+                .and_then(|spool| {
+                    report_generation::save_report(&cli.report, cli.report_format, &spool)
+                })
+        };
+        if let Err(e) = result.map_err(|e| format!("Failed to generate report: {e}")) {
+            eprintln!("{e}");
+            std::process::exit(1);
+        }
+        return;
+    }
+
+    let mut flows = collect_flows(&cli.flows);
+
+    if let Some(bundle_path) = &cli.write_bundle {
+        if let Err(e) = write_bundle(bundle_path, &flows) {
+            eprintln!("Failed to write bundle: {e}");
+            std::process::exit(1);
+        }
+        return;
+    }
+
+    let bundle = cli.bundle.as_ref().map(|bundle_path| {
+        match SuiteBundle::read(bundle_path).and_then(SuiteBundle::into_current) {
+            Ok((actions, flows)) => (actions, flows.into_iter().collect::<HashMap<_, _>>()),
+            Err(e) => {
+                eprintln!("Failed to read bundle: {e}");
+                std::process::exit(1);
+            }
+        }
+    });
+    if let (true, Some((_, bundled_flows))) = (flows.is_empty(), &bundle) {
+        flows = bundled_flows.keys().cloned().collect();
+        flows.sort();
+    }
+    if flows.is_empty() {
+        eprintln!("No flows to execute.");
+        std::process::exit(1);
+    }
 
-    let flow: AutomationFlow =
-        ron::from_str(&fs::read_to_string(cli.flow).expect("Failed to read flow."))
-            .expect("Failed to parse flow.");
+    let jobs = cli.jobs.unwrap_or_else(|| {
+        thread::available_parallelism()
+            .map(|n| n.get())
+            .unwrap_or(1)
+    });
+
+    if let Some(dataset) = &cli.dataset {
+        if flows.len() != 1 {
+            eprintln!("Exactly one flow must be given to execute with a dataset.");
+            std::process::exit(1);
+        }
+        let path = &flows[0];
+        let report_dir = cli
+            .report_dir
+            .clone()
+            .unwrap_or_else(|| cli.report.with_extension(""));
+        let (engine_map, action_map, mut bundled_flows) = load(bundle);
+        let flow = match bundled_flows.remove(path) {
+            Some(flow) => Ok(flow),
+            None => read_flow(path),
+        };
+        let result = flow.and_then(|flow| {
+            run_dataset(
+                &flow,
+                dataset,
+                &cli.report,
+                &report_dir,
+                cli.report_format,
+                jobs,
+                cli.resume,
+                &action_map,
+                engine_map,
+            )
+        });
+        match result {
+            Ok(0) => (),
+            Ok(failed) => {
+                eprintln!("{failed} row(s) of the dataset failed.");
+                std::process::exit(1);
+            }
+            Err(e) => {
+                eprintln!("{}: {e}", path.display());
+                std::process::exit(1);
+            }
+        }
+        return;
+    }
+
+    let jobs = jobs.clamp(1, flows.len());
+
+    // With a single flow given, keep writing its report to the single report path.
+    let report_dir = match (&cli.report_dir, flows.len()) {
+        (None, 1) => None,
+        (dir, _) => Some(dir.clone().unwrap_or_else(|| PathBuf::from("."))),
+    };
+
+    if let Some(dir) = &report_dir {
+        fs::create_dir_all(dir).expect("Failed to create report directory.");
+    }
+
+    let failed = if jobs > 1 {
+        run_workers(
+            &flows,
+            jobs,
+            report_dir.as_ref().unwrap(),
+            cli.report_format,
+            cli.timings,
+            cli.resume,
+            cli.bundle.as_ref(),
+        )
+    } else {
+        let (engine_map, action_map, mut bundled_flows) = load(bundle);
+
+        let mut failed = 0;
+        for path in &flows {
+            let report = match &report_dir {
+                Some(dir) => report_path(dir, path),
+                None => cli.report.clone(),
+            };
+            let flow = match bundled_flows.remove(path) {
+                Some(flow) => Ok(flow),
+                None => read_flow(path),
+            };
+            let result = flow.and_then(|flow| {
+                run_flow(
+                    &flow,
+                    &report,
+                    cli.report_format,
+                    cli.resume,
+                    &action_map,
+                    engine_map.clone(),
+                )
+            });
+            if let Err(e) = &result {
+                eprintln!("{}: {e}", path.display());
+                failed += 1;
+            }
+            if cli.report_results {
+                let line = FlowResult {
+                    flow: path.clone(),
+                    failed: result.is_err(),
+                };
+                println!("{}", serde_json::to_string(&line).unwrap());
+            }
+        }
+        failed
+    };
+
+    if failed > 0 {
+        eprintln!("{failed} of {} flow(s) failed.", flows.len());
+        std::process::exit(1);
+    }
+}
+
+/// Load the engines, and the actions from the bundle if one is given or from the action
+/// directory otherwise. The flows from the bundle are returned with them.
+#[allow(clippy::type_complexity)]
+fn load(
+    bundle: Option<(Vec<(PathBuf, Action)>, HashMap<PathBuf, AutomationFlow>)>,
+) -> (Arc<EngineList>, ActionMap, HashMap<PathBuf, AutomationFlow>) {
     let engine_map = Arc::new(ipc::get_engines());
-    let action_map = Arc::new(action_loader::get_actions(engine_map.clone()));
+    let (action_map, bundled_flows) = match bundle {
+        Some((actions, flows)) => (
+            action_loader::get_actions_from(engine_map.clone(), actions),
+            flows,
+        ),
+        None => (
+            action_loader::get_actions(engine_map.clone()),
+            HashMap::new(),
+        ),
+    };
+    (engine_map, action_map, bundled_flows)
+}
 
+/// Expand directories into the flow files they contain, keeping files as they are given.
+fn collect_flows(paths: &[PathBuf]) -> Vec<PathBuf> {
+    let mut flows = Vec::new();
+    for path in paths {
+        if path.is_dir() {
+            let mut dir_flows: Vec<PathBuf> = fs::read_dir(path)
+                .expect("Failed to read flow directory.")
+                .filter_map(|entry| entry.ok().map(|entry| entry.path()))
+                .filter(|path| {
+                    path.is_file() && path.extension().is_some_and(|ext| ext == "taflow")
+                })
+                .collect();
+            dir_flows.sort();
+            flows.extend(dir_flows);
+        } else {
+            flows.push(path.clone());
+        }
+    }
+    flows
+}
+
+/// Write the flows given and every available action to a suite bundle.
+fn write_bundle(to: &Path, flows: &[PathBuf]) -> Result<(), BundleError> {
+    let mut bundle = SuiteBundle::default();
+    for path in action_loader::action_files() {
+        if let Err(e) = bundle.add_action(&path) {
+            eprintln!("Skipping action {}: {e}", path.display());
+        }
+    }
+    for path in flows {
+        bundle.add_flow(path)?;
+    }
+    bundle.write(to)
+}
+
+/// Read a flow from its source file.
+fn read_flow(path: &Path) -> Result<AutomationFlow, String> {
+    ron::from_str(&fs::read_to_string(path).map_err(|e| format!("Failed to read flow: {e}"))?)
+        .map_err(|e| format!("Failed to parse flow: {e}"))
+}
+
+/// Get the path of the report for a flow within a report directory.
+fn report_path(report_dir: &Path, flow: &Path) -> PathBuf {
+    let mut name = flow.file_stem().unwrap_or(flow.as_os_str()).to_os_string();
+    name.push(".pdf");
+    report_dir.join(name)
+}
+
+/// The result of a flow executed by a worker process, reported with `--report-results`.
+#[derive(Serialize, Deserialize)]
+struct FlowResult {
+    flow: PathBuf,
+    failed: bool,
+}
+
+/// Split the flows between worker processes and wait for them all to finish. Each worker loads
+/// the engines and actions once and then executes its share of the flows one after another, so
+/// engine state is never shared between flows running at the same time. Returns the number of
+/// flows that failed, counting any flows a worker didn't report the result of because it
+/// stopped early.
+fn run_workers(
+    flows: &[PathBuf],
+    jobs: usize,
+    report_dir: &Path,
+    report_format: ReportFormat,
+    timings: bool,
+    resume: bool,
+    bundle: Option<&PathBuf>,
+) -> usize {
+    let exe = std::env::current_exe().expect("Failed to find the executor.");
+
+    let mut workers = Vec::with_capacity(jobs);
+    for worker in 0..jobs {
+        let share: Vec<&PathBuf> = flows.iter().skip(worker).step_by(jobs).collect();
+        let mut command = Command::new(&exe);
+        command
+            .arg("--jobs")
+            .arg("1")
+            .arg("--report-dir")
+            .arg(report_dir)
+            .arg("--report-format")
+            .arg(report_format.to_string())
+            .arg("--report-results")
+            .stdout(Stdio::piped());
+        if timings {
+            command.arg("--timings");
+        }
+        if resume {
+            command.arg("--resume");
+        }
+        if let Some(bundle) = bundle {
+            command.arg("--bundle").arg(bundle);
+        }
+        let child = command
+            .args(&share)
+            .spawn()
+            .expect("Failed to start worker.");
+        workers.push((child, share.len()));
+    }
+
+    // Read the results from every worker at once, so none is held up by a full pipe.
+    thread::scope(|s| {
+        let readers: Vec<_> = workers
+            .into_iter()
+            .map(|(mut child, count)| {
+                let reader = s.spawn(move || {
+                    let mut reported = 0;
+                    let mut failed = 0;
+                    if let Some(stdout) = child.stdout.take() {
+                        for line in BufReader::new(stdout).lines().map_while(Result::ok) {
+                            match serde_json::from_str::<FlowResult>(&line) {
+                                Ok(result) => {
+                                    reported += 1;
+                                    failed += usize::from(result.failed);
+                                }
+                                // Anything else the worker printed, such as from an engine.
+                                Err(_) => println!("{line}"),
+                            }
+                        }
+                    }
+                    if !child.wait().is_ok_and(|status| status.success()) && reported < count {
+                        log::warn!(
+                            "A worker stopped before reporting the results of {} flow(s).",
+                            count - reported
+                        );
+                    }
+                    failed + count.saturating_sub(reported)
+                });
+                (reader, count)
+            })
+            .collect();
+        // If reading the results of a worker failed, none of its flows are known to have passed.
+        readers
+            .into_iter()
+            .map(|(reader, count)| reader.join().unwrap_or(count))
+            .sum()
+    })
+}
+
+/// Execute a single flow and write its report, and its trace if timings are being recorded.
+fn run_flow(
+    flow: &AutomationFlow,
+    report: &Path,
+    report_format: ReportFormat,
+    resume: bool,
+    action_map: &ActionMap,
+    engine_map: Arc<EngineList>,
+) -> Result<(), String> {
+    let result = compile_flow(flow, action_map, engine_map).and_then(|compiled| {
+        let parameters = compiled
+            .parameter_kinds()
+            .iter()
+            .map(|kind| kind.default_value())
+            .collect();
+        execute_flow(
+            &compiled,
+            flow,
+            &compiled.open_sessions(),
+            parameters,
+            report,
+            report_format,
+            true,
+            resume,
+        )
+    });
+    write_trace(report);
+    result
+}
+
+/// Execute a flow once for each row of a dataset, sharing the rows between up to `jobs`
+/// sessions executing at once. The report for each row is written to `report_dir`, and a
+/// summary of every row to `summary`. Returns the number of rows that failed.
+#[allow(clippy::too_many_arguments)]
+fn run_dataset(
+    flow: &AutomationFlow,
+    dataset: &Path,
+    summary: &Path,
+    report_dir: &Path,
+    report_format: ReportFormat,
+    jobs: usize,
+    resume: bool,
+    action_map: &ActionMap,
+    engine_map: Arc<EngineList>,
+) -> Result<usize, String> {
+    let compiled = compile_flow(flow, action_map, engine_map)?;
+    let dataset = Dataset::read(dataset, &flow.parameters)
+        .map_err(|e| format!("Failed to read dataset: {e}"))?;
+    if dataset.is_empty() {
+        return Err(String::from("The dataset has no rows."));
+    }
+    fs::create_dir_all(report_dir)
+        .map_err(|e| format!("Failed to create report directory: {e}"))?;
+
+    // Rows can only be executed at the same time if they each have their own engine state.
+    let first_sessions = compiled.open_sessions();
+    let jobs = if jobs > 1 && !first_sessions[0].is_isolated() {
+        log::warn!("An engine used by this flow doesn't support sessions, so rows will be executed one at a time.");
+        1
+    } else {
+        jobs.clamp(1, dataset.len())
+    };
+    let sessions: Vec<_> = std::iter::once(first_sessions)
+        .chain((1..jobs).map(|_| compiled.open_sessions()))
+        .collect();
+
+    let next_row = AtomicUsize::new(0);
+    let mut results: Vec<(usize, Result<(), String>)> = thread::scope(|s| {
+        let workers: Vec<_> = sessions
+            .iter()
+            .map(|sessions| {
+                let (compiled, dataset, next_row) = (&compiled, &dataset, &next_row);
+                s.spawn(move || {
+                    let mut results = Vec::new();
+                    loop {
+                        let row = next_row.fetch_add(1, Ordering::Relaxed);
+                        let Some(values) = dataset.rows().get(row) else {
+                            break;
+                        };
+                        let report = report_dir.join(format!("row-{:05}.pdf", row + 1));
+                        let result = execute_flow(
+                            compiled,
+                            flow,
+                            sessions,
+                            values.clone(),
+                            &report,
+                            report_format,
+                            false,
+                            resume,
+                        );
+                        results.push((row, result));
+                    }
+                    results
+                })
+            })
+            .collect();
+        workers
+            .into_iter()
+            .flat_map(|worker| {
+                worker
+                    .join()
+                    .unwrap_or_else(|e| std::panic::resume_unwind(e))
+            })
+            .collect()
+    });
+    results.sort_unstable_by_key(|(row, _)| *row);
+
+    let failed = results.iter().filter(|(_, result)| result.is_err()).count();
+    let mut rows = String::new();
+    for (row, result) in &results {
+        match result {
+            Ok(()) => rows.push_str(&format!("Row {}: Passed\n", row + 1)),
+            Err(e) => rows.push_str(&format!("Row {}: {e}\n", row + 1)),
+        }
+    }
+    let mut evidence = vec![
+        Evidence {
+            label: String::from("Dataset Summary"),
+            content: EvidenceContent::Textual(format!(
+                "{} of {} rows passed. The report for each row is in {}.",
+                results.len() - failed,
+                results.len(),
+                report_dir.display(),
+            )),
+        },
+        Evidence {
+            label: String::from("Rows"),
+            content: EvidenceContent::Textual(rows),
+        },
+    ];
+    if timing::is_enabled() {
+        evidence.push(Evidence {
+            label: String::from("Timing Summary"),
+            content: EvidenceContent::Textual(timing::summary(&timing::recorded())),
+        });
+    }
+    report_generation::write_report(summary, report_format, evidence.into_iter().map(Ok))
+        .map_err(|e| format!("Failed to generate summary report: {e}"))?;
+    write_trace(summary);
+    Ok(failed)
+}
+
+/// Write the trace of everything timed so far alongside a report, if timings are being
+/// recorded.
+fn write_trace(report: &Path) {
+    if timing::is_enabled() {
+        let trace_path = report.with_extension("trace.json");
+        let written = File::create(&trace_path)
+            .and_then(|file| timing::write_chrome_trace(BufWriter::new(file), &timing::take()));
+        if let Err(e) = written {
+            eprintln!("Failed to write trace {}: {e}", trace_path.display());
+        }
+    }
+}
+
+/// Read the checkpoint to resume a flow from, if there is one for this flow with these
+/// parameters.
+fn read_checkpoint(
+    path: &Path,
+    flow: &AutomationFlow,
+    parameters: &[ParameterValue],
+) -> Option<Checkpoint> {
+    match Checkpoint::read(path) {
+        Ok(checkpoint) if checkpoint.matches(flow, parameters) => Some(checkpoint),
+        Ok(_) => {
+            log::warn!(
+                "The checkpoint {} is for a different flow or parameters, so it will be executed from the beginning.",
+                path.display()
+            );
+            None
+        }
+        Err(CheckpointError::Io(e)) if e.kind() == io::ErrorKind::NotFound => None,
+        Err(e) => {
+            log::warn!(
+                "{e} The flow will be executed from the beginning. ({})",
+                path.display()
+            );
+            None
+        }
+    }
+}
+
+/// Write a checkpoint, warning if it can't be written.
+fn write_checkpoint(checkpoint: &Checkpoint, path: &Path) {
+    if let Err(e) = checkpoint.write(path) {
+        log::warn!("{e} ({})", path.display());
+    }
+}
+
+/// Check that every action a flow uses is available, and compile it.
+fn compile_flow(
+    flow: &AutomationFlow,
+    action_map: &ActionMap,
+    engine_map: Arc<EngineList>,
+) -> Result<CompiledFlow, String> {
     // Check flow for actions that aren't available.
     for action_config in &flow.actions {
         if action_map
             .get_action_by_id(&action_config.action_id)
             .is_none()
         {
-            eprintln!("This flow cannot be executed because an action isn't available or wasn't loaded. Maybe an engine is missing?");
-            std::process::exit(1);
+            return Err(String::from("This flow cannot be executed because an action isn't available or wasn't loaded. Maybe an engine is missing?"));
         }
     }
 
-    let mut outputs: Vec<HashMap<usize, ParameterValue>> = Vec::new();
+    CompiledFlow::compile(flow, action_map, engine_map)
+        .map_err(|e| format!("This flow cannot be executed: {e}"))
+}
+
+/// Execute a compiled flow with the given parameters within its sessions, and write its
+/// report. If `timing_summary` is set and timings are being recorded, a summary of them is
+/// added to the end of the report. If `resume` is set and a checkpoint was left by an earlier
+/// execution of the same flow with the same parameters, execution continues from it.
+#[allow(clippy::too_many_arguments)]
+fn execute_flow(
+    compiled: &CompiledFlow,
+    flow: &AutomationFlow,
+    sessions: &[EngineSession],
+    parameters: Vec<ParameterValue>,
+    report: &Path,
+    report_format: ReportFormat,
+    timing_summary: bool,
+    resume: bool,
+) -> Result<(), String> {
+    // Evidence is written out after each step rather than held until the end, so a failed or
+    // interrupted execution still leaves the evidence collected up to that point.
+    let spool_path = report.with_extension("taspool");
+    let checkpoint_path = report.with_extension("tacheckpoint");
     let mut evidence = Vec::new();
 
-    for engine in engine_map.inner() {
-        if engine.reset_state().is_err() {
-            evidence.push(Evidence {
-                label: String::from("WARNING: State Warning"),
-                content: EvidenceContent::Textual(String::from("For this test execution, the state couldn't be correctly reset. Some results may not be accurate."))
-            });
+    let resumed = if resume {
+        read_checkpoint(&checkpoint_path, flow, &parameters)
+    } else {
+        None
+    };
+    let (mut spool, mut checkpoint, registers) = match resumed {
+        Some(checkpoint) => {
+            let spool = checkpoint
+                .resume_spool(&spool_path)
+                .map_err(|e| format!("Failed to reopen evidence spool: {e}"))?;
+            log::info!(
+                "Resuming {} from step {}",
+                report.display(),
+                checkpoint.completed_steps() + 1
+            );
+            let registers = checkpoint.registers(compiled);
+            (spool, checkpoint, registers)
         }
-    }
+        None => {
+            let mut spool = EvidenceSpool::create(&spool_path)
+                .map_err(|e| format!("Failed to create evidence spool: {e}"))?;
+            if sessions
+                .iter()
+                .any(|session| session.reset_state().is_err())
+            {
+                evidence.push(Evidence {
+                    label: String::from("WARNING: State Warning"),
+                    content: EvidenceContent::Textual(String::from("For this test execution, the state couldn't be correctly reset. Some results may not be accurate."))
+                });
+            }
+            spool
+                .append_all(&mut evidence)
+                .map_err(|e| format!("Failed to write evidence spool: {e}"))?;
+            let mut checkpoint = Checkpoint::new(flow, parameters.clone());
+            checkpoint.record_spool(&spool);
+            (spool, checkpoint, compiled.new_registers_with(parameters))
+        }
+    };
 
-    for action_config in flow.actions {
-        match action_config.execute(action_map.clone(), engine_map.clone(), outputs.clone()) {
-            Ok((output, ev)) => {
-                outputs.push(output);
-                evidence = vec![evidence, ev].concat();
+    let mut spool_error = None;
+    let mut last_checkpoint = Instant::now();
+    let result = compiled.execute_scheduled(
+        sessions,
+        registers,
+        checkpoint.completed_steps(),
+        None,
+        |_step| (),
+        |step, _duration, mut step_evidence, outputs| {
+            let _span = timing::span("spool evidence").step(step);
+            if spool_error.is_some() {
+                return;
             }
-            Err(e) => {
-                panic!("Failed to execute: {e}");
+            if let Err(e) = spool.append_all(&mut step_evidence) {
+                spool_error = Some(e);
+                return;
+            }
+            if let Some(outputs) = outputs {
+                checkpoint.record_step(outputs, &spool);
+                if last_checkpoint.elapsed() >= CHECKPOINT_INTERVAL {
+                    write_checkpoint(&checkpoint, &checkpoint_path);
+                    last_checkpoint = Instant::now();
+                }
             }
+        },
+    );
+    if let Some(e) = spool_error {
+        return Err(format!("Failed to write evidence spool: {e}"));
+    }
+    if let Err((step, e)) = result {
+        write_checkpoint(&checkpoint, &checkpoint_path);
+        return Err(format!(
+            "Failed to execute step {}: {e} The evidence collected is kept in {}, and execution can be continued from step {} with --resume.",
+            step + 1,
+            spool_path.display(),
+            checkpoint.completed_steps() + 1,
+        ));
+    }
+    if let Err(e) = fs::remove_file(&checkpoint_path) {
+        if e.kind() != io::ErrorKind::NotFound {
+            log::warn!("Failed to remove checkpoint: {e}");
         }
     }
 
-    if let Err(e) = report_generation::save_report(cli.report, evidence) {
-        eprintln!("Failed to generate report: {e}");
+    if timing_summary && timing::is_enabled() {
+        evidence.push(Evidence {
+            label: String::from("Timing Summary"),
+            content: EvidenceContent::Textual(timing::summary(&timing::recorded())),
+        });
+    }
+
+    let spool = spool
+        .append_all(&mut evidence)
+        .and_then(|()| spool.finish())
+        .map_err(|e| format!("Failed to write evidence spool: {e}"))?;
+    let span = timing::span("report generation");
+    report_generation::save_report(report, report_format, &spool)
+        .map_err(|e| format!("Failed to generate report: {e}"))?;
+    drop(span);
+    if let Err(e) = spool.remove() {
+        log::warn!("Failed to remove evidence spool: {e}");
     }
+    Ok(())
 }
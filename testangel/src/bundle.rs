@@ -0,0 +1,156 @@
+//! Suite bundles, which pack many flows and actions into a single binary file.
+//!
+//! The RON files remain the source of truth. Each bundled flow and action records the hash of
+//! the source it was built from, and if that source is present and has changed it is read in
+//! place of the bundled copy.
+
+use std::{
+    fs, io,
+    path::{Path, PathBuf},
+};
+
+use serde::{de::DeserializeOwned, Deserialize, Serialize};
+use thiserror::Error;
+
+use crate::types::{Action, AutomationFlow};
+
+/// The version of the suite bundle format.
+const BUNDLE_VERSION: usize = 1;
+
+#[derive(Error, Debug)]
+pub enum BundleError {
+    #[error("Failed to read or write the bundle.")]
+    Io(#[from] io::Error),
+    #[error("Failed to encode the bundle.")]
+    Encode(#[from] rmp_serde::encode::Error),
+    #[error("Failed to decode the bundle.")]
+    Decode(#[from] rmp_serde::decode::Error),
+    #[error("The bundle uses an incompatible version.")]
+    IncompatibleVersion,
+    #[error("Failed to parse {0:?}.")]
+    Parse(PathBuf, #[source] ron::error::SpannedError),
+    #[error("{0:?} uses an incompatible file version.")]
+    IncompatibleFile(PathBuf),
+}
+
+/// Hash the text of a source file using 64-bit FNV-1a.
+fn source_hash(text: &[u8]) -> u64 {
+    const OFFSET_BASIS: u64 = 0xcbf29ce484222325;
+    const PRIME: u64 = 0x100000001b3;
+    text.iter().fold(OFFSET_BASIS, |hash, byte| {
+        (hash ^ u64::from(*byte)).wrapping_mul(PRIME)
+    })
+}
+
+/// A flow or action with the path and hash of the source it was built from.
+#[derive(Debug, Serialize, Deserialize)]
+struct BundledItem<T> {
+    path: PathBuf,
+    hash: u64,
+    item: T,
+}
+
+impl<T: DeserializeOwned> BundledItem<T> {
+    /// Read and parse a source file.
+    fn from_source(path: &Path) -> Result<Self, BundleError> {
+        let text = fs::read_to_string(path)?;
+        let item = ron::from_str(&text).map_err(|e| BundleError::Parse(path.to_path_buf(), e))?;
+        Ok(Self {
+            path: path.to_path_buf(),
+            hash: source_hash(text.as_bytes()),
+            item,
+        })
+    }
+
+    /// Get the item, reading it from its source instead if the source has changed since this
+    /// was bundled. If the source isn't present, the bundled item is used.
+    fn into_current(self) -> Result<(PathBuf, T), BundleError> {
+        let Ok(text) = fs::read_to_string(&self.path) else {
+            return Ok((self.path, self.item));
+        };
+        if source_hash(text.as_bytes()) == self.hash {
+            return Ok((self.path, self.item));
+        }
+
+        log::warn!(
+            "{:?} has changed since the bundle was written, so it is read from its source.",
+            self.path
+        );
+        let item = ron::from_str(&text).map_err(|e| BundleError::Parse(self.path.clone(), e))?;
+        Ok((self.path, item))
+    }
+}
+
+/// A packed set of flows and actions.
+#[derive(Debug, Serialize, Deserialize)]
+pub struct SuiteBundle {
+    version: usize,
+    actions: Vec<BundledItem<Action>>,
+    flows: Vec<BundledItem<AutomationFlow>>,
+}
+
+impl Default for SuiteBundle {
+    fn default() -> Self {
+        Self {
+            version: BUNDLE_VERSION,
+            actions: vec![],
+            flows: vec![],
+        }
+    }
+}
+
+impl SuiteBundle {
+    /// Add an action to this bundle from its source file.
+    pub fn add_action(&mut self, path: &Path) -> Result<(), BundleError> {
+        let action = BundledItem::<Action>::from_source(path)?;
+        if action.item.version() != 1 {
+            return Err(BundleError::IncompatibleFile(path.to_path_buf()));
+        }
+        self.actions.push(action);
+        Ok(())
+    }
+
+    /// Add a flow to this bundle from its source file.
+    pub fn add_flow(&mut self, path: &Path) -> Result<(), BundleError> {
+        let flow = BundledItem::<AutomationFlow>::from_source(path)?;
+        if flow.item.version() != 1 {
+            return Err(BundleError::IncompatibleFile(path.to_path_buf()));
+        }
+        self.flows.push(flow);
+        Ok(())
+    }
+
+    /// Write this bundle to a file.
+    pub fn write<P: AsRef<Path>>(&self, to: P) -> Result<(), BundleError> {
+        fs::write(to, rmp_serde::to_vec_named(self)?)?;
+        Ok(())
+    }
+
+    /// Read a bundle from a file.
+    pub fn read<P: AsRef<Path>>(from: P) -> Result<Self, BundleError> {
+        let bundle: Self = rmp_serde::from_slice(&fs::read(from)?)?;
+        if bundle.version != BUNDLE_VERSION {
+            return Err(BundleError::IncompatibleVersion);
+        }
+        Ok(bundle)
+    }
+
+    /// Take the actions and flows from this bundle, with their source paths. Any whose source
+    /// has changed since the bundle was written are read from their source instead.
+    #[allow(clippy::type_complexity)]
+    pub fn into_current(
+        self,
+    ) -> Result<(Vec<(PathBuf, Action)>, Vec<(PathBuf, AutomationFlow)>), BundleError> {
+        let actions = self
+            .actions
+            .into_iter()
+            .map(BundledItem::into_current)
+            .collect::<Result<_, _>>()?;
+        let flows = self
+            .flows
+            .into_iter()
+            .map(BundledItem::into_current)
+            .collect::<Result<_, _>>()?;
+        Ok((actions, flows))
+    }
+}
@@ -0,0 +1,266 @@
+//! Checkpoints of the progress of executing a flow, so that a long execution that stops part way
+//! through can be resumed from the last step that succeeded.
+//!
+//! A checkpoint records the outputs of every step that has finished and how much of the evidence
+//! spool they account for. Resuming puts those outputs back into the register file and reopens
+//! the spool at that point, then executes the remaining steps.
+
+use std::{fs, io, path::Path};
+
+use serde::{Deserialize, Serialize};
+use testangel_ipc::prelude::*;
+use thiserror::Error;
+
+use crate::{
+    execution_plan::CompiledFlow, report_generation::EvidenceSpool, types::AutomationFlow,
+};
+
+/// The version of the checkpoint format.
+const CHECKPOINT_VERSION: usize = 1;
+
+#[derive(Error, Debug)]
+pub enum CheckpointError {
+    #[error("Failed to read or write the checkpoint.")]
+    Io(#[from] io::Error),
+    #[error("Failed to encode the checkpoint.")]
+    Encode(#[from] rmp_serde::encode::Error),
+    #[error("Failed to decode the checkpoint.")]
+    Decode(#[from] rmp_serde::decode::Error),
+    #[error("The checkpoint uses an incompatible version.")]
+    IncompatibleVersion,
+}
+
+/// The progress of one execution of a flow.
+#[derive(Clone, Debug, Serialize, Deserialize)]
+pub struct Checkpoint {
+    version: usize,
+    /// The action of each step of the flow, so that a checkpoint isn't resumed against a flow
+    /// whose steps have changed.
+    actions: Vec<String>,
+    /// The values of the parameters of the flow.
+    parameters: Vec<ParameterValue>,
+    /// The outputs of each step that has finished, in order.
+    outputs: Vec<Vec<ParameterValue>>,
+    /// The number of items of evidence spooled by those steps.
+    evidence_count: usize,
+    /// The length of the spool in bytes after those steps.
+    spool_length: u64,
+}
+
+impl Checkpoint {
+    /// Start a checkpoint for executing a flow with the given parameters, before any step has
+    /// finished.
+    pub fn new(flow: &AutomationFlow, parameters: Vec<ParameterValue>) -> Self {
+        Self {
+            version: CHECKPOINT_VERSION,
+            actions: flow.actions.iter().map(|a| a.action_id.clone()).collect(),
+            parameters,
+            outputs: vec![],
+            evidence_count: 0,
+            spool_length: 0,
+        }
+    }
+
+    /// Returns true if this checkpoint was taken while executing this flow with these
+    /// parameters.
+    pub fn matches(&self, flow: &AutomationFlow, parameters: &[ParameterValue]) -> bool {
+        self.parameters == parameters
+            && self.actions.len() == flow.actions.len()
+            && self
+                .actions
+                .iter()
+                .zip(&flow.actions)
+                .all(|(id, action)| *id == action.action_id)
+    }
+
+    /// The number of steps that had finished.
+    pub fn completed_steps(&self) -> usize {
+        self.outputs.len()
+    }
+
+    /// Record that the next step has finished with these outputs, and its evidence has been
+    /// written to `spool`.
+    pub fn record_step(&mut self, outputs: &[ParameterValue], spool: &EvidenceSpool) {
+        self.outputs.push(outputs.to_vec());
+        self.evidence_count = spool.len();
+        self.spool_length = spool.byte_len();
+    }
+
+    /// Record that the evidence written to `spool` before the first step should be kept.
+    pub fn record_spool(&mut self, spool: &EvidenceSpool) {
+        self.evidence_count = spool.len();
+        self.spool_length = spool.byte_len();
+    }
+
+    /// Create the register file to resume executing a compiled flow with, holding the
+    /// parameters and the outputs of every step that had finished.
+    pub fn registers(&self, compiled: &CompiledFlow) -> Vec<ParameterValue> {
+        let mut registers = compiled.new_registers_with(self.parameters.clone());
+        for (step, outputs) in self.outputs.iter().enumerate() {
+            compiled.write_outputs(step, &mut registers, outputs.clone());
+        }
+        registers
+    }
+
+    /// Reopen the spool at `path` to continue writing the evidence after the steps that had
+    /// finished.
+    pub fn resume_spool<P: AsRef<Path>>(&self, path: P) -> io::Result<EvidenceSpool> {
+        EvidenceSpool::resume(path, self.evidence_count, self.spool_length)
+    }
+
+    /// Write this checkpoint to a file. It is written alongside first and then renamed, so an
+    /// earlier checkpoint isn't lost if writing is interrupted.
+    pub fn write<P: AsRef<Path>>(&self, to: P) -> Result<(), CheckpointError> {
+        let to = to.as_ref();
+        let partial = to.with_extension("tacheckpoint.partial");
+        fs::write(&partial, rmp_serde::to_vec_named(self)?)?;
+        fs::rename(partial, to)?;
+        Ok(())
+    }
+
+    /// Read a checkpoint from a file.
+    pub fn read<P: AsRef<Path>>(from: P) -> Result<Self, CheckpointError> {
+        let checkpoint: Self = rmp_serde::from_slice(&fs::read(from)?)?;
+        if checkpoint.version != CHECKPOINT_VERSION {
+            return Err(CheckpointError::IncompatibleVersion);
+        }
+        Ok(checkpoint)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::{env, path::PathBuf};
+
+    use super::*;
+    use crate::{report_generation::SpooledEvidence, types::ActionConfiguration};
+
+    fn flow(actions: &[&str]) -> AutomationFlow {
+        let mut flow = AutomationFlow::default();
+        flow.actions = actions
+            .iter()
+            .map(|id| ActionConfiguration {
+                action_id: id.to_string(),
+                ..Default::default()
+            })
+            .collect();
+        flow
+    }
+
+    fn evidence(label: &str) -> Evidence {
+        Evidence {
+            label: label.to_string(),
+            content: EvidenceContent::Textual(String::new()),
+        }
+    }
+
+    fn temp_path(name: &str) -> PathBuf {
+        env::temp_dir().join(format!("testangel-{}-{name}", std::process::id()))
+    }
+
+    fn labels(spool: &Path) -> Vec<String> {
+        SpooledEvidence::open(spool)
+            .unwrap()
+            .read()
+            .unwrap()
+            .map(|ev| ev.unwrap().label)
+            .collect()
+    }
+
+    #[test]
+    fn round_trip() {
+        let flow = flow(&["a", "b", "c"]);
+        let parameters = vec![ParameterValue::Integer(1)];
+        let spool_path = temp_path("round-trip.taspool");
+        let checkpoint_path = temp_path("round-trip.tacheckpoint");
+
+        let mut spool = EvidenceSpool::create(&spool_path).unwrap();
+        let mut checkpoint = Checkpoint::new(&flow, parameters.clone());
+        spool.append_all(&mut vec![evidence("before")]).unwrap();
+        checkpoint.record_spool(&spool);
+        spool.append_all(&mut vec![evidence("a")]).unwrap();
+        checkpoint.record_step(&[ParameterValue::String("out".to_string())], &spool);
+        checkpoint.write(&checkpoint_path).unwrap();
+        // Evidence from a step that didn't finish
+        spool.append_all(&mut vec![evidence("b")]).unwrap();
+        drop(spool);
+
+        let read = Checkpoint::read(&checkpoint_path).unwrap();
+        assert!(read.matches(&flow, &parameters));
+        assert_eq!(read.completed_steps(), 1);
+        assert_eq!(read.outputs, checkpoint.outputs);
+
+        let mut spool = read.resume_spool(&spool_path).unwrap();
+        assert_eq!(spool.len(), 2);
+        spool.append_all(&mut vec![evidence("b again")]).unwrap();
+        drop(spool);
+        assert_eq!(labels(&spool_path), ["before", "a", "b again"]);
+
+        let _ = fs::remove_file(spool_path);
+        let _ = fs::remove_file(checkpoint_path);
+    }
+
+    #[test]
+    fn resume_at_end() {
+        let flow = flow(&["a", "b"]);
+        let spool_path = temp_path("end.taspool");
+        let checkpoint_path = temp_path("end.tacheckpoint");
+
+        let mut spool = EvidenceSpool::create(&spool_path).unwrap();
+        let mut checkpoint = Checkpoint::new(&flow, vec![]);
+        for step in ["a", "b"] {
+            spool.append_all(&mut vec![evidence(step)]).unwrap();
+            checkpoint.record_step(&[], &spool);
+        }
+        checkpoint.write(&checkpoint_path).unwrap();
+        drop(spool);
+
+        let read = Checkpoint::read(&checkpoint_path).unwrap();
+        assert_eq!(read.completed_steps(), flow.actions.len());
+        let spool = read.resume_spool(&spool_path).unwrap();
+        assert_eq!(spool.len(), 2);
+        assert_eq!(spool.byte_len(), fs::metadata(&spool_path).unwrap().len());
+        drop(spool);
+        assert_eq!(labels(&spool_path), ["a", "b"]);
+
+        let _ = fs::remove_file(spool_path);
+        let _ = fs::remove_file(checkpoint_path);
+    }
+
+    #[test]
+    fn only_matches_the_same_flow_and_parameters() {
+        let parameters = vec![ParameterValue::Boolean(true)];
+        let checkpoint = Checkpoint::new(&flow(&["a", "b"]), parameters.clone());
+        assert!(checkpoint.matches(&flow(&["a", "b"]), &parameters));
+        assert!(!checkpoint.matches(&flow(&["a", "c"]), &parameters));
+        assert!(!checkpoint.matches(&flow(&["a"]), &parameters));
+        assert!(!checkpoint.matches(&flow(&["a", "b"]), &[ParameterValue::Boolean(false)]));
+    }
+
+    #[test]
+    fn incompatible_version() {
+        let path = temp_path("version.tacheckpoint");
+        let mut checkpoint = Checkpoint::new(&flow(&["a"]), vec![]);
+        checkpoint.version = CHECKPOINT_VERSION + 1;
+        checkpoint.write(&path).unwrap();
+        assert!(matches!(
+            Checkpoint::read(&path),
+            Err(CheckpointError::IncompatibleVersion)
+        ));
+        let _ = fs::remove_file(path);
+    }
+
+    #[test]
+    fn resuming_a_truncated_spool_fails() {
+        let spool_path = temp_path("short.taspool");
+        let mut spool = EvidenceSpool::create(&spool_path).unwrap();
+        let mut checkpoint = Checkpoint::new(&flow(&["a"]), vec![]);
+        spool.append_all(&mut vec![evidence("a")]).unwrap();
+        checkpoint.record_step(&[], &spool);
+        drop(spool);
+
+        fs::write(&spool_path, b"").unwrap();
+        assert!(checkpoint.resume_spool(&spool_path).is_err());
+        let _ = fs::remove_file(spool_path);
+    }
+}
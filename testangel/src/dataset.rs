@@ -0,0 +1,410 @@
+//! Datasets of values for the parameters of a flow, so that a flow can be executed once for each
+//! row.
+//!
+//! A dataset is either a CSV file with a header row, or a JSON-lines file with an object on each
+//! line. Columns are matched to the parameters of the flow by name, and any other columns are
+//! ignored. Lists are given as their values separated by commas, or as JSON arrays.
+
+use std::{
+    fs::File,
+    io::{self, BufRead, BufReader},
+    path::Path,
+};
+
+use testangel_ipc::prelude::*;
+use thiserror::Error;
+
+#[derive(Error, Debug)]
+pub enum DatasetError {
+    #[error("An I/O error occurred: {0}")]
+    Io(#[from] io::Error),
+    #[error("Line {0}: {1}")]
+    Malformed(usize, String),
+    #[error("The dataset has no column for the parameter {0}.")]
+    MissingColumn(String),
+    #[error("Row {}: {3:?} isn't a valid {2} for {1}.", .0 + 1)]
+    InvalidValue(usize, String, ParameterKind, String),
+}
+
+/// The values of the parameters of a flow for each execution.
+#[derive(Clone, Debug, Default)]
+pub struct Dataset {
+    rows: Vec<Vec<ParameterValue>>,
+}
+
+impl Dataset {
+    /// Read a dataset for a flow with the given parameters. Files ending `.jsonl`, `.ndjson` or
+    /// `.json` are read as JSON-lines, and anything else as CSV.
+    pub fn read<P: AsRef<Path>>(
+        path: P,
+        parameters: &[(String, ParameterKind)],
+    ) -> Result<Self, DatasetError> {
+        let path = path.as_ref();
+        let reader = BufReader::new(File::open(path)?);
+        let is_json = path
+            .extension()
+            .is_some_and(|ext| ext == "jsonl" || ext == "ndjson" || ext == "json");
+        if is_json {
+            Self::read_json_lines(reader, parameters)
+        } else {
+            Self::read_csv(reader, parameters)
+        }
+    }
+
+    /// Read a CSV dataset. Fields may be quoted, with `""` for a quote within a quoted field.
+    pub fn read_csv<R: BufRead>(
+        reader: R,
+        parameters: &[(String, ParameterKind)],
+    ) -> Result<Self, DatasetError> {
+        let mut records = CsvRecords {
+            lines: reader.lines(),
+            line: 0,
+        };
+        let Some(header) = records.next().transpose()? else {
+            return Err(DatasetError::Malformed(
+                1,
+                String::from("the header is missing"),
+            ));
+        };
+        let columns = parameters
+            .iter()
+            .map(|(name, _)| {
+                header
+                    .iter()
+                    .position(|column| column.trim() == name)
+                    .ok_or_else(|| DatasetError::MissingColumn(name.clone()))
+            })
+            .collect::<Result<Vec<_>, _>>()?;
+
+        let mut rows = Vec::new();
+        for record in records {
+            let record = record?;
+            // Skip blank lines, such as one at the end of the file.
+            if record.len() == 1 && record[0].is_empty() {
+                continue;
+            }
+            let row = rows.len();
+            let values = parameters
+                .iter()
+                .zip(&columns)
+                .map(|((name, kind), column)| {
+                    let field = record.get(*column).map(String::as_str).unwrap_or_default();
+                    parse_value(field, *kind).ok_or_else(|| {
+                        DatasetError::InvalidValue(row, name.clone(), *kind, field.to_string())
+                    })
+                })
+                .collect::<Result<_, _>>()?;
+            rows.push(values);
+        }
+        Ok(Self { rows })
+    }
+
+    /// Read a JSON-lines dataset. Values may be given as strings, or as JSON numbers and
+    /// booleans.
+    pub fn read_json_lines<R: BufRead>(
+        reader: R,
+        parameters: &[(String, ParameterKind)],
+    ) -> Result<Self, DatasetError> {
+        let mut rows = Vec::new();
+        for (line_idx, line) in reader.lines().enumerate() {
+            let line = line?;
+            if line.trim().is_empty() {
+                continue;
+            }
+            let object: serde_json::Map<String, serde_json::Value> = serde_json::from_str(&line)
+                .map_err(|e| DatasetError::Malformed(line_idx + 1, e.to_string()))?;
+            let row = rows.len();
+            let values = parameters
+                .iter()
+                .map(|(name, kind)| {
+                    let value = object
+                        .get(name)
+                        .ok_or_else(|| DatasetError::MissingColumn(name.clone()))?;
+                    let parsed = match value {
+                        serde_json::Value::String(s) => parse_value(s, *kind),
+                        serde_json::Value::Bool(_) | serde_json::Value::Number(_) => {
+                            parse_value(&value.to_string(), *kind)
+                        }
+                        serde_json::Value::Array(values) => {
+                            let values: Vec<String> =
+                                values.iter().map(|v| v.to_string()).collect();
+                            parse_value(&values.join(","), *kind)
+                        }
+                        _ => None,
+                    };
+                    parsed.ok_or_else(|| {
+                        DatasetError::InvalidValue(row, name.clone(), *kind, value.to_string())
+                    })
+                })
+                .collect::<Result<_, _>>()?;
+            rows.push(values);
+        }
+        Ok(Self { rows })
+    }
+
+    /// The number of rows in this dataset.
+    pub fn len(&self) -> usize {
+        self.rows.len()
+    }
+
+    /// Returns true if this dataset has no rows.
+    pub fn is_empty(&self) -> bool {
+        self.rows.is_empty()
+    }
+
+    /// The values of the parameters in each row, in the order of the parameters of the flow.
+    pub fn rows(&self) -> &[Vec<ParameterValue>] {
+        &self.rows
+    }
+}
+
+/// Parse a value of a dataset into a parameter of the given kind.
+fn parse_value(value: &str, kind: ParameterKind) -> Option<ParameterValue> {
+    match kind {
+        ParameterKind::String => Some(ParameterValue::String(value.to_string())),
+        ParameterKind::Integer => value.trim().parse().ok().map(ParameterValue::Integer),
+        ParameterKind::Decimal => value.trim().parse().ok().map(ParameterValue::Decimal),
+        ParameterKind::Boolean => match value.trim().to_ascii_lowercase().as_str() {
+            "true" | "yes" | "y" | "1" => Some(ParameterValue::Boolean(true)),
+            "false" | "no" | "n" | "0" | "" => Some(ParameterValue::Boolean(false)),
+            _ => None,
+        },
+        ParameterKind::IntegerList | ParameterKind::DecimalList => {
+            ParameterValue::parse_list(kind, value)
+        }
+    }
+}
+
+/// The records of a CSV file. A quoted field may span more than one line.
+struct CsvRecords<L> {
+    lines: L,
+    /// The number of lines read so far.
+    line: usize,
+}
+
+impl<L: Iterator<Item = io::Result<String>>> Iterator for CsvRecords<L> {
+    type Item = Result<Vec<String>, DatasetError>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        let first_line = self.line + 1;
+        let mut fields = Vec::new();
+        let mut field = String::new();
+        let mut quoted = false;
+        let mut started = false;
+
+        loop {
+            let line = match self.lines.next() {
+                Some(Ok(line)) => line,
+                Some(Err(e)) => return Some(Err(e.into())),
+                None if started => {
+                    return Some(Err(DatasetError::Malformed(
+                        first_line,
+                        String::from("a quoted field isn't closed"),
+                    )))
+                }
+                None => return None,
+            };
+            self.line += 1;
+            if started {
+                // Still within a quoted field, which included this line break.
+                field.push('\n');
+            }
+            started = true;
+
+            let mut chars = line.chars().peekable();
+            while let Some(c) = chars.next() {
+                match (quoted, c) {
+                    (true, '"') if chars.peek() == Some(&'"') => {
+                        chars.next();
+                        field.push('"');
+                    }
+                    (true, '"') => quoted = false,
+                    (true, c) => field.push(c),
+                    (false, '"') if field.is_empty() => quoted = true,
+                    (false, ',') => fields.push(std::mem::take(&mut field)),
+                    (false, c) => field.push(c),
+                }
+            }
+            if !quoted {
+                fields.push(field);
+                return Some(Ok(fields));
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn params(params: &[(&str, ParameterKind)]) -> Vec<(String, ParameterKind)> {
+        params
+            .iter()
+            .map(|(name, kind)| (name.to_string(), *kind))
+            .collect()
+    }
+
+    fn csv(text: &str, parameters: &[(&str, ParameterKind)]) -> Result<Dataset, DatasetError> {
+        Dataset::read_csv(text.as_bytes(), &params(parameters))
+    }
+
+    fn records(text: &str) -> Vec<Vec<String>> {
+        CsvRecords {
+            lines: text.as_bytes().lines(),
+            line: 0,
+        }
+        .collect::<Result<_, _>>()
+        .unwrap()
+    }
+
+    #[test]
+    fn quoted_fields() {
+        assert_eq!(
+            records("a,\"b, c\",\"\"\nd"),
+            [vec!["a", "b, c", ""], vec!["d"]]
+        );
+    }
+
+    #[test]
+    fn escaped_quotes() {
+        assert_eq!(
+            records(r#""say ""hi""",x"y"#),
+            [vec![r#"say "hi""#, r#"x"y"#]]
+        );
+    }
+
+    #[test]
+    fn embedded_newlines() {
+        assert_eq!(
+            records("\"one\ntwo\",3\n4,5"),
+            [vec!["one\ntwo", "3"], vec!["4", "5"]]
+        );
+    }
+
+    #[test]
+    fn malformed_rows() {
+        let text = "text\nfine\n\"not closed\nstill not closed";
+        let mut records = CsvRecords {
+            lines: text.as_bytes().lines(),
+            line: 0,
+        };
+        assert_eq!(records.next().unwrap().unwrap(), ["text"]);
+        assert_eq!(records.next().unwrap().unwrap(), ["fine"]);
+        assert!(matches!(
+            records.next(),
+            Some(Err(DatasetError::Malformed(3, _)))
+        ));
+
+        assert!(matches!(
+            csv("", &[("a", ParameterKind::String)]),
+            Err(DatasetError::Malformed(1, _))
+        ));
+        assert!(matches!(
+            csv("a\n1", &[("b", ParameterKind::String)]),
+            Err(DatasetError::MissingColumn(name)) if name == "b"
+        ));
+        assert!(matches!(
+            csv("n\n1\nx", &[("n", ParameterKind::Integer)]),
+            Err(DatasetError::InvalidValue(1, _, ParameterKind::Integer, value)) if value == "x"
+        ));
+    }
+
+    #[test]
+    fn columns_are_matched_by_name() {
+        let dataset = csv(
+            "ignored, b ,a\nx,2,one\n\ny,3,two\n",
+            &[("a", ParameterKind::String), ("b", ParameterKind::Integer)],
+        )
+        .unwrap();
+        assert_eq!(
+            dataset.rows(),
+            [
+                vec![
+                    ParameterValue::String("one".to_string()),
+                    ParameterValue::Integer(2)
+                ],
+                vec![
+                    ParameterValue::String("two".to_string()),
+                    ParameterValue::Integer(3)
+                ],
+            ]
+        );
+    }
+
+    #[test]
+    fn type_coercion() {
+        assert_eq!(
+            parse_value(" 42 ", ParameterKind::Integer),
+            Some(ParameterValue::Integer(42))
+        );
+        assert_eq!(parse_value("4.2", ParameterKind::Integer), None);
+        assert_eq!(
+            parse_value("-1.5", ParameterKind::Decimal),
+            Some(ParameterValue::Decimal(-1.5))
+        );
+        assert_eq!(
+            parse_value(" ", ParameterKind::String),
+            Some(ParameterValue::String(" ".to_string()))
+        );
+        for (text, value) in [("Yes", true), ("1", true), ("n", false), ("", false)] {
+            assert_eq!(
+                parse_value(text, ParameterKind::Boolean),
+                Some(ParameterValue::Boolean(value))
+            );
+        }
+        assert_eq!(parse_value("maybe", ParameterKind::Boolean), None);
+        assert_eq!(
+            parse_value("1, 2,3", ParameterKind::IntegerList),
+            Some(ParameterValue::IntegerList(vec![1, 2, 3]))
+        );
+        assert_eq!(parse_value("1,two", ParameterKind::IntegerList), None);
+
+        // A missing field is empty
+        let dataset = csv("a,b\n1", &[("b", ParameterKind::Boolean)]).unwrap();
+        assert_eq!(dataset.rows(), [vec![ParameterValue::Boolean(false)]]);
+        // A list in a quoted field
+        let dataset = csv("a\n\"1.5,2\"", &[("a", ParameterKind::DecimalList)]).unwrap();
+        assert_eq!(
+            dataset.rows(),
+            [vec![ParameterValue::DecimalList(vec![1.5, 2.0])]]
+        );
+    }
+
+    #[test]
+    fn json_lines() {
+        let dataset = Dataset::read_json_lines(
+            "{\"n\": 3, \"b\": true, \"l\": [1, 2], \"s\": \"x\"}\n\n{\"n\": \"4\", \"b\": \"no\", \"l\": \"5\", \"s\": \"y\"}".as_bytes(),
+            &params(&[
+                ("n", ParameterKind::Integer),
+                ("b", ParameterKind::Boolean),
+                ("l", ParameterKind::IntegerList),
+                ("s", ParameterKind::String),
+            ]),
+        )
+        .unwrap();
+        assert_eq!(
+            dataset.rows(),
+            [
+                vec![
+                    ParameterValue::Integer(3),
+                    ParameterValue::Boolean(true),
+                    ParameterValue::IntegerList(vec![1, 2]),
+                    ParameterValue::String("x".to_string()),
+                ],
+                vec![
+                    ParameterValue::Integer(4),
+                    ParameterValue::Boolean(false),
+                    ParameterValue::IntegerList(vec![5]),
+                    ParameterValue::String("y".to_string()),
+                ],
+            ]
+        );
+        assert!(matches!(
+            Dataset::read_json_lines(
+                "{\"n\": 1}\nnot json".as_bytes(),
+                &params(&[("n", ParameterKind::Integer)])
+            ),
+            Err(DatasetError::Malformed(2, _))
+        ));
+    }
+}
@@ -0,0 +1,340 @@
+//! Hosting engines in separate worker processes.
+//!
+//! When `TA_ENGINE_HOST_WORKERS` is set, each engine is loaded by a pool of
+//! `testangel-engine-host` worker processes rather than into this process. Requests are sent to
+//! the workers over their standard input and output as length-prefixed MessagePack messages, so
+//! an engine that crashes only takes down its worker, and sessions can run on different workers
+//! at the same time. Anything the engine itself prints goes to the worker's standard error.
+
+use std::{
+    collections::HashMap,
+    env,
+    io::{self, BufReader, BufWriter, Read, Write},
+    path::{Path, PathBuf},
+    process::{Child, ChildStdin, ChildStdout, Command, Stdio},
+    sync::{
+        atomic::{AtomicU64, AtomicUsize, Ordering},
+        Arc, Mutex,
+    },
+};
+
+use testangel_ipc::prelude::*;
+
+use crate::ipc::{self, IpcError};
+
+/// The largest message that can be read or written, so that a corrupt length doesn't allocate
+/// gigabytes.
+pub(crate) const MAX_FRAME_LEN: usize = 256 * 1024 * 1024;
+
+/// Read a length-prefixed message.
+pub(crate) fn read_frame<R: Read>(reader: &mut R) -> io::Result<Vec<u8>> {
+    let mut len = [0u8; 4];
+    reader.read_exact(&mut len)?;
+    let len = u32::from_le_bytes(len) as usize;
+    if len > MAX_FRAME_LEN {
+        return Err(io::Error::new(
+            io::ErrorKind::InvalidData,
+            format!("message of {len} bytes is too large"),
+        ));
+    }
+    let mut buf = vec![0u8; len];
+    reader.read_exact(&mut buf)?;
+    Ok(buf)
+}
+
+/// Write a length-prefixed message.
+pub(crate) fn write_frame<W: Write>(writer: &mut W, data: &[u8]) -> io::Result<()> {
+    let len = u32::try_from(data.len())
+        .ok()
+        .filter(|len| *len as usize <= MAX_FRAME_LEN)
+        .ok_or_else(|| io::Error::new(io::ErrorKind::InvalidInput, "message too large"))?;
+    writer.write_all(&len.to_le_bytes())?;
+    writer.write_all(data)?;
+    writer.flush()
+}
+
+/// The number of workers to start for each engine, from `TA_ENGINE_HOST_WORKERS`. If `None`,
+/// engines are loaded into this process.
+pub fn workers_per_engine() -> Option<usize> {
+    env::var("TA_ENGINE_HOST_WORKERS")
+        .ok()
+        .and_then(|n| n.parse::<usize>().ok())
+        .filter(|n| *n > 0)
+}
+
+/// The path to the worker executable. This is `TA_ENGINE_HOST` if set, otherwise
+/// `testangel-engine-host` alongside the current executable.
+fn worker_executable() -> PathBuf {
+    if let Ok(path) = env::var("TA_ENGINE_HOST") {
+        return PathBuf::from(path);
+    }
+    let name = format!("testangel-engine-host{}", env::consts::EXE_SUFFIX);
+    env::current_exe()
+        .ok()
+        .and_then(|exe| exe.parent().map(|dir| dir.join(&name)))
+        .unwrap_or_else(|| PathBuf::from(name))
+}
+
+/// A running worker process.
+#[derive(Debug)]
+struct Worker {
+    /// The worker process, which can be stopped while a request is being handled.
+    child: Arc<Mutex<Child>>,
+    stdin: BufWriter<ChildStdin>,
+    stdout: BufReader<ChildStdout>,
+}
+
+impl Worker {
+    /// Start a worker for the engine at `path`.
+    fn spawn(path: &Path) -> io::Result<Self> {
+        let mut child = Command::new(worker_executable())
+            .arg(path)
+            .stdin(Stdio::piped())
+            .stdout(Stdio::piped())
+            .spawn()?;
+        let stdin = BufWriter::new(child.stdin.take().unwrap());
+        let stdout = BufReader::new(child.stdout.take().unwrap());
+        Ok(Self {
+            child: Arc::new(Mutex::new(child)),
+            stdin,
+            stdout,
+        })
+    }
+
+    /// Send a request and wait for the response.
+    fn call(&mut self, request: &Request) -> Result<Response, IpcError> {
+        write_frame(&mut self.stdin, &request.to_msgpack()).map_err(IpcError::IoError)?;
+        let response = read_frame(&mut self.stdout).map_err(IpcError::IoError)?;
+        Response::try_from(response.as_slice()).map_err(|e| {
+            log::error!("Failed to parse response ({e}) from engine host.");
+            IpcError::InvalidResponseFromEngine
+        })
+    }
+}
+
+impl Drop for Worker {
+    fn drop(&mut self) {
+        if let Ok(mut child) = self.child.lock() {
+            let _ = child.kill();
+            let _ = child.wait();
+        }
+    }
+}
+
+/// A pool of warm workers for a single engine.
+///
+/// Each session is opened on one worker, chosen in turn, and all of its requests go to that
+/// worker. Requests without a session always go to the first worker, so they share a single
+/// state as they would in process. If a worker fails it is restarted on the next request, and
+/// the sessions it held are lost.
+#[derive(Debug)]
+pub struct WorkerPool {
+    path: PathBuf,
+    workers: Vec<Mutex<Option<Worker>>>,
+    /// The process of each worker, so that a worker can be stopped while it holds its lock.
+    processes: Vec<Mutex<Option<Arc<Mutex<Child>>>>>,
+    /// The worker and the worker's own session ID for each session handed out by this pool.
+    sessions: Mutex<HashMap<u64, (usize, u64)>>,
+    next_session: AtomicU64,
+    next_worker: AtomicUsize,
+}
+
+impl WorkerPool {
+    /// Start a pool of workers for the engine at `path`.
+    pub fn spawn(path: PathBuf, workers: usize) -> io::Result<Self> {
+        let workers = (0..workers.max(1))
+            .map(|_| Worker::spawn(&path))
+            .collect::<io::Result<Vec<_>>>()?;
+        let processes = workers
+            .iter()
+            .map(|w| Mutex::new(Some(w.child.clone())))
+            .collect();
+        Ok(Self {
+            path,
+            workers: workers.into_iter().map(|w| Mutex::new(Some(w))).collect(),
+            processes,
+            sessions: Mutex::default(),
+            next_session: AtomicU64::new(1),
+            next_worker: AtomicUsize::new(0),
+        })
+    }
+
+    /// Send a request to a worker, restarting it first if it has failed.
+    fn call_worker(&self, worker: usize, request: &Request) -> Result<Response, IpcError> {
+        let mut slot = self.workers[worker]
+            .lock()
+            .map_err(|_| IpcError::CantLockEngineIo)?;
+        if slot.is_none() {
+            log::info!("Restarting engine host for {:?}", self.path);
+            let restarted = Worker::spawn(&self.path).map_err(IpcError::IoError)?;
+            if let Ok(mut process) = self.processes[worker].lock() {
+                *process = Some(restarted.child.clone());
+            }
+            *slot = Some(restarted);
+        }
+        let result = slot.as_mut().unwrap().call(request);
+        if let Err(IpcError::IoError(e)) = &result {
+            log::error!("Engine host for {:?} failed: {e}", self.path);
+            *slot = None;
+            drop(slot);
+            self.sessions
+                .lock()
+                .unwrap()
+                .retain(|_, (w, _)| *w != worker);
+        }
+        result
+    }
+
+    /// Stop the worker handling requests for a session, or requests without a session if `None`,
+    /// so that a request it is stuck on fails. It is restarted on the next request, and the
+    /// sessions it held are lost.
+    pub fn abort(&self, session: Option<u64>) {
+        let worker = match session {
+            Some(session) => match self.find_session(session) {
+                Some((worker, _)) => worker,
+                None => return,
+            },
+            None => 0,
+        };
+        log::warn!("Stopping engine host {worker} for {:?}", self.path);
+        let process = self.processes[worker]
+            .lock()
+            .ok()
+            .and_then(|process| process.clone());
+        if let Some(process) = process {
+            if let Ok(mut child) = process.lock() {
+                let _ = child.kill();
+            }
+        }
+    }
+
+    /// Find the worker holding a session, and the worker's ID for it.
+    fn find_session(&self, session: u64) -> Option<(usize, u64)> {
+        self.sessions.lock().unwrap().get(&session).copied()
+    }
+
+    /// Produce the response for a session that isn't open.
+    fn invalid_session(session: u64) -> Response {
+        Response::Error {
+            kind: ErrorKind::InvalidSession,
+            reason: format!("The session {session} isn't open."),
+        }
+    }
+
+    /// Send a request to the right worker and return its response.
+    pub fn call(&self, request: Request) -> Result<Response, IpcError> {
+        match request {
+            Request::OpenSession => {
+                let worker = self.next_worker.fetch_add(1, Ordering::Relaxed) % self.workers.len();
+                match self.call_worker(worker, &Request::OpenSession)? {
+                    Response::SessionOpened {
+                        session: worker_session,
+                    } => {
+                        let session = self.next_session.fetch_add(1, Ordering::Relaxed);
+                        self.sessions
+                            .lock()
+                            .unwrap()
+                            .insert(session, (worker, worker_session));
+                        Ok(Response::SessionOpened { session })
+                    }
+                    res => Ok(res),
+                }
+            }
+
+            Request::CloseSession { session } => {
+                let Some((worker, worker_session)) = self.find_session(session) else {
+                    return Ok(Self::invalid_session(session));
+                };
+                self.sessions.lock().unwrap().remove(&session);
+                self.call_worker(
+                    worker,
+                    &Request::CloseSession {
+                        session: worker_session,
+                    },
+                )
+            }
+
+            Request::ResetState {
+                session: Some(session),
+            } => {
+                let Some((worker, worker_session)) = self.find_session(session) else {
+                    return Ok(Self::invalid_session(session));
+                };
+                self.call_worker(
+                    worker,
+                    &Request::ResetState {
+                        session: Some(worker_session),
+                    },
+                )
+            }
+
+            Request::RunInstructions {
+                instructions,
+                session: Some(session),
+            } => {
+                let Some((worker, worker_session)) = self.find_session(session) else {
+                    return Ok(Self::invalid_session(session));
+                };
+                self.call_worker(
+                    worker,
+                    &Request::RunInstructions {
+                        instructions,
+                        session: Some(worker_session),
+                    },
+                )
+            }
+
+            request => self.call_worker(0, &request),
+        }
+    }
+}
+
+/// Take standard output for the replies to requests, and point standard output at standard
+/// error instead, so that anything the engine prints can't end up in the middle of a reply.
+#[cfg(unix)]
+fn take_stdout() -> io::Result<std::fs::File> {
+    use std::os::fd::{AsFd, AsRawFd};
+
+    io::stdout().flush()?;
+    let replies = io::stdout().as_fd().try_clone_to_owned()?;
+    // SAFETY: this only changes what fd 1 refers to, which `replies` holds its own copy of.
+    if unsafe { libc::dup2(io::stderr().as_raw_fd(), io::stdout().as_raw_fd()) } < 0 {
+        return Err(io::Error::last_os_error());
+    }
+    Ok(replies.into())
+}
+
+/// Take standard output for the replies to requests. Here standard output can't be moved, so
+/// the engine mustn't print to it.
+#[cfg(not(unix))]
+fn take_stdout() -> io::Result<io::Stdout> {
+    Ok(io::stdout())
+}
+
+/// Serve requests for the engine at `path` over standard input and output until standard
+/// input is closed. This is run by the `testangel-engine-host` worker.
+pub fn serve(path: PathBuf) -> io::Result<()> {
+    let replies = take_stdout()?;
+    let engine = ipc::Engine::load(path).map_err(|e| io::Error::other(format!("{e:?}")))?;
+
+    let mut stdin = BufReader::new(io::stdin().lock());
+    let mut stdout = BufWriter::new(replies);
+    loop {
+        let request = match read_frame(&mut stdin) {
+            Ok(request) => request,
+            Err(e) if e.kind() == io::ErrorKind::UnexpectedEof => return Ok(()),
+            Err(e) => return Err(e),
+        };
+        let response = match Request::try_from(request.as_slice()) {
+            Err(e) => Response::Error {
+                kind: ErrorKind::FailedToParseIPCJson,
+                reason: format!("The IPC message was invalid. ({e:?})"),
+            },
+            Ok(request) => ipc::ipc_call(&engine, request).unwrap_or_else(|e| Response::Error {
+                kind: ErrorKind::EngineProcessingError,
+                reason: format!("The engine couldn't be called. ({e:?})"),
+            }),
+        };
+        write_frame(&mut stdout, &response.to_msgpack())?;
+    }
+}
@@ -0,0 +1,1533 @@
+//! Compilation of flows and actions into flat execution plans.
+//!
+//! Compiling looks up every action and engine, checks that every parameter source refers to
+//! something that exists and has the right kind, and assigns every value a slot in a register
+//! file. Executing a plan then only has to move values between registers and make IPC calls.
+
+use std::{
+    collections::HashMap,
+    sync::{
+        atomic::{AtomicBool, Ordering},
+        Arc, Condvar, Mutex,
+    },
+    thread,
+    time::{Duration, Instant},
+};
+
+use testangel_ipc::prelude::*;
+use thiserror::Error;
+
+use crate::{
+    action_loader::ActionMap,
+    ipc::{EngineList, EngineSession, IpcError},
+    timing,
+    types::{
+        Action, ActionConfiguration, ActionParameterSource, AutomationFlow, FlowError,
+        InstructionParameterSource,
+    },
+};
+
+#[derive(Error, Clone, Debug, PartialEq, Eq)]
+pub enum CompileError {
+    #[error("Step {}: the action {1} isn't available.", .0 + 1)]
+    MissingAction(usize, String),
+    #[error("Step {}: the instruction {1} isn't available.", .0 + 1)]
+    MissingInstruction(usize, String),
+    #[error("Step {}: no value has been set for {1}.", .0 + 1)]
+    MissingValue(usize, String),
+    #[error("Step {}: {1} refers to something that doesn't exist or hasn't run yet.", .0 + 1)]
+    InvalidSource(usize, String),
+    #[error("Step {}: {1} should be {2} but was given {3}.", .0 + 1)]
+    KindMismatch(usize, String, ParameterKind, ParameterKind),
+    #[error("Output {}: outputs can't be set to a literal value.", .0 + 1)]
+    LiteralOutput(usize),
+    #[error("Step {}: the action {1} is invalid. {2}", .0 + 1)]
+    InvalidAction(usize, String, Box<CompileError>),
+}
+
+impl CompileError {
+    /// The step or output at which this error occurred.
+    pub fn step(&self) -> usize {
+        match self {
+            Self::MissingAction(step, ..)
+            | Self::MissingInstruction(step, ..)
+            | Self::MissingValue(step, ..)
+            | Self::InvalidSource(step, ..)
+            | Self::KindMismatch(step, ..)
+            | Self::LiteralOutput(step)
+            | Self::InvalidAction(step, ..) => *step,
+        }
+    }
+}
+
+/// Where a value comes from when a plan is executed.
+#[derive(Clone, Debug)]
+enum Operand {
+    /// A value known when the plan is compiled.
+    Literal(ParameterValue),
+    /// A value held in a register.
+    Register(usize),
+}
+
+impl Operand {
+    /// Get the value of this operand.
+    fn resolve<'a>(&'a self, registers: &'a [ParameterValue]) -> &'a ParameterValue {
+        match self {
+            Self::Literal(value) => value,
+            Self::Register(reg) => &registers[*reg],
+        }
+    }
+}
+
+/// An instruction with all of its inputs and outputs resolved to registers.
+#[derive(Clone, Debug)]
+struct CompiledInstruction {
+    /// The step within the action.
+    step: usize,
+    instruction_id: String,
+    instruction_handle: Option<usize>,
+    /// Whether the engine marked this instruction as pure, so its results can be reused.
+    pure: bool,
+    /// Only run this instruction if this operand is true. If `None`, always run.
+    run_if: Option<Operand>,
+    /// The parameters of this instruction, in order of their IDs.
+    parameters: Vec<(String, Operand)>,
+    /// The register each output of this instruction is written to, and its expected kind, in
+    /// order of their IDs.
+    outputs: Vec<(String, usize, ParameterKind)>,
+}
+
+/// The most results of pure instructions kept for each execution. When the memo is full, it is
+/// emptied before more are kept.
+const MEMO_CAPACITY: usize = 4096;
+
+/// A parameter value that can be used to look up the results of a pure instruction.
+#[derive(Clone, Debug, PartialEq, Eq, Hash)]
+enum MemoValue {
+    String(String),
+    Integer(i32),
+    Decimal(u32),
+    Boolean(bool),
+    IntegerList(Vec<i32>),
+    DecimalList(Vec<u32>),
+}
+
+impl From<&ParameterValue> for MemoValue {
+    fn from(value: &ParameterValue) -> Self {
+        match value {
+            ParameterValue::String(v) => Self::String(v.clone()),
+            ParameterValue::Integer(v) => Self::Integer(*v),
+            ParameterValue::Decimal(v) => Self::Decimal(v.to_bits()),
+            ParameterValue::Boolean(v) => Self::Boolean(*v),
+            ParameterValue::IntegerList(v) => Self::IntegerList(v.clone()),
+            ParameterValue::DecimalList(v) => {
+                Self::DecimalList(v.iter().map(|v| v.to_bits()).collect())
+            }
+        }
+    }
+}
+
+/// The instruction ID and parameters of a call to a pure instruction.
+type MemoKey = (String, Vec<MemoValue>);
+
+/// The outputs of calls to pure instructions made during one execution of a flow or action, so
+/// that an instruction isn't called again with the same parameters.
+#[derive(Debug, Default)]
+pub struct Memo(Mutex<HashMap<MemoKey, Vec<Option<ParameterValue>>>>);
+
+impl Memo {
+    /// Get the key for a call to an instruction with the current registers.
+    fn key(instruction: &CompiledInstruction, registers: &[ParameterValue]) -> MemoKey {
+        (
+            instruction.instruction_id.clone(),
+            instruction
+                .parameters
+                .iter()
+                .map(|(_, operand)| MemoValue::from(operand.resolve(registers)))
+                .collect(),
+        )
+    }
+
+    /// Get the outputs of an earlier call, in the order of the outputs of the instruction.
+    fn get(&self, key: &MemoKey) -> Option<Vec<Option<ParameterValue>>> {
+        self.0.lock().ok()?.get(key).cloned()
+    }
+
+    /// Keep the outputs of a call, first emptying the memo if it is full so that the results of
+    /// recent calls are kept.
+    fn insert(&self, key: MemoKey, outputs: Vec<Option<ParameterValue>>) {
+        if let Ok(mut memo) = self.0.lock() {
+            if memo.len() >= MEMO_CAPACITY && !memo.contains_key(&key) {
+                memo.clear();
+            }
+            memo.insert(key, outputs);
+        }
+    }
+}
+
+/// Consecutive instructions, sent to the same engine in a single IPC call. Nothing in a batch
+/// depends on the output of anything else in the same batch.
+#[derive(Clone, Debug)]
+struct CompiledBatch {
+    /// The index of the engine in the [`EngineList`].
+    engine: usize,
+    instructions: Vec<CompiledInstruction>,
+}
+
+/// An action compiled into an execution plan.
+///
+/// Registers `0..parameter_count` hold the parameters of the action, and the rest hold the
+/// outputs of each instruction.
+#[derive(Clone, Debug)]
+pub struct CompiledAction {
+    parameter_kinds: Vec<ParameterKind>,
+    /// The value of every register before the action runs. Outputs of instructions that are
+    /// skipped keep these default values.
+    initial_registers: Vec<ParameterValue>,
+    batches: Vec<CompiledBatch>,
+    outputs: Vec<Operand>,
+}
+
+impl CompiledAction {
+    /// Compile an action against a list of engines. Errors refer to instruction steps, or to
+    /// action outputs in the case of [`CompileError::LiteralOutput`].
+    pub fn compile(engine_list: &EngineList, action: &Action) -> Result<Self, CompileError> {
+        let parameter_kinds: Vec<ParameterKind> =
+            action.parameters.iter().map(|(_, kind)| *kind).collect();
+        let mut initial_registers: Vec<ParameterValue> = parameter_kinds
+            .iter()
+            .map(|kind| kind.default_value())
+            .collect();
+        // The register and kind of each output of each step so far.
+        let mut step_outputs: Vec<HashMap<&String, (usize, ParameterKind)>> =
+            Vec::with_capacity(action.instructions.len());
+
+        let mut batches: Vec<CompiledBatch> = Vec::new();
+        let mut batch_start = 0;
+        for (step, config) in action.instructions.iter().enumerate() {
+            let engine = engine_list
+                .get_engine_index_by_instruction_id(&config.instruction_id)
+                .ok_or_else(|| {
+                    CompileError::MissingInstruction(step, config.instruction_id.clone())
+                })?;
+            let instruction = engine_list
+                .get_instruction_by_id(&config.instruction_id)
+                .unwrap();
+
+            let resolve = |name: &String,
+                           src: &InstructionParameterSource,
+                           literal: Option<&ParameterValue>|
+             -> Result<(Operand, ParameterKind), CompileError> {
+                match src {
+                    InstructionParameterSource::Literal => {
+                        let value = literal
+                            .ok_or_else(|| CompileError::MissingValue(step, name.clone()))?;
+                        Ok((Operand::Literal(value.clone()), value.kind()))
+                    }
+                    InstructionParameterSource::FromParameter(idx) => parameter_kinds
+                        .get(*idx)
+                        .map(|kind| (Operand::Register(*idx), *kind))
+                        .ok_or_else(|| CompileError::InvalidSource(step, name.clone())),
+                    InstructionParameterSource::FromOutput(from_step, id) => step_outputs
+                        .get(*from_step)
+                        .and_then(|outputs| outputs.get(id))
+                        .map(|(reg, kind)| (Operand::Register(*reg), *kind))
+                        .ok_or_else(|| CompileError::InvalidSource(step, name.clone())),
+                }
+            };
+
+            let run_if = match &config.run_if {
+                InstructionParameterSource::Literal => None,
+                src => {
+                    let name = String::from("Run If");
+                    let (operand, kind) = resolve(&name, src, None)?;
+                    if kind != ParameterKind::Boolean {
+                        return Err(CompileError::KindMismatch(
+                            step,
+                            name,
+                            ParameterKind::Boolean,
+                            kind,
+                        ));
+                    }
+                    Some(operand)
+                }
+            };
+
+            let mut parameters = Vec::with_capacity(config.parameter_sources.len());
+            for (id, src) in &config.parameter_sources {
+                let (operand, kind) = resolve(id, src, config.parameter_values.get(id))?;
+                if let Some((_, expected)) = instruction.parameters().get(id) {
+                    if kind != *expected {
+                        return Err(CompileError::KindMismatch(
+                            step,
+                            id.clone(),
+                            *expected,
+                            kind,
+                        ));
+                    }
+                }
+                parameters.push((id.clone(), operand));
+            }
+            parameters.sort_unstable_by(|a, b| a.0.cmp(&b.0));
+
+            let mut outputs = Vec::with_capacity(instruction.outputs().len());
+            let mut this_step_outputs = HashMap::with_capacity(instruction.outputs().len());
+            for (id, (_, kind)) in instruction.outputs() {
+                let reg = initial_registers.len();
+                initial_registers.push(kind.default_value());
+                outputs.push((id.clone(), reg, *kind));
+                this_step_outputs.insert(id, (reg, *kind));
+            }
+            outputs.sort_unstable_by(|a, b| a.0.cmp(&b.0));
+            step_outputs.push(this_step_outputs);
+
+            let compiled = CompiledInstruction {
+                step,
+                instruction_id: config.instruction_id.clone(),
+                instruction_handle: engine_list.inner()[engine]
+                    .instruction_handle(&config.instruction_id),
+                pure: instruction.is_pure(),
+                run_if,
+                parameters,
+                outputs,
+            };
+
+            // Add this to the current batch if it targets the same engine and doesn't depend
+            // on anything from within the batch.
+            if let Some(batch) = batches.last_mut() {
+                if batch.engine == engine && !config.depends_on_steps_from(batch_start) {
+                    batch.instructions.push(compiled);
+                    continue;
+                }
+            }
+            batch_start = step;
+            batches.push(CompiledBatch {
+                engine,
+                instructions: vec![compiled],
+            });
+        }
+
+        let mut outputs = Vec::with_capacity(action.outputs.len());
+        for (index, (name, kind, src)) in action.outputs.iter().enumerate() {
+            let operand = match src {
+                InstructionParameterSource::Literal => {
+                    return Err(CompileError::LiteralOutput(index))
+                }
+                InstructionParameterSource::FromParameter(idx) => parameter_kinds
+                    .get(*idx)
+                    .map(|kind| (Operand::Register(*idx), *kind)),
+                InstructionParameterSource::FromOutput(step, id) => step_outputs
+                    .get(*step)
+                    .and_then(|outputs| outputs.get(id))
+                    .map(|(reg, kind)| (Operand::Register(*reg), *kind)),
+            };
+            match operand {
+                Some((operand, actual)) if actual == *kind => outputs.push(operand),
+                Some((_, actual)) => {
+                    return Err(CompileError::KindMismatch(
+                        index,
+                        name.clone(),
+                        *kind,
+                        actual,
+                    ))
+                }
+                // Carry on with the default value, as this has always been permitted.
+                None => outputs.push(Operand::Literal(kind.default_value())),
+            }
+        }
+
+        Ok(Self {
+            parameter_kinds,
+            initial_registers,
+            batches,
+            outputs,
+        })
+    }
+
+    /// The kinds of the parameters this action takes.
+    pub fn parameter_kinds(&self) -> &[ParameterKind] {
+        &self.parameter_kinds
+    }
+
+    /// The indices of the engines this action uses.
+    fn engines(&self) -> impl Iterator<Item = usize> + '_ {
+        self.batches.iter().map(|batch| batch.engine)
+    }
+
+    /// Execute this plan with the given parameters, in order, within a session. The session
+    /// must be with the same engine list as this was compiled with. Evidence is appended to
+    /// `evidence` as each batch of instructions completes. Pure instructions that are in `memo`
+    /// with the same parameters aren't called again. On failure, the step of the instruction is
+    /// returned with the error.
+    pub fn execute(
+        &self,
+        session: &EngineSession,
+        memo: &Memo,
+        parameters: Vec<ParameterValue>,
+        evidence: &mut Vec<Evidence>,
+    ) -> Result<Vec<ParameterValue>, (usize, FlowError)> {
+        let mut registers = self.initial_registers.clone();
+        for (reg, value) in parameters.into_iter().enumerate() {
+            registers[reg] = value;
+        }
+
+        for batch in &self.batches {
+            let engine = &session.engine_list().inner()[batch.engine];
+
+            // Nothing in the batch depends on anything else in the batch, so everything to
+            // send can be determined up front.
+            let mut requested = Vec::with_capacity(batch.instructions.len());
+            let mut ran = Vec::with_capacity(batch.instructions.len());
+            for instruction in &batch.instructions {
+                if let Some(run_if) = &instruction.run_if {
+                    if !run_if.resolve(&registers).value_bool() {
+                        log::debug!("Instruction skipped");
+                        continue;
+                    }
+                }
+
+                // Nothing else in the batch uses the outputs of this instruction, so they can
+                // be written straight away.
+                let memo_key = instruction.pure.then(|| Memo::key(instruction, &registers));
+                if let Some(outputs) = memo_key.as_ref().and_then(|key| memo.get(key)) {
+                    for ((_, reg, _), value) in instruction.outputs.iter().zip(outputs) {
+                        if let Some(value) = value {
+                            registers[*reg] = value;
+                        }
+                    }
+                    continue;
+                }
+
+                requested.push(InstructionWithParameters {
+                    instruction: instruction.instruction_id.clone(),
+                    instruction_handle: instruction.instruction_handle,
+                    parameters: instruction
+                        .parameters
+                        .iter()
+                        .map(|(id, operand)| (id.clone(), operand.resolve(&registers).clone()))
+                        .collect(),
+                });
+                ran.push((instruction, memo_key));
+            }
+
+            let Some((first, _)) = ran.first() else {
+                continue;
+            };
+            // The engine stops at the first failing instruction but doesn't report which one
+            // it was, so errors are attributed to the first instruction sent.
+            let first_step = first.step;
+            let span = timing::span("engine execution")
+                .engine(engine)
+                .instruction(|| {
+                    ran.iter()
+                        .map(|(instruction, _)| instruction.instruction_id.as_str())
+                        .collect::<Vec<_>>()
+                        .join(", ")
+                });
+            let (outputs, ev) = run_instructions(session, batch.engine, requested)
+                .map_err(|err| (first_step, err))?;
+            drop(span);
+
+            for ((instruction, memo_key), (mut output, ev)) in
+                ran.into_iter().zip(outputs.into_iter().zip(&ev))
+            {
+                let mut memo_outputs = memo_key
+                    .as_ref()
+                    .map(|_| Vec::with_capacity(instruction.outputs.len()));
+                for (id, reg, kind) in &instruction.outputs {
+                    let value = output.remove(id);
+                    if let Some(outputs) = &mut memo_outputs {
+                        outputs.push(value.clone());
+                    }
+                    if let Some(value) = value {
+                        if value.kind() != *kind {
+                            log::error!(
+                                "Engine {engine} returned a {} for output {id} of {}, expected {kind}.",
+                                value.kind(),
+                                instruction.instruction_id,
+                            );
+                            return Err((
+                                instruction.step,
+                                FlowError::IPCFailure(IpcError::InvalidResponseFromEngine),
+                            ));
+                        }
+                        registers[*reg] = value;
+                    }
+                }
+                // An instruction that produced evidence isn't really pure, so its results
+                // aren't kept.
+                if let (Some(key), Some(outputs)) = (memo_key, memo_outputs) {
+                    if ev.is_empty() {
+                        memo.insert(key, outputs);
+                    }
+                }
+            }
+            let _span = timing::span("evidence handling").engine(engine);
+            for mut ev in ev {
+                evidence.append(&mut ev);
+            }
+        }
+
+        Ok(self
+            .outputs
+            .iter()
+            .map(|operand| operand.resolve(&registers).clone())
+            .collect())
+    }
+}
+
+/// Send a batch of instructions to the engine at an index of the engine list in a single IPC
+/// call within a session, returning the output and evidence of each instruction in the order
+/// they were given.
+#[allow(clippy::type_complexity)]
+fn run_instructions(
+    session: &EngineSession,
+    engine: usize,
+    instructions: Vec<InstructionWithParameters>,
+) -> Result<(Vec<HashMap<String, ParameterValue>>, Vec<Vec<Evidence>>), FlowError> {
+    let count = instructions.len();
+    let response = session
+        .run_instructions(engine, instructions)
+        .map_err(FlowError::IPCFailure)?;
+    let engine = &session.engine_list().inner()[engine];
+
+    match response {
+        Response::ExecutionOutput { output, evidence } => {
+            if output.len() != count || evidence.len() != count {
+                log::error!(
+                    "Engine {engine} returned {} outputs for {count} instructions.",
+                    output.len()
+                );
+                return Err(FlowError::IPCFailure(IpcError::InvalidResponseFromEngine));
+            }
+            Ok((output, evidence))
+        }
+        Response::Error { kind, reason } => Err(FlowError::FromInstruction {
+            error_kind: kind,
+            reason,
+        }),
+        _ => unreachable!(),
+    }
+}
+
+/// One step of a compiled flow.
+#[derive(Clone, Debug)]
+struct CompiledStep {
+    action: Arc<CompiledAction>,
+    parameters: Vec<Operand>,
+    /// The first register the outputs of this step are written to.
+    first_output: usize,
+    /// The number of outputs of this step.
+    output_count: usize,
+    /// The earlier steps whose outputs this step uses.
+    depends_on: Vec<usize>,
+    /// Whether this step has to execute after every earlier step, in every session.
+    barrier: bool,
+    /// The step whose session this step must be executed in, so that it sees the engine state
+    /// that step left: the latest of the steps it depends on that isn't a barrier.
+    pinned_to: Option<usize>,
+}
+
+/// How often a schedule checks whether execution has been cancelled while it waits for steps.
+const SCHEDULE_POLL_INTERVAL: Duration = Duration::from_millis(50);
+
+/// How long a step took, the evidence it produced, and its outputs if it succeeded.
+type FinishedStep = (
+    Duration,
+    Vec<Evidence>,
+    Result<Vec<ParameterValue>, FlowError>,
+);
+
+/// The progress of executing a flow with [`CompiledFlow::execute_scheduled`].
+struct Schedule {
+    registers: Vec<ParameterValue>,
+    started: Vec<bool>,
+    done: Vec<bool>,
+    /// The index of the session each step that has started was executed in. Steps before the
+    /// first step executed count as executed in the first session. Barriers are executed in
+    /// every session, so they have none.
+    sessions: Vec<Option<usize>>,
+    /// The last barrier each session has started.
+    barriers: Vec<Option<usize>>,
+    /// The number of sessions each step is still to finish executing in: one, or every session
+    /// for a barrier.
+    runs_left: Vec<usize>,
+    /// The results of steps that have finished, until they are passed on.
+    finished: Vec<Option<FinishedStep>>,
+    /// The number of steps executing.
+    running: usize,
+    /// Set when a step fails, so that no more are started.
+    stopped: bool,
+}
+
+/// A flow compiled into an execution plan. This can be kept and executed any number of times.
+///
+/// The parameters of the flow and the outputs of every step are held in a single register file,
+/// which is created with [`CompiledFlow::new_registers`]. Registers `0..parameter_count` hold
+/// the parameters of the flow.
+#[derive(Clone, Debug)]
+pub struct CompiledFlow {
+    engine_list: Arc<EngineList>,
+    parameter_kinds: Vec<ParameterKind>,
+    steps: Vec<CompiledStep>,
+    initial_registers: Vec<ParameterValue>,
+    /// The indices of the engines this flow uses.
+    engines: Vec<usize>,
+    /// The most steps to execute at once.
+    parallel_steps: usize,
+}
+
+impl CompiledFlow {
+    /// Compile a flow against the available actions and engines. Each action is compiled once,
+    /// no matter how many steps use it.
+    pub fn compile(
+        flow: &AutomationFlow,
+        action_map: &ActionMap,
+        engine_list: Arc<EngineList>,
+    ) -> Result<Self, CompileError> {
+        let mut compiled_actions: HashMap<&String, Arc<CompiledAction>> = HashMap::new();
+        let parameter_kinds: Vec<ParameterKind> =
+            flow.parameters.iter().map(|(_, kind)| *kind).collect();
+        let mut initial_registers: Vec<ParameterValue> = parameter_kinds
+            .iter()
+            .map(|kind| kind.default_value())
+            .collect();
+        // The first register and the kinds of the outputs of each step so far.
+        let mut step_outputs: Vec<(usize, Vec<ParameterKind>)> =
+            Vec::with_capacity(flow.actions.len());
+        let mut steps: Vec<CompiledStep> = Vec::with_capacity(flow.actions.len());
+
+        for (step, config) in flow.actions.iter().enumerate() {
+            let action = action_map
+                .get_action_by_id(&config.action_id)
+                .ok_or_else(|| CompileError::MissingAction(step, config.action_id.clone()))?;
+            let compiled_action = match compiled_actions.get(&config.action_id) {
+                Some(compiled) => compiled.clone(),
+                None => {
+                    let compiled = Arc::new(
+                        CompiledAction::compile(&engine_list, &action).map_err(|err| {
+                            CompileError::InvalidAction(step, action.id.clone(), Box::new(err))
+                        })?,
+                    );
+                    compiled_actions.insert(&config.action_id, compiled.clone());
+                    compiled
+                }
+            };
+
+            let parameters = compile_action_parameters(
+                step,
+                config,
+                &action,
+                compiled_action.parameter_kinds(),
+                &parameter_kinds,
+                &step_outputs,
+            )?;
+
+            let first_output = initial_registers.len();
+            let output_kinds: Vec<ParameterKind> =
+                action.outputs.iter().map(|(_, kind, _)| *kind).collect();
+            initial_registers.extend(output_kinds.iter().map(|kind| kind.default_value()));
+            let output_count = output_kinds.len();
+            step_outputs.push((first_output, output_kinds));
+
+            let mut depends_on: Vec<usize> = config
+                .parameter_sources
+                .values()
+                .filter_map(|source| match source {
+                    ActionParameterSource::FromOutput(from_step, _) => Some(*from_step),
+                    _ => None,
+                })
+                .collect();
+            depends_on.sort_unstable();
+            depends_on.dedup();
+            let pinned_to = depends_on
+                .iter()
+                .rev()
+                .find(|dep| !steps[**dep].barrier)
+                .copied();
+
+            steps.push(CompiledStep {
+                action: compiled_action,
+                parameters,
+                first_output,
+                output_count,
+                depends_on,
+                barrier: config.barrier,
+                pinned_to,
+            });
+        }
+
+        let mut engines: Vec<usize> = compiled_actions
+            .values()
+            .flat_map(|action| action.engines())
+            .collect();
+        engines.sort_unstable();
+        engines.dedup();
+
+        Ok(Self {
+            engine_list,
+            parameter_kinds,
+            steps,
+            initial_registers,
+            engines,
+            parallel_steps: flow.parallel_steps.max(1),
+        })
+    }
+
+    /// The number of steps in this flow.
+    pub fn len(&self) -> usize {
+        self.steps.len()
+    }
+
+    /// Returns true if this flow has no steps.
+    pub fn is_empty(&self) -> bool {
+        self.steps.is_empty()
+    }
+
+    /// The kinds of the parameters this flow takes.
+    pub fn parameter_kinds(&self) -> &[ParameterKind] {
+        &self.parameter_kinds
+    }
+
+    /// The engines this flow was compiled against.
+    pub fn engine_list(&self) -> &Arc<EngineList> {
+        &self.engine_list
+    }
+
+    /// Open a session with the engines this flow uses, to execute it with its own engine
+    /// state.
+    pub fn open_session(&self) -> EngineSession {
+        EngineSession::open_with(self.engine_list.clone(), self.engines.clone())
+    }
+
+    /// Open the sessions to execute this flow with in [`CompiledFlow::execute_scheduled`]: one
+    /// for each step that may execute at once. If an engine this flow uses doesn't support
+    /// sessions, only one is opened, so steps are executed one at a time.
+    pub fn open_sessions(&self) -> Vec<EngineSession> {
+        let first = self.open_session();
+        let wanted = self.parallel_steps.min(self.steps.len());
+        if wanted > 1 && !first.is_isolated() {
+            log::warn!(
+                "An engine doesn't support sessions, so steps will be executed one at a time."
+            );
+            return vec![first];
+        }
+        let mut sessions = vec![first];
+        sessions.extend((1..wanted).map(|_| self.open_session()));
+        sessions
+    }
+
+    /// Create a fresh register file to execute this flow with, with every parameter of the flow
+    /// set to its default value.
+    pub fn new_registers(&self) -> Vec<ParameterValue> {
+        self.initial_registers.clone()
+    }
+
+    /// Create a fresh register file to execute this flow with the given parameters. These must
+    /// be of the kinds returned by [`CompiledFlow::parameter_kinds`].
+    pub fn new_registers_with(&self, parameters: Vec<ParameterValue>) -> Vec<ParameterValue> {
+        let mut registers = self.new_registers();
+        for (reg, value) in parameters.into_iter().enumerate() {
+            registers[reg] = value;
+        }
+        registers
+    }
+
+    /// Execute a single step of this flow within a session, reading the outputs of previous
+    /// steps from `registers` and writing the outputs of this step to it. `memo` holds the
+    /// results of pure instructions from earlier steps of the same execution.
+    pub fn execute_step(
+        &self,
+        step: usize,
+        session: &EngineSession,
+        memo: &Memo,
+        registers: &mut [ParameterValue],
+        evidence: &mut Vec<Evidence>,
+    ) -> Result<(), FlowError> {
+        let parameters = self.step_parameters(step, registers);
+        let outputs = self.run_step(step, session, memo, parameters, evidence)?;
+        self.write_outputs(step, registers, outputs);
+        Ok(())
+    }
+
+    /// Read the parameters of a step from `registers`.
+    fn step_parameters(&self, step: usize, registers: &[ParameterValue]) -> Vec<ParameterValue> {
+        self.steps[step]
+            .parameters
+            .iter()
+            .map(|operand| operand.resolve(registers).clone())
+            .collect()
+    }
+
+    /// Execute the action of a step with its parameters, returning its outputs.
+    fn run_step(
+        &self,
+        step: usize,
+        session: &EngineSession,
+        memo: &Memo,
+        parameters: Vec<ParameterValue>,
+        evidence: &mut Vec<Evidence>,
+    ) -> Result<Vec<ParameterValue>, FlowError> {
+        let _span = timing::span("step").step(step);
+        self.steps[step]
+            .action
+            .execute(session, memo, parameters, evidence)
+            .map_err(|(_step, err)| err)
+    }
+
+    /// Write the outputs of a step to `registers`, such as those recorded when it was executed
+    /// before.
+    pub fn write_outputs(
+        &self,
+        step: usize,
+        registers: &mut [ParameterValue],
+        outputs: Vec<ParameterValue>,
+    ) {
+        let first_output = self.steps[step].first_output;
+        for (offset, value) in outputs.into_iter().enumerate() {
+            registers[first_output + offset] = value;
+        }
+    }
+
+    /// Read the outputs of a step from `registers`.
+    fn read_outputs<'a>(
+        &self,
+        step: usize,
+        registers: &'a [ParameterValue],
+    ) -> &'a [ParameterValue] {
+        let compiled_step = &self.steps[step];
+        &registers
+            [compiled_step.first_output..compiled_step.first_output + compiled_step.output_count]
+    }
+
+    /// Execute the steps of this flow from `first_step` with `registers`, running steps that
+    /// don't depend on each other at the same time, one in each of `sessions` (which must not be
+    /// empty), as opened by [`CompiledFlow::open_sessions`]. A step is executed in the same
+    /// session as the latest step it depends on, so it sees the engine state that step left.
+    /// Barriers are executed in every session, so every later step sees the engine state they
+    /// left, and the evidence and outputs of the first to finish are passed on. The outputs of
+    /// any steps before `first_step` must already be in `registers`.
+    ///
+    /// `on_start` is called as each step starts, from the thread executing it. `on_finish` is
+    /// called with how long each step took, the evidence it produced and its outputs if it
+    /// succeeded, in step order, so the evidence is recorded in the same order as if the steps
+    /// had been executed one at a time. On failure, the steps already running are finished, and
+    /// the step that failed is returned with the error. If `cancel` is set, no more steps are
+    /// started and [`IpcError::Cancelled`] is returned.
+    pub fn execute_scheduled<S, F>(
+        &self,
+        sessions: &[EngineSession],
+        registers: Vec<ParameterValue>,
+        first_step: usize,
+        cancel: Option<&AtomicBool>,
+        on_start: S,
+        mut on_finish: F,
+    ) -> Result<(), (usize, FlowError)>
+    where
+        S: Fn(usize) + Sync,
+        F: FnMut(usize, Duration, Vec<Evidence>, Option<&[ParameterValue]>),
+    {
+        let is_cancelled = || cancel.is_some_and(|cancel| cancel.load(Ordering::Relaxed));
+        let cancelled = |step| (step, FlowError::IPCFailure(IpcError::Cancelled));
+        let memo = Memo::default();
+
+        if sessions.len() <= 1 {
+            let mut registers = registers;
+            for step in first_step..self.steps.len() {
+                if is_cancelled() {
+                    return Err(cancelled(step));
+                }
+                on_start(step);
+                let started = Instant::now();
+                let mut evidence = Vec::new();
+                let result =
+                    self.execute_step(step, &sessions[0], &memo, &mut registers, &mut evidence);
+                let outputs = result
+                    .as_ref()
+                    .ok()
+                    .map(|()| self.read_outputs(step, &registers));
+                on_finish(step, started.elapsed(), evidence, outputs);
+                result.map_err(|err| (step, err))?;
+            }
+            return Ok(());
+        }
+
+        let schedule = Mutex::new(Schedule {
+            registers,
+            started: (0..self.steps.len())
+                .map(|step| step < first_step)
+                .collect(),
+            done: (0..self.steps.len())
+                .map(|step| step < first_step)
+                .collect(),
+            sessions: (0..self.steps.len())
+                .map(|step| (step < first_step).then_some(0))
+                .collect(),
+            barriers: vec![(0..first_step).rfind(|step| self.steps[*step].barrier); sessions.len()],
+            runs_left: (0..self.steps.len())
+                .map(|step| match step {
+                    step if step < first_step => 0,
+                    step if self.steps[step].barrier => sessions.len(),
+                    _ => 1,
+                })
+                .collect(),
+            finished: (0..self.steps.len()).map(|_| None).collect(),
+            running: 0,
+            stopped: false,
+        });
+        let changed = Condvar::new();
+
+        thread::scope(|scope| {
+            for (index, session) in sessions.iter().enumerate() {
+                let (memo, schedule, changed, on_start) = (&memo, &schedule, &changed, &on_start);
+                scope.spawn(move || {
+                    self.schedule_worker(index, session, memo, schedule, changed, cancel, on_start)
+                });
+            }
+
+            // Pass on the results of each step in order as they finish.
+            let mut next = first_step;
+            let mut guard = schedule.lock().unwrap();
+            while next < self.steps.len() {
+                let finished = if guard.done[next] {
+                    guard.finished[next].take()
+                } else {
+                    None
+                };
+                if let Some((duration, evidence, result)) = finished {
+                    drop(guard);
+                    on_finish(next, duration, evidence, result.as_deref().ok());
+                    if let Err(err) = result {
+                        return Err((next, err));
+                    }
+                    next += 1;
+                    guard = schedule.lock().unwrap();
+                    continue;
+                }
+                if guard.running == 0 && (guard.stopped || is_cancelled()) {
+                    // Nothing else will finish, as a later step has failed or execution has
+                    // been cancelled.
+                    break;
+                }
+                guard = changed
+                    .wait_timeout(guard, SCHEDULE_POLL_INTERVAL)
+                    .unwrap()
+                    .0;
+            }
+            if next == self.steps.len() {
+                return Ok(());
+            }
+
+            // A later step failed before the next could start.
+            let failed = (next..self.steps.len()).find_map(|step| {
+                if let Some((duration, evidence, Err(err))) = guard.finished[step].take() {
+                    Some((step, duration, evidence, err))
+                } else {
+                    None
+                }
+            });
+            drop(guard);
+            match failed {
+                Some((step, duration, evidence, err)) => {
+                    on_finish(step, duration, evidence, None);
+                    Err((step, err))
+                }
+                None => Err(cancelled(next)),
+            }
+        })
+    }
+
+    /// Execute steps from a schedule within the session at `index` of the sessions until there
+    /// are none left to start.
+    #[allow(clippy::too_many_arguments)]
+    fn schedule_worker<S: Fn(usize)>(
+        &self,
+        index: usize,
+        session: &EngineSession,
+        memo: &Memo,
+        schedule: &Mutex<Schedule>,
+        changed: &Condvar,
+        cancel: Option<&AtomicBool>,
+        on_start: &S,
+    ) {
+        loop {
+            let mut guard = schedule.lock().unwrap();
+            let step = loop {
+                if guard.stopped || cancel.is_some_and(|cancel| cancel.load(Ordering::Relaxed)) {
+                    break None;
+                }
+                if let Some(step) = self.next_ready_step(&guard, index) {
+                    break Some(step);
+                }
+                if guard.started.iter().all(|started| *started) {
+                    break None;
+                }
+                guard = changed
+                    .wait_timeout(guard, SCHEDULE_POLL_INTERVAL)
+                    .unwrap()
+                    .0;
+            };
+            let Some(step) = step else {
+                changed.notify_all();
+                return;
+            };
+            let first_run = if self.steps[step].barrier {
+                let first_run = guard.barriers.iter().all(|barrier| *barrier < Some(step));
+                guard.barriers[index] = Some(step);
+                guard.started[step] = guard.barriers.iter().all(|b| *b == Some(step));
+                first_run
+            } else {
+                guard.started[step] = true;
+                guard.sessions[step] = Some(index);
+                true
+            };
+            guard.running += 1;
+            let parameters = self.step_parameters(step, &guard.registers);
+            drop(guard);
+
+            if first_run {
+                on_start(step);
+            }
+            let started = Instant::now();
+            let mut evidence = Vec::new();
+            let result = self.run_step(step, session, memo, parameters, &mut evidence);
+
+            let mut guard = schedule.lock().unwrap();
+            // Keep the result of the first session to finish a barrier, unless another fails.
+            let keep = match &guard.finished[step] {
+                None => true,
+                Some((_, _, Ok(_))) => result.is_err(),
+                Some((_, _, Err(_))) => false,
+            };
+            if keep {
+                if let Ok(outputs) = &result {
+                    self.write_outputs(step, &mut guard.registers, outputs.clone());
+                }
+                guard.finished[step] = Some((started.elapsed(), evidence, result));
+            }
+            if matches!(guard.finished[step], Some((_, _, Err(_)))) {
+                guard.stopped = true;
+            }
+            guard.running -= 1;
+            guard.runs_left[step] -= 1;
+            guard.done[step] = guard.runs_left[step] == 0;
+            drop(guard);
+            changed.notify_all();
+        }
+    }
+
+    /// Find the first step that hasn't started in the session at `session` of the sessions and
+    /// can start now: every step it depends on has finished, it isn't held up by an earlier
+    /// barrier that hasn't finished in every session, if it is a barrier itself, every earlier
+    /// step has finished, and it isn't pinned to another session.
+    fn next_ready_step(&self, schedule: &Schedule, session: usize) -> Option<usize> {
+        let is_done = |step: usize| schedule.done[step];
+        for (step, compiled_step) in self.steps.iter().enumerate() {
+            if compiled_step.barrier {
+                if schedule.barriers[session] < Some(step) {
+                    return (0..step).all(is_done).then_some(step);
+                }
+                if !is_done(step) {
+                    return None;
+                }
+                continue;
+            }
+            if schedule.started[step] {
+                continue;
+            }
+            let in_session = compiled_step
+                .pinned_to
+                .and_then(|pin| schedule.sessions[pin])
+                .is_none_or(|pinned| pinned == session);
+            if in_session && compiled_step.depends_on.iter().all(|dep| is_done(*dep)) {
+                return Some(step);
+            }
+        }
+        None
+    }
+
+    /// Execute every step of this flow in order within a session. On failure, the step that
+    /// failed is returned with the error.
+    pub fn execute(
+        &self,
+        session: &EngineSession,
+        evidence: &mut Vec<Evidence>,
+    ) -> Result<(), (usize, FlowError)> {
+        let memo = Memo::default();
+        let mut registers = self.new_registers();
+        for step in 0..self.steps.len() {
+            self.execute_step(step, session, &memo, &mut registers, evidence)
+                .map_err(|err| (step, err))?;
+        }
+        Ok(())
+    }
+}
+
+/// Resolve the parameters of an action in a flow to operands.
+fn compile_action_parameters(
+    step: usize,
+    config: &ActionConfiguration,
+    action: &Action,
+    kinds: &[ParameterKind],
+    flow_parameters: &[ParameterKind],
+    step_outputs: &[(usize, Vec<ParameterKind>)],
+) -> Result<Vec<Operand>, CompileError> {
+    let mut parameters = Vec::with_capacity(kinds.len());
+    for (idx, expected) in kinds.iter().enumerate() {
+        let name = action.parameters[idx].0.clone();
+        let (operand, kind) = match config.parameter_sources.get(&idx) {
+            None => return Err(CompileError::MissingValue(step, name)),
+            Some(ActionParameterSource::Literal) => {
+                let value = config
+                    .parameter_values
+                    .get(&idx)
+                    .ok_or_else(|| CompileError::MissingValue(step, name.clone()))?;
+                (Operand::Literal(value.clone()), value.kind())
+            }
+            Some(ActionParameterSource::FromOutput(from_step, output)) => step_outputs
+                .get(*from_step)
+                .and_then(|(first, kinds)| {
+                    kinds
+                        .get(*output)
+                        .map(|kind| (Operand::Register(first + output), *kind))
+                })
+                .ok_or_else(|| CompileError::InvalidSource(step, name.clone()))?,
+            Some(ActionParameterSource::FromFlowParameter(idx)) => flow_parameters
+                .get(*idx)
+                .map(|kind| (Operand::Register(*idx), *kind))
+                .ok_or_else(|| CompileError::InvalidSource(step, name.clone()))?,
+        };
+        if kind != *expected {
+            return Err(CompileError::KindMismatch(step, name, *expected, kind));
+        }
+        parameters.push(operand);
+    }
+    Ok(parameters)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::types::InstructionConfiguration;
+
+    #[derive(Default)]
+    struct State {
+        count: i32,
+    }
+
+    /// A list with an engine whose instructions add integers and count within a session.
+    fn engine_list() -> Arc<EngineList> {
+        let engine = testangel_engine::Engine::<State>::new("Test", "1")
+            .with_typed_instruction(
+                Instruction::new("test-add", "Add", "").pure(),
+                [("a", "A"), ("b", "B")],
+                [("result", "Result")],
+                |_state, (a, b): (i32, i32), _evidence| Ok((a + b,)),
+            )
+            .with_typed_instruction(
+                Instruction::new("test-count", "Count", ""),
+                [],
+                [("count", "Count")],
+                |state, (): (), _evidence| {
+                    state.count += 1;
+                    Ok((state.count,))
+                },
+            );
+        let stub = crate::ipc::Engine::stub(move |request| engine.process_request(request));
+        Arc::new(EngineList::from_engines(vec![stub]))
+    }
+
+    /// An instruction of an action, with each parameter taken from a source, or a literal
+    /// value if `None`.
+    fn instruction(
+        id: &str,
+        parameters: &[(&str, Option<InstructionParameterSource>, ParameterValue)],
+    ) -> InstructionConfiguration {
+        InstructionConfiguration {
+            instruction_id: id.to_string(),
+            parameter_sources: parameters
+                .iter()
+                .map(|(name, src, _)| (name.to_string(), src.clone().unwrap_or_default()))
+                .collect(),
+            parameter_values: parameters
+                .iter()
+                .map(|(name, _, value)| (name.to_string(), value.clone()))
+                .collect(),
+            ..Default::default()
+        }
+    }
+
+    fn action(
+        id: &str,
+        parameters: &[ParameterKind],
+        instructions: Vec<InstructionConfiguration>,
+        outputs: Vec<(ParameterKind, InstructionParameterSource)>,
+    ) -> Action {
+        let mut action = Action::default();
+        action.id = id.to_string();
+        action.parameters = parameters
+            .iter()
+            .map(|kind| (String::from("Parameter"), *kind))
+            .collect();
+        action.instructions = instructions;
+        action.outputs = outputs
+            .into_iter()
+            .map(|(kind, src)| (String::from("Output"), kind, src))
+            .collect();
+        action
+    }
+
+    /// An action that adds one to its parameter.
+    fn add_one() -> Action {
+        action(
+            "add-one",
+            &[ParameterKind::Integer],
+            vec![instruction(
+                "test-add",
+                &[
+                    (
+                        "a",
+                        Some(InstructionParameterSource::FromParameter(0)),
+                        ParameterValue::Integer(0),
+                    ),
+                    ("b", None, ParameterValue::Integer(1)),
+                ],
+            )],
+            vec![(
+                ParameterKind::Integer,
+                InstructionParameterSource::FromOutput(0, String::from("result")),
+            )],
+        )
+    }
+
+    /// An action that counts within its session, with an integer parameter that is ignored, so
+    /// that it can use the output of another step.
+    fn count() -> Action {
+        action(
+            "count",
+            &[ParameterKind::Integer],
+            vec![instruction("test-count", &[])],
+            vec![(
+                ParameterKind::Integer,
+                InstructionParameterSource::FromOutput(0, String::from("count")),
+            )],
+        )
+    }
+
+    fn count_step(source: Option<ActionParameterSource>, barrier: bool) -> ActionConfiguration {
+        ActionConfiguration {
+            action_id: String::from("count"),
+            ..add_one_step(source, barrier)
+        }
+    }
+
+    /// Execute a flow of `count` steps three at a time, returning the count each step output.
+    fn execute_counts(steps: Vec<ActionConfiguration>) -> Vec<i32> {
+        let mut flow = flow(steps);
+        flow.parallel_steps = 3;
+        let compiled = compile_flow(&flow, vec![count()]).unwrap();
+        let sessions = compiled.open_sessions();
+        assert_eq!(sessions.len(), 3);
+        let mut counts = vec![0; compiled.len()];
+        compiled
+            .execute_scheduled(
+                &sessions,
+                compiled.new_registers(),
+                0,
+                None,
+                |_| (),
+                |step, _, _, outputs| {
+                    if let Some([ParameterValue::Integer(n)]) = outputs {
+                        counts[step] = *n;
+                    }
+                },
+            )
+            .unwrap();
+        counts
+    }
+
+    /// A step of a flow calling `add-one`, with its parameter from a source, or the literal `1`
+    /// if `None`.
+    fn add_one_step(source: Option<ActionParameterSource>, barrier: bool) -> ActionConfiguration {
+        ActionConfiguration {
+            action_id: String::from("add-one"),
+            parameter_sources: HashMap::from([(0, source.unwrap_or_default())]),
+            parameter_values: HashMap::from([(0, ParameterValue::Integer(1))]),
+            barrier,
+        }
+    }
+
+    fn flow(steps: Vec<ActionConfiguration>) -> AutomationFlow {
+        let mut flow = AutomationFlow::default();
+        flow.actions = steps;
+        flow
+    }
+
+    fn compile_flow(
+        flow: &AutomationFlow,
+        actions: Vec<Action>,
+    ) -> Result<CompiledFlow, CompileError> {
+        let engine_list = engine_list();
+        let action_map = ActionMap::from_actions(&engine_list, actions);
+        CompiledFlow::compile(flow, &action_map, engine_list)
+    }
+
+    #[test]
+    fn executes_a_compiled_flow() {
+        let compiled = compile_flow(
+            &flow(vec![
+                add_one_step(None, false),
+                add_one_step(Some(ActionParameterSource::FromOutput(0, 0)), false),
+            ]),
+            vec![add_one()],
+        )
+        .unwrap();
+        let session = compiled.open_session();
+        let memo = Memo::default();
+        let mut registers = compiled.new_registers();
+        let mut evidence = vec![];
+        for step in 0..compiled.len() {
+            compiled
+                .execute_step(step, &session, &memo, &mut registers, &mut evidence)
+                .unwrap();
+        }
+        assert_eq!(
+            compiled.read_outputs(1, &registers),
+            [ParameterValue::Integer(3)]
+        );
+    }
+
+    #[test]
+    fn unknown_instructions_and_actions() {
+        let engine_list = engine_list();
+        let unknown = action(
+            "unknown",
+            &[],
+            vec![instruction("test-unknown", &[])],
+            vec![],
+        );
+        assert_eq!(
+            CompiledAction::compile(&engine_list, &unknown).unwrap_err(),
+            CompileError::MissingInstruction(0, String::from("test-unknown"))
+        );
+
+        // An action with an unknown instruction isn't loaded at all
+        let step = ActionConfiguration {
+            action_id: String::from("unknown"),
+            ..Default::default()
+        };
+        assert_eq!(
+            compile_flow(&flow(vec![step]), vec![unknown]).unwrap_err(),
+            CompileError::MissingAction(0, String::from("unknown"))
+        );
+    }
+
+    #[test]
+    fn forward_output_references() {
+        let engine_list = engine_list();
+        let forward = action(
+            "forward",
+            &[],
+            vec![
+                instruction(
+                    "test-add",
+                    &[
+                        (
+                            "a",
+                            Some(InstructionParameterSource::FromOutput(
+                                1,
+                                String::from("result"),
+                            )),
+                            ParameterValue::Integer(0),
+                        ),
+                        ("b", None, ParameterValue::Integer(1)),
+                    ],
+                ),
+                instruction("test-count", &[]),
+            ],
+            vec![],
+        );
+        assert_eq!(
+            CompiledAction::compile(&engine_list, &forward).unwrap_err(),
+            CompileError::InvalidSource(0, String::from("a"))
+        );
+
+        for from_step in [0, 1] {
+            let compiled = compile_flow(
+                &flow(vec![
+                    add_one_step(Some(ActionParameterSource::FromOutput(from_step, 0)), false),
+                    add_one_step(None, false),
+                ]),
+                vec![add_one()],
+            );
+            assert_eq!(
+                compiled.unwrap_err(),
+                CompileError::InvalidSource(0, String::from("Parameter"))
+            );
+        }
+    }
+
+    #[test]
+    fn kind_mismatches() {
+        let engine_list = engine_list();
+        let mismatched = action(
+            "mismatched",
+            &[ParameterKind::String],
+            vec![instruction(
+                "test-add",
+                &[
+                    (
+                        "a",
+                        Some(InstructionParameterSource::FromParameter(0)),
+                        ParameterValue::Integer(0),
+                    ),
+                    ("b", None, ParameterValue::Integer(1)),
+                ],
+            )],
+            vec![],
+        );
+        let error = CompileError::KindMismatch(
+            0,
+            String::from("a"),
+            ParameterKind::Integer,
+            ParameterKind::String,
+        );
+        assert_eq!(
+            CompiledAction::compile(&engine_list, &mismatched).unwrap_err(),
+            error
+        );
+        let step = ActionConfiguration {
+            action_id: String::from("mismatched"),
+            parameter_sources: HashMap::from([(0, ActionParameterSource::Literal)]),
+            parameter_values: HashMap::from([(0, ParameterValue::String(String::new()))]),
+            barrier: false,
+        };
+        assert_eq!(
+            compile_flow(&flow(vec![step]), vec![mismatched]).unwrap_err(),
+            CompileError::InvalidAction(0, String::from("mismatched"), Box::new(error))
+        );
+
+        let mut step = add_one_step(None, false);
+        step.parameter_values
+            .insert(0, ParameterValue::Boolean(true));
+        assert_eq!(
+            compile_flow(&flow(vec![step]), vec![add_one()]).unwrap_err(),
+            CompileError::KindMismatch(
+                0,
+                String::from("Parameter"),
+                ParameterKind::Integer,
+                ParameterKind::Boolean
+            )
+        );
+    }
+
+    #[test]
+    fn next_ready_step_follows_dependencies_and_barriers() {
+        // 1 depends on 0, 3 is a barrier and 4 and 5 are after it, with 5 using its output.
+        let compiled = compile_flow(
+            &flow(vec![
+                add_one_step(None, false),
+                add_one_step(Some(ActionParameterSource::FromOutput(0, 0)), false),
+                add_one_step(None, false),
+                add_one_step(None, true),
+                add_one_step(None, false),
+                add_one_step(Some(ActionParameterSource::FromOutput(3, 0)), false),
+            ]),
+            vec![add_one()],
+        )
+        .unwrap();
+        let mut schedule = Schedule {
+            registers: compiled.new_registers(),
+            started: vec![false; 6],
+            done: vec![false; 6],
+            sessions: vec![None; 6],
+            barriers: vec![None; 3],
+            runs_left: vec![1; 6],
+            finished: (0..6).map(|_| None).collect(),
+            running: 0,
+            stopped: false,
+        };
+        let start_in = |schedule: &mut Schedule, session| {
+            let step = compiled.next_ready_step(schedule, session);
+            if let Some(step) = step {
+                if compiled.steps[step].barrier {
+                    schedule.barriers[session] = Some(step);
+                } else {
+                    schedule.started[step] = true;
+                    schedule.sessions[step] = Some(session);
+                }
+            }
+            step
+        };
+        let start = |schedule: &mut Schedule| start_in(schedule, 0);
+
+        assert_eq!(start(&mut schedule), Some(0));
+        // 1 waits for 0
+        assert_eq!(start(&mut schedule), Some(2));
+        // The barrier waits for every earlier step, and 4 waits for the barrier
+        assert_eq!(start(&mut schedule), None);
+        schedule.done[0] = true;
+        // 1 is executed in the session that executed 0
+        assert_eq!(start_in(&mut schedule, 1), None);
+        assert_eq!(start(&mut schedule), Some(1));
+        schedule.done[2] = true;
+        assert_eq!(start(&mut schedule), None);
+        schedule.done[1] = true;
+        assert_eq!(start(&mut schedule), Some(3));
+        assert_eq!(start(&mut schedule), None);
+        // The barrier is executed in every session, and 4 waits for all of them
+        assert_eq!(start_in(&mut schedule, 1), Some(3));
+        assert_eq!(start_in(&mut schedule, 1), None);
+        assert_eq!(start_in(&mut schedule, 2), Some(3));
+        schedule.done[3] = true;
+        // The steps after the barrier can then be executed in any session at once
+        assert_eq!(start_in(&mut schedule, 2), Some(4));
+        assert_eq!(start_in(&mut schedule, 1), Some(5));
+        assert_eq!(start(&mut schedule), None);
+    }
+
+    #[test]
+    fn steps_after_a_barrier_see_its_engine_state() {
+        let mut steps = vec![count_step(None, true)];
+        steps.extend((0..4).map(|_| count_step(None, false)));
+        let counts = execute_counts(steps);
+        // The barrier counts once in each session, before anything else
+        assert_eq!(counts[0], 1);
+        assert!(counts[1..].iter().all(|count| *count >= 2));
+    }
+
+    #[test]
+    fn steps_see_the_engine_state_of_the_steps_they_use() {
+        for _ in 0..20 {
+            let counts = execute_counts(vec![
+                count_step(None, false),
+                count_step(None, false),
+                count_step(Some(ActionParameterSource::FromOutput(0, 0)), false),
+                count_step(Some(ActionParameterSource::FromOutput(2, 0)), false),
+                count_step(None, false),
+            ]);
+            assert!(counts[2] > counts[0]);
+            assert_eq!(counts[3], counts[2] + 1);
+        }
+    }
+
+    #[test]
+    fn memo_is_emptied_when_full() {
+        let memo = Memo::default();
+        let key = |n: i32| (String::from("pure"), vec![MemoValue::Integer(n)]);
+        let outputs = |n: i32| vec![Some(ParameterValue::Integer(n))];
+        for n in 0..MEMO_CAPACITY as i32 {
+            memo.insert(key(n), outputs(n));
+        }
+        assert_eq!(memo.get(&key(0)), Some(outputs(0)));
+
+        // Replacing a result that is kept doesn't empty it
+        memo.insert(key(1), outputs(-1));
+        assert_eq!(memo.get(&key(0)), Some(outputs(0)));
+        assert_eq!(memo.get(&key(1)), Some(outputs(-1)));
+
+        memo.insert(key(-1), outputs(-1));
+        assert_eq!(memo.get(&key(0)), None);
+        assert_eq!(memo.get(&key(-1)), Some(outputs(-1)));
+    }
+}
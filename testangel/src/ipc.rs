@@ -1,13 +1,26 @@
 use std::{
+    collections::HashMap,
     env,
     ffi::{c_char, CStr, CString},
     fmt, fs, io,
-    path::PathBuf,
-    sync::Arc,
+    path::{Path, PathBuf},
+    sync::{
+        atomic::{AtomicBool, AtomicUsize, Ordering},
+        mpsc, Arc, Mutex, OnceLock,
+    },
+    thread,
+    time::{Duration, Instant, UNIX_EPOCH},
 };
 
+use serde::{Deserialize, Serialize};
 use testangel_ipc::prelude::*;
 
+use crate::{
+    engine_host::{self, WorkerPool},
+    search::{SearchIndex, SearchStep},
+    timing,
+};
+
 #[derive(Debug)]
 pub enum IpcError {
     IoError(io::Error),
@@ -15,21 +28,241 @@ pub enum IpcError {
     EngineNotCompliant,
     CantLockEngineIo,
     InvalidResponseFromEngine,
+    /// The engine didn't respond before the deadline.
+    TimedOut,
+    /// The call was cancelled before the engine responded.
+    Cancelled,
+}
+
+/// How long an engine may take to run a batch of instructions, from `TA_INSTRUCTION_TIMEOUT` in
+/// seconds. If `None`, there is no limit.
+pub fn instruction_timeout() -> Option<Duration> {
+    static TIMEOUT: OnceLock<Option<Duration>> = OnceLock::new();
+    *TIMEOUT.get_or_init(|| {
+        env::var("TA_INSTRUCTION_TIMEOUT")
+            .ok()
+            .and_then(|secs| secs.parse::<f64>().ok())
+            .filter(|secs| secs.is_finite() && *secs > 0.0)
+            .map(Duration::from_secs_f64)
+    })
+}
+
+/// How often a call with a deadline checks if it has been cancelled.
+const CANCEL_POLL_INTERVAL: Duration = Duration::from_millis(50);
+
+/// The most threads making IPC calls for callers that may stop waiting for them. Calls made when
+/// every thread is busy wait for one to be free.
+const CALL_THREADS: usize = 32;
+
+type CallJob = Box<dyn FnOnce() + Send>;
+
+/// Threads that make IPC calls for callers that may stop waiting for them. A thread is started
+/// whenever none are free, up to [`CALL_THREADS`]. A call that never returns only holds up its
+/// own thread, and no more calls are made to its engine session until it does.
+struct CallExecutor {
+    sender: Mutex<mpsc::Sender<CallJob>>,
+    receiver: Arc<Mutex<mpsc::Receiver<CallJob>>>,
+    /// The number of threads waiting for a call.
+    idle: Arc<AtomicUsize>,
+    /// The number of threads started.
+    threads: AtomicUsize,
+}
+
+impl CallExecutor {
+    /// Get the executor shared by every call.
+    fn get() -> &'static Self {
+        static EXECUTOR: OnceLock<CallExecutor> = OnceLock::new();
+        EXECUTOR.get_or_init(|| {
+            let (sender, receiver) = mpsc::channel();
+            Self {
+                sender: Mutex::new(sender),
+                receiver: Arc::new(Mutex::new(receiver)),
+                idle: Arc::default(),
+                threads: AtomicUsize::new(0),
+            }
+        })
+    }
+
+    /// Run a job on a free thread, starting one if there are none and there are fewer than
+    /// [`CALL_THREADS`]. Otherwise, the job waits for a thread to be free.
+    fn spawn(&self, job: CallJob) -> Result<(), IpcError> {
+        let claimed_idle = self
+            .idle
+            .fetch_update(Ordering::AcqRel, Ordering::Acquire, |n| n.checked_sub(1))
+            .is_ok();
+        let can_start = || {
+            self.threads
+                .fetch_update(Ordering::AcqRel, Ordering::Acquire, |n| {
+                    (n < CALL_THREADS).then_some(n + 1)
+                })
+                .is_ok()
+        };
+        if !claimed_idle && can_start() {
+            let receiver = self.receiver.clone();
+            let idle = self.idle.clone();
+            thread::Builder::new()
+                .name(String::from("testangel-ipc"))
+                .spawn(move || loop {
+                    let job = match receiver.lock() {
+                        Ok(receiver) => receiver.recv(),
+                        Err(_) => return,
+                    };
+                    let Ok(job) = job else {
+                        return;
+                    };
+                    job();
+                    idle.fetch_add(1, Ordering::AcqRel);
+                })
+                .map_err(|e| {
+                    self.threads.fetch_sub(1, Ordering::AcqRel);
+                    IpcError::IoError(e)
+                })?;
+        }
+        self.sender
+            .lock()
+            .map_err(|_| IpcError::CantLockEngineIo)?
+            .send(job)
+            .map_err(|_| IpcError::CantLockEngineIo)
+    }
+}
+
+/// The progress of a call made by [`ipc_call_until`].
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+enum CallState {
+    /// The call is waiting for a free thread.
+    Queued,
+    Running,
+    /// The caller stopped waiting for the call. If it hadn't started, it never will.
+    Abandoned,
+    Finished,
+}
+
+/// Make an IPC call to an engine in a list, giving up if the engine hasn't responded by the
+/// deadline or `cancel` is set. If the engine is hosted, the worker making the call is stopped
+/// and restarted. Otherwise, the call is left to finish in the background, and until it does,
+/// other calls to the same session of the engine fail with the same error.
+pub fn ipc_call_until(
+    engine_list: &Arc<EngineList>,
+    engine: usize,
+    request: Request,
+    deadline: Option<Instant>,
+    cancel: Option<&AtomicBool>,
+) -> Result<Response, IpcError> {
+    if deadline.is_none() && cancel.is_none() {
+        return ipc_call(&engine_list.inner()[engine], request);
+    }
+
+    let session = match &request {
+        Request::RunInstructions { session, .. } | Request::ResetState { session } => *session,
+        Request::CloseSession { session } => Some(*session),
+        Request::Instructions | Request::OpenSession => None,
+    };
+    let (sender, receiver) = mpsc::sync_channel(1);
+    let state = Arc::new(Mutex::new(CallState::Queued));
+    let list = engine_list.clone();
+    let job_state = state.clone();
+    CallExecutor::get().spawn(Box::new(move || {
+        {
+            let Ok(mut state) = job_state.lock() else {
+                return;
+            };
+            if *state != CallState::Queued {
+                return;
+            }
+            *state = CallState::Running;
+        }
+        let result = ipc_call(&list.inner()[engine], request);
+        let abandoned = job_state.lock().is_ok_and(|mut state| {
+            let abandoned = *state == CallState::Abandoned;
+            *state = CallState::Finished;
+            abandoned
+        });
+        if abandoned {
+            list.inner()[engine].finish_abandoned(session);
+        }
+        let _ = sender.send(result);
+    }))?;
+
+    loop {
+        let mut wait = match deadline {
+            Some(deadline) => deadline.saturating_duration_since(Instant::now()),
+            None => CANCEL_POLL_INTERVAL,
+        };
+        if cancel.is_some() {
+            wait = wait.min(CANCEL_POLL_INTERVAL);
+        }
+        match receiver.recv_timeout(wait) {
+            Ok(result) => return result,
+            Err(mpsc::RecvTimeoutError::Disconnected) => {
+                return Err(IpcError::InvalidResponseFromEngine)
+            }
+            Err(mpsc::RecvTimeoutError::Timeout) => {
+                let cancelled = cancel.is_some_and(|cancel| cancel.load(Ordering::Relaxed));
+                if !cancelled && deadline.is_none_or(|deadline| Instant::now() < deadline) {
+                    continue;
+                }
+                let mut state = state.lock().map_err(|_| IpcError::CantLockEngineIo)?;
+                match *state {
+                    // The response is about to be sent.
+                    CallState::Finished => continue,
+                    CallState::Running => engine_list.inner()[engine].abort(session, cancelled),
+                    CallState::Queued | CallState::Abandoned => (),
+                }
+                *state = CallState::Abandoned;
+                return Err(if cancelled {
+                    IpcError::Cancelled
+                } else {
+                    IpcError::TimedOut
+                });
+            }
+        }
+    }
 }
 
 pub fn ipc_call(engine: &Engine, request: Request) -> Result<Response, IpcError> {
-    log::debug!(
-        "Sending request {:?} to engine {} at {:?}.",
-        request,
-        engine,
-        engine.path
-    );
+    // Requests and responses can carry large evidence, so only format them when they will be
+    // logged.
+    if log::log_enabled!(log::Level::Debug) {
+        log::debug!(
+            "Sending request {:?} to engine {} at {:?}.",
+            request,
+            engine,
+            engine.path
+        );
+    }
+
+    engine.check_abandoned(&request)?;
+    let res = match engine.transport()? {
+        Transport::Hosted(host) => {
+            let _span = timing::span("engine host call").engine(engine);
+            host.call(request)?
+        }
+        Transport::InProcess { lib, wire_format } => match wire_format {
+            WireFormat::Json => ipc_call_json(engine, lib, request)?,
+            WireFormat::MessagePack => ipc_call_msgpack(engine, lib, request)?,
+        },
+        #[cfg(test)]
+        Transport::Stub(handler) => handler.0(request),
+    };
 
+    if log::log_enabled!(log::Level::Debug) {
+        log::debug!("Got response {res:?}");
+    }
+    Ok(res)
+}
+
+/// Make an IPC call using the JSON wire format over the `ta_call` and `ta_release` symbols.
+fn ipc_call_json(
+    engine: &Engine,
+    lib: &libloading::Library,
+    request: Request,
+) -> Result<Response, IpcError> {
+    let span = timing::span("serialise").engine(engine);
     let request = request.to_json();
     let c_request = CString::new(request).unwrap();
+    drop(span);
+    let span = timing::span("ta_call").engine(engine);
     let response = unsafe {
-        let lib = engine.lib.clone().ok_or(IpcError::EngineNotStarted)?;
-
         let ta_call: libloading::Symbol<
             unsafe extern "C" fn(input: *const c_char) -> *const c_char,
         > = lib
@@ -47,14 +280,110 @@ pub fn ipc_call(engine: &Engine, request: Request) -> Result<Response, IpcError>
 
         string
     };
+    drop(span);
 
-    let res = Response::try_from(response).map_err(|e| {
+    let _span = timing::span("parse").engine(engine);
+    Response::try_from(response).map_err(|e| {
         log::error!("Failed to parse response ({}) from engine {}.", e, engine,);
         IpcError::InvalidResponseFromEngine
-    })?;
+    })
+}
 
-    log::debug!("Got response {res:?}");
-    Ok(res)
+/// Make an IPC call using the binary wire format over the `ta_call_bin` and `ta_release_bin`
+/// symbols. The response is parsed directly from the engine's buffer before it is released.
+fn ipc_call_msgpack(
+    engine: &Engine,
+    lib: &libloading::Library,
+    request: Request,
+) -> Result<Response, IpcError> {
+    let span = timing::span("serialise").engine(engine);
+    let request = request.to_msgpack();
+    drop(span);
+    let response = unsafe {
+        let ta_call_bin: libloading::Symbol<
+            unsafe extern "C" fn(
+                input: *const u8,
+                input_len: usize,
+                output_len: *mut usize,
+            ) -> *mut u8,
+        > = lib
+            .get(b"ta_call_bin")
+            .map_err(|_| IpcError::EngineNotCompliant)?;
+        let ta_release_bin: libloading::Symbol<
+            unsafe extern "C" fn(output: *mut u8, output_len: usize),
+        > = lib
+            .get(b"ta_release_bin")
+            .map_err(|_| IpcError::EngineNotCompliant)?;
+
+        let mut res_len = 0;
+        let span = timing::span("ta_call").engine(engine);
+        let res = ta_call_bin(request.as_ptr(), request.len(), &mut res_len);
+        drop(span);
+        let span = timing::span("parse").engine(engine);
+        let response = Response::try_from(std::slice::from_raw_parts(res, res_len));
+        drop(span);
+
+        // release buffer
+        ta_release_bin(res, res_len);
+
+        response
+    };
+
+    response.map_err(|e| {
+        log::error!("Failed to parse response ({}) from engine {}.", e, engine,);
+        IpcError::InvalidResponseFromEngine
+    })
+}
+
+/// The format used to exchange messages with an engine.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub enum WireFormat {
+    /// JSON text, passed as C strings. All engines support this.
+    #[default]
+    Json,
+    /// MessagePack, passed as byte buffers. Used when the engine exports `ta_call_bin`.
+    MessagePack,
+}
+
+impl WireFormat {
+    /// Determine the best wire format supported by an engine library.
+    fn detect(lib: &libloading::Library) -> Self {
+        let supports_bin = unsafe {
+            lib.get::<unsafe extern "C" fn()>(b"ta_call_bin").is_ok()
+                && lib.get::<unsafe extern "C" fn()>(b"ta_release_bin").is_ok()
+        };
+        if supports_bin {
+            Self::MessagePack
+        } else {
+            Self::Json
+        }
+    }
+}
+
+/// How requests reach an engine once it has been started.
+#[derive(Debug)]
+enum Transport {
+    /// The engine library is loaded into this process.
+    InProcess {
+        lib: libloading::Library,
+        wire_format: WireFormat,
+    },
+    /// The engine is hosted by worker processes.
+    Hosted(WorkerPool),
+    /// The engine is a function, for tests.
+    #[cfg(test)]
+    Stub(StubHandler),
+}
+
+/// A function that answers the requests to an engine made with [`Engine::stub`].
+#[cfg(test)]
+struct StubHandler(Box<dyn Fn(Request) -> Response + Send + Sync>);
+
+#[cfg(test)]
+impl fmt::Debug for StubHandler {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.write_str("StubHandler")
+    }
 }
 
 #[derive(Clone, Debug, Default)]
@@ -62,13 +391,241 @@ pub struct Engine {
     path: PathBuf,
     pub name: String,
     pub instructions: Vec<Instruction>,
-    lib: Option<Arc<libloading::Library>>,
+    /// A lookup from instruction ID to the index of that instruction in `instructions`, which is
+    /// also the handle the engine accepts for it.
+    instruction_handles: HashMap<String, usize>,
+    /// The number of worker processes to host this engine with, or `None` to load it into this
+    /// process.
+    host_workers: Option<usize>,
+    /// The started engine. This is started on first use, so engines registered from the
+    /// discovery cache aren't loaded until they are needed.
+    transport: Arc<OnceLock<Result<Transport, String>>>,
+    /// The calls that were stopped waiting for but couldn't be interrupted, and are still
+    /// running.
+    abandoned: Arc<Mutex<Abandoned>>,
+}
+
+/// The calls to an engine that were stopped waiting for but are still running, and the sessions
+/// to close once they finish.
+#[derive(Debug, Default)]
+struct Abandoned {
+    calls: Vec<AbandonedCall>,
+    closing: Vec<u64>,
+}
+
+impl Abandoned {
+    /// Get the call still running that holds up a session, if any.
+    fn holding_up(&self, session: Option<u64>) -> Option<&AbandonedCall> {
+        self.calls
+            .iter()
+            .find(|call| call.session.is_none() || session.is_none() || call.session == session)
+    }
+}
+
+/// A call to an engine that was stopped waiting for but is still running.
+#[derive(Clone, Copy, Debug)]
+struct AbandonedCall {
+    /// The session of the call. `None` is the shared state, which holds up every session.
+    session: Option<u64>,
+    /// Whether the call was cancelled rather than timed out.
+    cancelled: bool,
 }
 
 impl Engine {
-    /// Ask the engine to reset it's state for test repeatability.
-    pub fn reset_state(&self) -> Result<(), IpcError> {
-        ipc_call(self, Request::ResetState).map(|_| ())
+    /// Create an engine for the library at `path`. It isn't started until it is first called.
+    fn new(path: PathBuf, host_workers: Option<usize>) -> Self {
+        Self {
+            name: String::from("newly discovered engine"),
+            path,
+            host_workers,
+            ..Default::default()
+        }
+    }
+
+    /// Load an engine library into this process now. The instructions it provides aren't
+    /// requested.
+    pub fn load(path: PathBuf) -> Result<Self, String> {
+        let engine = Self::new(path, None);
+        if let Err(e) = engine.transport.get_or_init(|| engine.start()) {
+            return Err(e.clone());
+        }
+        Ok(engine)
+    }
+
+    /// Create an engine for tests whose requests are answered by a function, with the
+    /// instructions it gives in response to [`Request::Instructions`].
+    #[cfg(test)]
+    pub(crate) fn stub<F>(handler: F) -> Self
+    where
+        F: Fn(Request) -> Response + Send + Sync + 'static,
+    {
+        let mut engine = Self::new(PathBuf::from("stub"), None);
+        if let Response::Instructions {
+            friendly_name,
+            instructions,
+            ..
+        } = handler(Request::Instructions)
+        {
+            engine.name = friendly_name;
+            engine.set_instructions(instructions);
+        }
+        let _ = engine
+            .transport
+            .set(Ok(Transport::Stub(StubHandler(Box::new(handler)))));
+        engine
+    }
+
+    /// Start this engine, either by loading it into this process or starting its workers.
+    fn start(&self) -> Result<Transport, String> {
+        match self.host_workers {
+            Some(workers) => {
+                log::debug!("Engine {:?} is hosted by {workers} worker(s)", self.path);
+                WorkerPool::spawn(self.path.clone(), workers)
+                    .map(Transport::Hosted)
+                    .map_err(|e| e.to_string())
+            }
+            None => {
+                let lib =
+                    unsafe { libloading::Library::new(&self.path) }.map_err(|e| e.to_string())?;
+                let wire_format = WireFormat::detect(&lib);
+                log::debug!(
+                    "Engine {:?} uses the {wire_format:?} wire format",
+                    self.path
+                );
+                Ok(Transport::InProcess { lib, wire_format })
+            }
+        }
+    }
+
+    /// Get the transport to this engine, starting it if it hasn't been already.
+    fn transport(&self) -> Result<&Transport, IpcError> {
+        self.transport
+            .get_or_init(|| self.start())
+            .as_ref()
+            .map_err(|e| {
+                log::error!("Failed to start engine {:?}: {e}", self.path);
+                IpcError::EngineNotStarted
+            })
+    }
+
+    /// Set the instructions this engine provides.
+    fn set_instructions(&mut self, instructions: Vec<Instruction>) {
+        self.instruction_handles = instructions
+            .iter()
+            .enumerate()
+            .map(|(idx, inst)| (inst.id().clone(), idx))
+            .collect();
+        self.instructions = instructions;
+    }
+
+    /// Get the handle the engine accepts for an instruction, if this engine provides it.
+    pub fn instruction_handle(&self, instruction_id: &String) -> Option<usize> {
+        self.instruction_handles.get(instruction_id).copied()
+    }
+
+    /// Ask the engine to reset it's state for test repeatability. If a session is given, only
+    /// the state of that session is reset.
+    pub fn reset_state(&self, session: Option<u64>) -> Result<(), IpcError> {
+        match ipc_call(self, Request::ResetState { session })? {
+            Response::StateReset => Ok(()),
+            _ => Err(IpcError::InvalidResponseFromEngine),
+        }
+    }
+
+    /// Open a session with this engine. Returns `None` if this engine doesn't support sessions,
+    /// in which case it only has a single shared state.
+    pub fn open_session(&self) -> Option<u64> {
+        match ipc_call(self, Request::OpenSession) {
+            Ok(Response::SessionOpened { session }) => Some(session),
+            _ => {
+                log::debug!("Engine {self} doesn't support sessions.");
+                None
+            }
+        }
+    }
+
+    /// Stop a call that is still running for a session, after the caller has stopped waiting for
+    /// it. Only hosted engines can be stopped, by stopping the worker making the call, which
+    /// loses the sessions it held. Otherwise, other calls to the session fail until
+    /// [`Engine::finish_abandoned`] is called for it.
+    fn abort(&self, session: Option<u64>, cancelled: bool) {
+        match self.transport.get() {
+            Some(Ok(Transport::Hosted(host))) => host.abort(session),
+            _ => {
+                log::warn!(
+                    "A call to engine {self} was stopped waiting for, but can't be interrupted and will be left to finish."
+                );
+                if let Ok(mut abandoned) = self.abandoned.lock() {
+                    abandoned.calls.push(AbandonedCall { session, cancelled });
+                }
+            }
+        }
+    }
+
+    /// Allow calls to a session again after a call that was stopped waiting for has finished,
+    /// and close the sessions that were waiting for it to be closed.
+    fn finish_abandoned(&self, session: Option<u64>) {
+        let closing: Vec<u64> = {
+            let Ok(mut abandoned) = self.abandoned.lock() else {
+                return;
+            };
+            if let Some(idx) = abandoned
+                .calls
+                .iter()
+                .position(|call| call.session == session)
+            {
+                abandoned.calls.remove(idx);
+            }
+            let (closing, held): (Vec<u64>, Vec<u64>) = abandoned
+                .closing
+                .iter()
+                .partition(|session| abandoned.holding_up(Some(**session)).is_none());
+            abandoned.closing = held;
+            closing
+        };
+        for session in closing {
+            if let Err(e) = self.close_session(session) {
+                log::warn!("Couldn't close session with engine {self}: {e:?}");
+            }
+        }
+    }
+
+    /// Fail a request if a call that was stopped waiting for is still running in the session it
+    /// uses.
+    fn check_abandoned(&self, request: &Request) -> Result<(), IpcError> {
+        let session = match request {
+            Request::RunInstructions { session, .. } | Request::ResetState { session } => *session,
+            Request::CloseSession { session } => Some(*session),
+            Request::Instructions | Request::OpenSession => return Ok(()),
+        };
+        let abandoned = self
+            .abandoned
+            .lock()
+            .map_err(|_| IpcError::CantLockEngineIo)?;
+        match abandoned.holding_up(session) {
+            Some(call) if call.cancelled => Err(IpcError::Cancelled),
+            Some(_) => Err(IpcError::TimedOut),
+            None => Ok(()),
+        }
+    }
+
+    /// Close a session with this engine, discarding its state. If a call that was stopped
+    /// waiting for is still running in it, it is closed once the call finishes.
+    pub fn close_session(&self, session: u64) -> Result<(), IpcError> {
+        {
+            let mut abandoned = self
+                .abandoned
+                .lock()
+                .map_err(|_| IpcError::CantLockEngineIo)?;
+            if abandoned.holding_up(Some(session)).is_some() {
+                abandoned.closing.push(session);
+                return Ok(());
+            }
+        }
+        match ipc_call(self, Request::CloseSession { session })? {
+            Response::SessionClosed => Ok(()),
+            _ => Err(IpcError::InvalidResponseFromEngine),
+        }
     }
 }
 
@@ -79,98 +636,467 @@ impl fmt::Display for Engine {
 }
 
 #[derive(Default, Debug)]
-pub struct EngineList(Vec<Engine>);
+pub struct EngineList {
+    engines: Vec<Engine>,
+    /// A lookup from instruction ID to the index of the engine that provides it. If more than
+    /// one engine provides an instruction, the first engine discovered is used.
+    instruction_engines: HashMap<String, usize>,
+    /// The search index of the instructions, built when it is first needed.
+    search_index: OnceLock<SearchIndex>,
+}
 
 impl EngineList {
-    /// Get an instruction from an instruction ID by iterating through available engines.
-    pub fn get_instruction_by_id(&self, instruction_id: &String) -> Option<Instruction> {
-        for engine in &self.0 {
+    /// Build an engine list and its instruction index from a list of engines.
+    fn new(engines: Vec<Engine>) -> Self {
+        let mut instruction_engines = HashMap::new();
+        for (idx, engine) in engines.iter().enumerate() {
             for inst in &engine.instructions {
-                if *inst.id() == *instruction_id {
-                    return Some(inst.clone());
-                }
+                instruction_engines.entry(inst.id().clone()).or_insert(idx);
             }
         }
-        None
+        Self {
+            engines,
+            instruction_engines,
+            search_index: OnceLock::new(),
+        }
+    }
+
+    /// Build an engine list for tests, such as from engines made with [`Engine::stub`].
+    #[cfg(test)]
+    pub(crate) fn from_engines(engines: Vec<Engine>) -> Self {
+        Self::new(engines)
     }
 
-    /// Get an instruction and engine from an instruction ID by iterating through available engines.
+    /// Get an instruction from an instruction ID.
+    pub fn get_instruction_by_id(&self, instruction_id: &String) -> Option<&Instruction> {
+        let engine = self.get_engine_by_instruction_id(instruction_id)?;
+        let handle = engine.instruction_handle(instruction_id)?;
+        engine.instructions.get(handle)
+    }
+
+    /// Get the engine that provides an instruction from an instruction ID.
     pub fn get_engine_by_instruction_id(&self, instruction_id: &String) -> Option<&Engine> {
-        for engine in &self.0 {
-            for inst in &engine.instructions {
-                if *inst.id() == *instruction_id {
-                    return Some(engine);
+        self.get_engine_index_by_instruction_id(instruction_id)
+            .map(|idx| &self.engines[idx])
+    }
+
+    /// Get the index in [`EngineList::inner`] of the engine that provides an instruction.
+    pub fn get_engine_index_by_instruction_id(&self, instruction_id: &String) -> Option<usize> {
+        self.instruction_engines.get(instruction_id).copied()
+    }
+
+    /// Return the inner list of engines
+    pub fn inner(&self) -> &Vec<Engine> {
+        &self.engines
+    }
+
+    /// Get the search index of the instructions of every engine, labelled `engine: name`. It is
+    /// built the first time this is called.
+    pub fn search_index(&self) -> &SearchIndex {
+        self.search_index.get_or_init(|| {
+            SearchIndex::new(self.engines.iter().flat_map(|engine| {
+                engine.instructions.iter().map(|instruction| SearchStep {
+                    label: format!("{}: {}", engine.name, instruction.friendly_name()),
+                    value: instruction.id().clone(),
+                    description: instruction.description().clone(),
+                    group: engine.name.clone(),
+                    hidden: false,
+                })
+            }))
+        })
+    }
+}
+
+/// A session with the engines in an [`EngineList`] that a flow uses, giving the flow its own
+/// engine state so that more than one flow can be executed at the same time. Engines that don't
+/// support sessions use their single shared state. The sessions are closed when this is dropped.
+///
+/// Instructions run within a session may take up to [`instruction_timeout`], and are cancelled
+/// if the session was given a cancel flag which is set.
+#[derive(Debug)]
+pub struct EngineSession {
+    engine_list: Arc<EngineList>,
+    /// The indices of the engines this session is with.
+    engines: Vec<usize>,
+    /// The session with each engine, in the same order as the engine list.
+    sessions: Vec<Option<u64>>,
+    /// How long a batch of instructions may take.
+    timeout: Option<Duration>,
+    /// If set, instructions that are running are cancelled.
+    cancel: Option<Arc<AtomicBool>>,
+}
+
+impl EngineSession {
+    /// Open a session with every engine in the list.
+    pub fn open(engine_list: Arc<EngineList>) -> Self {
+        let engines = (0..engine_list.inner().len()).collect();
+        Self::open_with(engine_list, engines)
+    }
+
+    /// Open a session with only the engines at the given indices of the engine list. Other
+    /// engines aren't started.
+    pub fn open_with(engine_list: Arc<EngineList>, engines: Vec<usize>) -> Self {
+        let mut sessions = vec![None; engine_list.inner().len()];
+        for idx in &engines {
+            sessions[*idx] = engine_list.inner()[*idx].open_session();
+        }
+        Self {
+            engine_list,
+            engines,
+            sessions,
+            timeout: instruction_timeout(),
+            cancel: None,
+        }
+    }
+
+    /// Use the shared state of every engine, without opening any sessions.
+    pub fn shared(engine_list: Arc<EngineList>) -> Self {
+        let sessions = vec![None; engine_list.inner().len()];
+        Self {
+            engines: (0..sessions.len()).collect(),
+            engine_list,
+            sessions,
+            timeout: instruction_timeout(),
+            cancel: None,
+        }
+    }
+
+    /// Limit how long a batch of instructions may take, instead of using
+    /// [`instruction_timeout`].
+    pub fn with_timeout(mut self, timeout: Option<Duration>) -> Self {
+        self.timeout = timeout;
+        self
+    }
+
+    /// Cancel any instructions that are running when `cancel` is set.
+    pub fn with_cancel(mut self, cancel: Arc<AtomicBool>) -> Self {
+        self.cancel = Some(cancel);
+        self
+    }
+
+    /// Send instructions to the engine at an index of the engine list within this session,
+    /// giving up if they take longer than the timeout or are cancelled.
+    pub fn run_instructions(
+        &self,
+        engine: usize,
+        instructions: Vec<InstructionWithParameters>,
+    ) -> Result<Response, IpcError> {
+        let request = Request::RunInstructions {
+            instructions,
+            session: self.sessions[engine],
+        };
+        ipc_call_until(
+            &self.engine_list,
+            engine,
+            request,
+            self.timeout.map(|timeout| Instant::now() + timeout),
+            self.cancel.as_deref(),
+        )
+    }
+
+    /// The engines this session is with.
+    pub fn engine_list(&self) -> &Arc<EngineList> {
+        &self.engine_list
+    }
+
+    /// Returns true if this session has its own state with every engine it is with, so it can be
+    /// used at the same time as other sessions.
+    pub fn is_isolated(&self) -> bool {
+        self.engines.iter().all(|idx| self.sessions[*idx].is_some())
+    }
+
+    /// Get the session with the engine at an index of the engine list, if it has one.
+    pub fn session(&self, engine: usize) -> Option<u64> {
+        self.sessions[engine]
+    }
+
+    /// Reset the state of this session with every engine. Every engine is reset even if one
+    /// fails, and the first error is returned.
+    pub fn reset_state(&self) -> Result<(), IpcError> {
+        let mut result = Ok(());
+        for idx in &self.engines {
+            let engine = &self.engine_list.inner()[*idx];
+            if let Err(e) = engine.reset_state(self.sessions[*idx]) {
+                log::warn!("Couldn't reset the state of engine {engine}: {e:?}");
+                if result.is_ok() {
+                    result = Err(e);
                 }
             }
         }
-        None
+        result
     }
+}
 
-    /// Return the inner list of engines
-    pub fn inner(&self) -> &Vec<Engine> {
-        &self.0
+impl Drop for EngineSession {
+    fn drop(&mut self) {
+        for (engine, session) in self.engine_list.inner().iter().zip(&self.sessions) {
+            if let Some(session) = session {
+                if let Err(e) = engine.close_session(*session) {
+                    log::warn!("Couldn't close session with engine {engine}: {e:?}");
+                }
+            }
+        }
+    }
+}
+
+/// The version of the engine discovery cache format.
+const ENGINE_CACHE_VERSION: usize = 1;
+
+/// The name of the engine discovery cache file within the engine directory.
+const ENGINE_CACHE_FILE: &str = ".tacache-engines";
+
+/// The modification time and size of a file, used to tell if it has changed.
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Serialize, Deserialize)]
+pub(crate) struct FileStamp {
+    modified_secs: u64,
+    modified_nanos: u32,
+    size: u64,
+}
+
+impl FileStamp {
+    pub(crate) fn new(meta: &fs::Metadata) -> Option<Self> {
+        let modified = meta.modified().ok()?.duration_since(UNIX_EPOCH).ok()?;
+        Some(Self {
+            modified_secs: modified.as_secs(),
+            modified_nanos: modified.subsec_nanos(),
+            size: meta.len(),
+        })
+    }
+}
+
+/// An engine remembered from a previous discovery.
+#[derive(Clone, Debug, Serialize, Deserialize)]
+struct CachedEngine {
+    path: PathBuf,
+    stamp: FileStamp,
+    name: String,
+    instructions: Vec<Instruction>,
+}
+
+/// The engine discovery cache, which lets unchanged engines be registered without loading them.
+#[derive(Debug, Default, Serialize, Deserialize)]
+struct EngineCache {
+    version: usize,
+    engines: Vec<CachedEngine>,
+}
+
+impl EngineCache {
+    /// Read the cache, returning an empty cache if it is missing, unreadable or out of date.
+    fn read(path: &Path) -> Self {
+        fs::read_to_string(path)
+            .ok()
+            .and_then(|cache| ron::from_str::<Self>(&cache).ok())
+            .filter(|cache| cache.version == ENGINE_CACHE_VERSION)
+            .unwrap_or_default()
+    }
+
+    /// Write the cache. Failing to do so only means the next discovery is slower.
+    fn write(&self, path: &Path) {
+        match ron::to_string(self) {
+            Ok(cache) => {
+                if let Err(e) = fs::write(path, cache) {
+                    log::debug!("Couldn't write engine cache {path:?}: {e}");
+                }
+            }
+            Err(e) => log::debug!("Couldn't serialise engine cache: {e}"),
+        }
+    }
+}
+
+/// Discover a single engine, from the cache if it hasn't changed or by starting it and asking
+/// for its instructions otherwise.
+fn discover_engine(
+    path: PathBuf,
+    stamp: Option<FileStamp>,
+    cached: Option<&CachedEngine>,
+    host_workers: Option<usize>,
+) -> Option<(Engine, Option<CachedEngine>)> {
+    let mut engine = Engine::new(path.clone(), host_workers);
+
+    if let Some(cached) = cached.filter(|cached| Some(cached.stamp) == stamp) {
+        log::info!("Discovered engine {} at {path:?} (cached)", cached.name);
+        engine.name = cached.name.clone();
+        engine.set_instructions(cached.instructions.clone());
+        return Some((engine, Some(cached.clone())));
     }
+
+    match ipc_call(&engine, Request::Instructions) {
+        Ok(Response::Instructions {
+            friendly_name,
+            engine_version,
+            ipc_version,
+            instructions,
+        }) => {
+            if ipc_version != 1 {
+                log::warn!(
+                    "Engine {friendly_name} (v{engine_version}) at {path:?} doesn't speak the right IPC version!"
+                );
+                return None;
+            }
+            log::info!("Discovered engine {friendly_name} (v{engine_version}) at {path:?}");
+            let cached = stamp.map(|stamp| CachedEngine {
+                path,
+                stamp,
+                name: friendly_name.clone(),
+                instructions: instructions.clone(),
+            });
+            engine.name = friendly_name;
+            engine.set_instructions(instructions);
+            Some((engine, cached))
+        }
+        Ok(_) => {
+            log::error!("Invalid response from engine {path:?}");
+            None
+        }
+        Err(e) => {
+            log::warn!("IPC error: {e:?}");
+            None
+        }
+    }
+}
+
+/// The directory engines are discovered in, from `TA_ENGINE_DIR`. This is also where caches
+/// are kept.
+pub fn engine_dir() -> String {
+    env::var("TA_ENGINE_DIR").unwrap_or("./engines".to_owned())
 }
 
-/// Get the list of available engines.
+/// Get the list of available engines. Engines are discovered concurrently, and engines that
+/// haven't changed since they were last discovered are registered from a cache without being
+/// loaded until they are first used.
 pub fn get_engines() -> EngineList {
-    let mut engines = Vec::new();
-    let engine_dir = env::var("TA_ENGINE_DIR").unwrap_or("./engines".to_owned());
+    let engine_dir = engine_dir();
     fs::create_dir_all(engine_dir.clone()).unwrap();
     log::info!("Searching for engines in {engine_dir:?}");
+    let host_workers = engine_host::workers_per_engine();
+    let cache_path = Path::new(&engine_dir).join(ENGINE_CACHE_FILE);
+    let cache = EngineCache::read(&cache_path);
+    let cached: HashMap<&PathBuf, &CachedEngine> =
+        cache.engines.iter().map(|e| (&e.path, e)).collect();
+
+    let mut paths = Vec::new();
     for path in fs::read_dir(engine_dir).unwrap() {
         let path = path.unwrap();
-        let basename = path.file_name();
-        if let Ok(meta) = path.metadata() {
-            if meta.is_dir() {
-                continue;
-            }
+        let Ok(meta) = path.metadata() else {
+            continue;
+        };
+        if meta.is_dir() {
+            continue;
         }
 
-        if let Ok(str) = basename.into_string() {
+        if let Ok(str) = path.file_name().into_string() {
             log::debug!("Found {str}");
             if str.ends_with(".so") || str.ends_with(".dll") || str.ends_with(".dylib") {
                 log::debug!("Detected possible engine {str}");
-                match unsafe { libloading::Library::new(path.path()) } {
-                    Ok(lib) => {
-                        let mut engine = Engine {
-                            name: String::from("newly discovered engine"),
-                            path: path.path(),
-                            lib: Some(Arc::new(lib)),
-                            ..Default::default()
-                        };
-                        match ipc_call(&engine, Request::Instructions) {
-                            Ok(res) => match res {
-                                Response::Instructions {
-                                    friendly_name,
-                                    engine_version,
-                                    ipc_version,
-                                    instructions,
-                                } => {
-                                    if ipc_version == 1 {
-                                        log::info!(
-                                            "Discovered engine {friendly_name} (v{engine_version}) at {:?}",
-                                            path.path()
-                                        );
-                                        engine.name = friendly_name.clone();
-                                        engine.instructions = instructions;
-                                        engines.push(engine);
-                                    } else {
-                                        log::warn!(
-                                            "Engine {friendly_name} (v{engine_version}) at {:?} doesn't speak the right IPC version!",
-                                            path.path()
-                                        );
-                                    }
-                                }
-                                _ => log::error!("Invalid response from engine {str}"),
-                            },
-                            Err(e) => log::warn!("IPC error: {e:?}"),
-                        }
-                    }
-                    Err(e) => log::warn!("Failed to load engine {str}: {e}"),
+                paths.push((path.path(), FileStamp::new(&meta)));
+            }
+        }
+    }
+    // Keep the order engines are registered in stable, as the first engine to provide an
+    // instruction is used.
+    paths.sort_by(|a, b| a.0.cmp(&b.0));
+
+    let discovered: Vec<_> = thread::scope(|s| {
+        let handles: Vec<_> = paths
+            .into_iter()
+            .map(|(path, stamp)| {
+                let cached = cached.get(&path).copied();
+                s.spawn(move || discover_engine(path, stamp, cached, host_workers))
+            })
+            .collect();
+        handles
+            .into_iter()
+            .filter_map(|handle| handle.join().ok().flatten())
+            .collect()
+    });
+
+    let mut engines = Vec::with_capacity(discovered.len());
+    let mut new_cache = EngineCache {
+        version: ENGINE_CACHE_VERSION,
+        engines: Vec::with_capacity(discovered.len()),
+    };
+    for (engine, cached) in discovered {
+        engines.push(engine);
+        new_cache.engines.extend(cached);
+    }
+    let unchanged = new_cache.engines.len() == cache.engines.len()
+        && new_cache
+            .engines
+            .iter()
+            .all(|e| cached.get(&e.path).is_some_and(|c| c.stamp == e.stamp));
+    if !unchanged {
+        new_cache.write(&cache_path);
+    }
+
+    EngineList::new(engines)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn run(session: Option<u64>) -> Request {
+        Request::RunInstructions {
+            instructions: vec![],
+            session,
+        }
+    }
+
+    #[test]
+    fn abandoned_calls_hold_up_their_session() {
+        // Calls in session 1 wait until they are let go.
+        let (release, released) = mpsc::channel::<()>();
+        let released = Mutex::new(released);
+        let (close, closed) = mpsc::channel::<u64>();
+        let close = Mutex::new(close);
+        let engine = Engine::stub(move |request| match request {
+            Request::Instructions => Response::Instructions {
+                friendly_name: String::from("Test"),
+                engine_version: String::from("1"),
+                ipc_version: 1,
+                instructions: vec![],
+            },
+            Request::RunInstructions {
+                session: Some(1), ..
+            } => {
+                let _ = released.lock().unwrap().recv();
+                Response::ExecutionOutput {
+                    output: vec![],
+                    evidence: vec![],
                 }
             }
+            Request::CloseSession { session } => {
+                let _ = close.lock().unwrap().send(session);
+                Response::SessionClosed
+            }
+            _ => Response::ExecutionOutput {
+                output: vec![],
+                evidence: vec![],
+            },
+        });
+        let list = Arc::new(EngineList::from_engines(vec![engine]));
+        let soon = || Some(Instant::now() + Duration::from_millis(100));
+
+        assert!(matches!(
+            ipc_call_until(&list, 0, run(Some(1)), soon(), None),
+            Err(IpcError::TimedOut)
+        ));
+        // The call is still running, so the session can't be used, but others can.
+        assert!(matches!(
+            ipc_call(&list.inner()[0], run(Some(1))),
+            Err(IpcError::TimedOut)
+        ));
+        assert!(ipc_call_until(&list, 0, run(Some(2)), soon(), None).is_ok());
+
+        // Closing the session waits for the call to finish.
+        list.inner()[0].close_session(1).unwrap();
+        assert!(closed.try_recv().is_err());
+        release.send(()).unwrap();
+        assert_eq!(closed.recv_timeout(Duration::from_secs(5)), Ok(1));
+        let deadline = Instant::now() + Duration::from_secs(5);
+        while ipc_call(&list.inner()[0], Request::ResetState { session: Some(1) }).is_err() {
+            assert!(Instant::now() < deadline);
+            thread::sleep(Duration::from_millis(10));
         }
     }
-    EngineList(engines)
 }
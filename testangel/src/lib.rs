@@ -1,5 +1,12 @@
 pub mod action_loader;
+pub mod bundle;
+pub mod checkpoint;
+pub mod dataset;
+pub mod engine_host;
+pub mod execution_plan;
 pub mod ipc;
 pub mod report_generation;
+pub mod search;
+pub mod timing;
 pub mod types;
 pub mod version;
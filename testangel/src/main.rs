@@ -31,9 +31,12 @@ fn main() {
 
         log::info!("Using locale: {}", ui::lang::initialise_i18n());
 
-        if let Ok(rt) = runtime::Builder::new_current_thread().enable_all().build() {
-            let _is_latest = rt.block_on(version::check_is_latest());
-        }
+        // Check the version in the background, so it doesn't hold up opening the window.
+        std::thread::spawn(|| {
+            if let Ok(rt) = runtime::Builder::new_current_thread().enable_all().build() {
+                let _is_latest = rt.block_on(version::check_is_latest());
+            }
+        });
 
         ui::initialise_ui();
     }
@@ -0,0 +1,67 @@
+//! Self-contained HTML reports.
+
+use std::{
+    fs::File,
+    io::{BufWriter, Write},
+    path::Path,
+};
+
+use base64::Engine;
+use testangel_ipc::prelude::*;
+
+use super::ReportGenerationError;
+
+/// Escape text to be included in HTML.
+fn escape(text: &str) -> String {
+    let mut escaped = String::with_capacity(text.len());
+    for c in text.chars() {
+        match c {
+            '&' => escaped.push_str("&amp;"),
+            '<' => escaped.push_str("&lt;"),
+            '>' => escaped.push_str("&gt;"),
+            '"' => escaped.push_str("&quot;"),
+            '\'' => escaped.push_str("&#39;"),
+            c => escaped.push(c),
+        }
+    }
+    escaped
+}
+
+/// Write evidence to a single HTML file, an item at a time. Images are embedded as they are
+/// given, without being decoded.
+pub(super) fn write<I>(to: &Path, evidence: I) -> Result<(), ReportGenerationError>
+where
+    I: IntoIterator<Item = Result<Evidence, ReportGenerationError>>,
+{
+    let mut out = BufWriter::new(File::create(to)?);
+    write!(
+        out,
+        "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>TestAngel Evidence</title>\n\
+         <style>body {{ font-family: sans-serif; margin: 2em; }} h2 {{ font-size: 1em; margin-top: 1.5em; }} \
+         pre {{ white-space: pre-wrap; }} img {{ max-width: 100%; }}</style>\n</head>\n<body>\n\
+         <h1>Flow Evidence</h1>\n<p>Generated by TestAngel at {}</p>\n",
+        chrono::Local::now().format("%Y-%m-%d %H:%M")
+    )?;
+
+    for ev in evidence {
+        let ev = ev?;
+        writeln!(out, "<h2>{}</h2>", escape(&ev.label))?;
+        match ev.content {
+            EvidenceContent::Textual(text) => writeln!(out, "<pre>{}</pre>", escape(&text))?,
+            EvidenceContent::ImageAsPngBase64(base64) => writeln!(
+                out,
+                "<img src=\"data:image/png;base64,{}\">",
+                escape(&base64)
+            )?,
+            EvidenceContent::ImageAsPng(data) => writeln!(
+                out,
+                "<img src=\"data:image/png;base64,{}\">",
+                base64::engine::general_purpose::STANDARD.encode(data)
+            )?,
+        }
+    }
+
+    writeln!(out, "</body>\n</html>")?;
+    out.flush()?;
+    Ok(())
+}
@@ -0,0 +1,129 @@
+//! Evidence directories: the raw evidence files and a JSON-lines index describing them.
+
+use std::{
+    fs::{self, File},
+    io::{BufRead, BufReader, BufWriter, Lines, Write},
+    path::{Component, Path, PathBuf},
+};
+
+use base64::Engine;
+use serde::{Deserialize, Serialize};
+use testangel_ipc::prelude::*;
+
+use super::ReportGenerationError;
+
+/// The name of the index within an evidence directory.
+const INDEX: &str = "index.jsonl";
+
+/// A line of the index.
+#[derive(Serialize, Deserialize)]
+struct IndexEntry {
+    label: String,
+    #[serde(flatten)]
+    content: IndexContent,
+}
+
+#[derive(Serialize, Deserialize)]
+#[serde(tag = "kind", rename_all = "snake_case")]
+enum IndexContent {
+    Text {
+        text: String,
+    },
+    /// An image, stored as given in a file alongside the index.
+    Image {
+        file: String,
+    },
+}
+
+/// Write evidence to a directory, an item at a time. Text is kept in the index, and images are
+/// written to their own files without being re-encoded.
+pub(super) fn write<I>(to: &Path, evidence: I) -> Result<(), ReportGenerationError>
+where
+    I: IntoIterator<Item = Result<Evidence, ReportGenerationError>>,
+{
+    fs::create_dir_all(to)?;
+    let mut index = BufWriter::new(File::create(to.join(INDEX))?);
+    for (idx, ev) in evidence.into_iter().enumerate() {
+        let ev = ev?;
+        let content = match ev.content {
+            EvidenceContent::Textual(text) => IndexContent::Text { text },
+            EvidenceContent::ImageAsPngBase64(base64) => {
+                let data = base64::engine::general_purpose::STANDARD
+                    .decode(base64)
+                    .map_err(|_| ReportGenerationError::InvalidImageBase64Data)?;
+                write_image(to, idx, &data)?
+            }
+            EvidenceContent::ImageAsPng(data) => write_image(to, idx, &data)?,
+        };
+        let entry = IndexEntry {
+            label: ev.label,
+            content,
+        };
+        serde_json::to_writer(&mut index, &entry)
+            .map_err(|_| ReportGenerationError::InvalidEvidenceIndex)?;
+        index.write_all(b"\n")?;
+    }
+    index.flush()?;
+    Ok(())
+}
+
+/// Write an image to its own file, returning its index entry.
+fn write_image(to: &Path, idx: usize, data: &[u8]) -> Result<IndexContent, ReportGenerationError> {
+    let file = format!("{idx:05}.png");
+    fs::write(to.join(&file), data)?;
+    Ok(IndexContent::Image { file })
+}
+
+/// Reads evidence back from an evidence directory in order.
+pub struct EvidenceDirReader {
+    dir: PathBuf,
+    lines: Lines<BufReader<File>>,
+}
+
+impl EvidenceDirReader {
+    /// Open an evidence directory.
+    pub fn open<P: AsRef<Path>>(dir: P) -> Result<Self, ReportGenerationError> {
+        let dir = dir.as_ref().to_path_buf();
+        let lines = BufReader::new(File::open(dir.join(INDEX))?).lines();
+        Ok(Self { dir, lines })
+    }
+
+    /// Parse a line of the index into evidence, reading any file it refers to.
+    fn read_entry(&self, line: &str) -> Result<Evidence, ReportGenerationError> {
+        let entry: IndexEntry =
+            serde_json::from_str(line).map_err(|_| ReportGenerationError::InvalidEvidenceIndex)?;
+        let content = match entry.content {
+            IndexContent::Text { text } => EvidenceContent::Textual(text),
+            IndexContent::Image { file } => {
+                // Only read files directly within the evidence directory.
+                let mut components = Path::new(&file).components();
+                match (components.next(), components.next()) {
+                    (Some(Component::Normal(name)), None) => {
+                        EvidenceContent::ImageAsPng(fs::read(self.dir.join(name))?)
+                    }
+                    _ => return Err(ReportGenerationError::InvalidEvidenceIndex),
+                }
+            }
+        };
+        Ok(Evidence {
+            label: entry.label,
+            content,
+        })
+    }
+}
+
+impl Iterator for EvidenceDirReader {
+    type Item = Result<Evidence, ReportGenerationError>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        loop {
+            let line = match self.lines.next()? {
+                Ok(line) => line,
+                Err(e) => return Some(Err(e.into())),
+            };
+            if !line.trim().is_empty() {
+                return Some(self.read_entry(&line));
+            }
+        }
+    }
+}
@@ -1,13 +1,24 @@
-use std::fs;
-use std::io::{BufReader, BufWriter, Cursor};
+use std::fmt;
+use std::io::{BufReader, Cursor};
 use std::path::Path;
+use std::str::FromStr;
+use std::{env, panic, thread};
 
 use base64::Engine;
+use genpdf::fonts::{FontData, FontFamily};
 use genpdf::style::{Style, StyledString};
 use genpdf::{elements, Element};
+use image::codecs::png::{self, PngEncoder};
+use image::{ImageEncoder, RgbImage};
 use testangel_ipc::prelude::*;
 use thiserror::Error;
 
+mod html;
+mod jsonl;
+mod spool;
+pub use jsonl::EvidenceDirReader;
+pub use spool::{EvidenceSpool, SpoolReader, SpooledEvidence};
+
 #[derive(Error, Debug)]
 pub enum ReportGenerationError {
     #[error("Invalid image format: {0}")]
@@ -22,33 +33,138 @@ pub enum ReportGenerationError {
     Io(#[from] std::io::Error),
     #[error("Failed to generate PDF: {0}")]
     PdfGeneration(#[from] genpdf::error::Error),
+    #[error("The evidence spool is corrupt.")]
+    InvalidSpool,
+    #[error("The evidence index is invalid.")]
+    InvalidEvidenceIndex,
 }
 
-// TODO Remove so many assumptions
+/// The formats a report can be written in.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub enum ReportFormat {
+    /// A PDF document.
+    #[default]
+    Pdf,
+    /// A single HTML file with the images embedded.
+    Html,
+    /// A directory of the raw evidence files, with a JSON-lines index. This can be turned into
+    /// another format later.
+    JsonLines,
+}
+
+impl ReportFormat {
+    /// The extension given to reports in this format.
+    pub fn extension(&self) -> &'static str {
+        match self {
+            Self::Pdf => "pdf",
+            Self::Html => "html",
+            Self::JsonLines => "taevidence",
+        }
+    }
+}
+
+impl FromStr for ReportFormat {
+    type Err = String;
+
+    fn from_str(s: &str) -> Result<Self, Self::Err> {
+        match s.to_ascii_lowercase().as_str() {
+            "pdf" => Ok(Self::Pdf),
+            "html" => Ok(Self::Html),
+            "jsonl" => Ok(Self::JsonLines),
+            _ => Err(format!(
+                "unknown report format {s:?}, expected pdf, html or jsonl"
+            )),
+        }
+    }
+}
+
+impl fmt::Display for ReportFormat {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            Self::Pdf => write!(f, "pdf"),
+            Self::Html => write!(f, "html"),
+            Self::JsonLines => write!(f, "jsonl"),
+        }
+    }
+}
+
+/// The resolution genpdf lays out images at, unless told otherwise.
+const IMAGE_DPI: f64 = 300.0;
+
+/// The number of items of evidence read from the spool for each thread preparing them, before
+/// they are laid out.
+const BATCH_PER_THREAD: usize = 8;
+
+/// The highest resolution to include images at, from `TA_REPORT_MAX_DPI`. Images are shown at the
+/// same size either way, but larger images are downscaled to keep reports small.
+fn max_image_dpi() -> Option<f64> {
+    env::var("TA_REPORT_MAX_DPI")
+        .ok()
+        .and_then(|dpi| dpi.parse::<f64>().ok())
+        .filter(|dpi| *dpi > 0.0)
+}
+
+/// An item of evidence that is ready to be laid out.
+struct PreparedEvidence {
+    label: String,
+    content: PreparedContent,
+}
+
+enum PreparedContent {
+    Text(String),
+    /// An 8-bit RGB PNG, and the resolution to show it at if not the default.
+    Image {
+        data: Vec<u8>,
+        dpi: Option<f64>,
+    },
+}
+
+/// Render the evidence in a spool into a report. The evidence is read back from the spool one
+/// item at a time rather than all being loaded at once.
 pub fn save_report<P: AsRef<Path>>(
     to: P,
-    evidence: Vec<Evidence>,
+    format: ReportFormat,
+    evidence: &SpooledEvidence,
 ) -> Result<(), ReportGenerationError> {
-    fs::create_dir_all("./.tafonts")?;
-    fs::write(
-        "./.tafonts/LiberationSans-Bold.ttf",
-        include_bytes!("./fonts/LiberationSans-Bold.ttf"),
-    )?;
-    fs::write(
-        "./.tafonts/LiberationSans-BoldItalic.ttf",
-        include_bytes!("./fonts/LiberationSans-BoldItalic.ttf"),
-    )?;
-    fs::write(
-        "./.tafonts/LiberationSans-Italic.ttf",
-        include_bytes!("./fonts/LiberationSans-Italic.ttf"),
-    )?;
-    fs::write(
-        "./.tafonts/LiberationSans-Regular.ttf",
-        include_bytes!("./fonts/LiberationSans-Regular.ttf"),
-    )?;
-
-    let font_family = genpdf::fonts::from_files("./.tafonts", "LiberationSans", None)?;
-    let mut doc = genpdf::Document::new(font_family);
+    write_report(to, format, evidence.read()?)
+}
+
+/// Write evidence into a report, with the extension of the format. The HTML and JSON-lines
+/// formats are written out as each item is read.
+pub fn write_report<P, I>(
+    to: P,
+    format: ReportFormat,
+    evidence: I,
+) -> Result<(), ReportGenerationError>
+where
+    P: AsRef<Path>,
+    I: IntoIterator<Item = Result<Evidence, ReportGenerationError>>,
+{
+    let to = to.as_ref().with_extension(format.extension());
+    match format {
+        ReportFormat::Pdf => write_pdf(&to, evidence),
+        ReportFormat::Html => html::write(&to, evidence),
+        ReportFormat::JsonLines => jsonl::write(&to, evidence),
+    }
+}
+
+/// Load the embedded fonts.
+fn font_family() -> Result<FontFamily<FontData>, ReportGenerationError> {
+    let font = |data: &[u8]| FontData::new(data.to_vec(), None);
+    Ok(FontFamily {
+        regular: font(include_bytes!("./fonts/LiberationSans-Regular.ttf"))?,
+        bold: font(include_bytes!("./fonts/LiberationSans-Bold.ttf"))?,
+        italic: font(include_bytes!("./fonts/LiberationSans-Italic.ttf"))?,
+        bold_italic: font(include_bytes!("./fonts/LiberationSans-BoldItalic.ttf"))?,
+    })
+}
+
+// TODO Remove so many assumptions
+fn write_pdf<I>(to: &Path, evidence: I) -> Result<(), ReportGenerationError>
+where
+    I: IntoIterator<Item = Result<Evidence, ReportGenerationError>>,
+{
+    let mut doc = genpdf::Document::new(font_family()?);
     doc.set_title("TestAngel Evidence");
     let mut decorator = genpdf::SimplePageDecorator::new();
     decorator.set_margins(10);
@@ -71,36 +187,165 @@ pub fn save_report<P: AsRef<Path>>(
     });
     doc.set_page_decorator(decorator);
 
-    for ev in &evidence {
-        doc.push(elements::Paragraph::new(ev.label.clone()).padded((3, 0, 0, 0)));
-        match &ev.content {
-            EvidenceContent::Textual(text) => doc.push(elements::Paragraph::new(text)),
-            EvidenceContent::ImageAsPngBase64(base64) => {
-                let data = base64::engine::general_purpose::STANDARD
-                    .decode(base64)
-                    .map_err(|_| ReportGenerationError::InvalidImageBase64Data)?;
-
-                // Make sure it's encoded as expected, fixing #107
-                let img = image::io::Reader::new(BufReader::new(Cursor::new(data)))
-                    .with_guessed_format()
-                    .map_err(ReportGenerationError::InvalidImageFormat)?
-                    .decode()
-                    .map_err(ReportGenerationError::InvalidImageData)?
-                    .into_rgb8();
-                let mut data = vec![];
-                img.write_to(
-                    &mut BufWriter::new(Cursor::new(&mut data)),
-                    image::ImageOutputFormat::Png,
-                )
-                .map_err(ReportGenerationError::FailedToGenerateImage)?;
-
-                doc.push(elements::Image::from_reader(Cursor::new(data))?);
+    // Images are decoded and converted across all cores a batch at a time, and only the layout
+    // of each batch happens in order on this thread.
+    let threads = thread::available_parallelism()
+        .map(|n| n.get())
+        .unwrap_or(1);
+    let max_dpi = max_image_dpi();
+    let mut items = evidence.into_iter();
+    loop {
+        let batch = items
+            .by_ref()
+            .take(threads * BATCH_PER_THREAD)
+            .collect::<Result<Vec<_>, _>>()?;
+        if batch.is_empty() {
+            break;
+        }
+
+        for ev in prepare_all(batch, threads, max_dpi)? {
+            doc.push(elements::Paragraph::new(ev.label).padded((3, 0, 0, 0)));
+            match ev.content {
+                PreparedContent::Text(text) => doc.push(elements::Paragraph::new(text)),
+                PreparedContent::Image { data, dpi } => {
+                    let mut image = elements::Image::from_reader(Cursor::new(data))?;
+                    if let Some(dpi) = dpi {
+                        image.set_dpi(dpi);
+                    }
+                    doc.push(image);
+                }
             }
         }
     }
 
-    doc.render_to_file(to.as_ref().with_extension("pdf"))?;
-    fs::remove_dir_all("./.tafonts")?;
+    doc.render_to_file(to)?;
 
     Ok(())
 }
+
+/// Prepare a batch of evidence across up to `threads` threads, keeping it in order.
+fn prepare_all(
+    evidence: Vec<Evidence>,
+    threads: usize,
+    max_dpi: Option<f64>,
+) -> Result<Vec<PreparedEvidence>, ReportGenerationError> {
+    let chunk_size = evidence.len().div_ceil(threads.clamp(1, evidence.len()));
+    let mut evidence = evidence.into_iter().peekable();
+    let mut chunks = vec![];
+    while evidence.peek().is_some() {
+        chunks.push(evidence.by_ref().take(chunk_size).collect::<Vec<_>>());
+    }
+
+    thread::scope(|s| {
+        let handles: Vec<_> = chunks
+            .into_iter()
+            .map(|chunk| {
+                s.spawn(move || {
+                    chunk
+                        .into_iter()
+                        .map(|ev| prepare(ev, max_dpi))
+                        .collect::<Vec<_>>()
+                })
+            })
+            .collect();
+        handles
+            .into_iter()
+            .flat_map(|handle| handle.join().unwrap_or_else(|e| panic::resume_unwind(e)))
+            .collect()
+    })
+}
+
+/// Decode and convert an item of evidence ready to be laid out.
+fn prepare(ev: Evidence, max_dpi: Option<f64>) -> Result<PreparedEvidence, ReportGenerationError> {
+    let content = match ev.content {
+        EvidenceContent::Textual(text) => PreparedContent::Text(text),
+        EvidenceContent::ImageAsPngBase64(base64) => {
+            let data = base64::engine::general_purpose::STANDARD
+                .decode(base64)
+                .map_err(|_| ReportGenerationError::InvalidImageBase64Data)?;
+            prepare_image(data, max_dpi)?
+        }
+        EvidenceContent::ImageAsPng(data) => prepare_image(data, max_dpi)?,
+    };
+    Ok(PreparedEvidence {
+        label: ev.label,
+        content,
+    })
+}
+
+/// Make sure image data is encoded as an 8-bit RGB PNG, as expected by genpdf, fixing #107, and
+/// downscale it if it is above `max_dpi`. Data that needs neither is returned untouched.
+fn prepare_image(
+    data: Vec<u8>,
+    max_dpi: Option<f64>,
+) -> Result<PreparedContent, ReportGenerationError> {
+    let max_dpi = max_dpi.filter(|dpi| *dpi < IMAGE_DPI);
+    if max_dpi.is_none() && is_rgb8_png(&data) {
+        return Ok(PreparedContent::Image { data, dpi: None });
+    }
+
+    let mut img = image::io::Reader::new(BufReader::new(Cursor::new(data)))
+        .with_guessed_format()
+        .map_err(ReportGenerationError::InvalidImageFormat)?
+        .decode()
+        .map_err(ReportGenerationError::InvalidImageData)?
+        .into_rgb8();
+    if let Some(dpi) = max_dpi {
+        // Shown at the lower resolution, the downscaled image takes up the same space.
+        let scale = dpi / IMAGE_DPI;
+        let width = ((f64::from(img.width()) * scale).round() as u32).max(1);
+        let height = ((f64::from(img.height()) * scale).round() as u32).max(1);
+        img = image::imageops::resize(&img, width, height, image::imageops::FilterType::Triangle);
+    }
+    Ok(PreparedContent::Image {
+        data: encode_png(&img)?,
+        dpi: max_dpi,
+    })
+}
+
+/// Encode an image as a PNG, favouring speed over size as genpdf decodes it again to embed it in
+/// the PDF.
+fn encode_png(img: &RgbImage) -> Result<Vec<u8>, ReportGenerationError> {
+    let mut data = vec![];
+    PngEncoder::new_with_quality(&mut data, png::CompressionType::Fast, png::FilterType::Sub)
+        .write_image(
+            img.as_raw(),
+            img.width(),
+            img.height(),
+            image::ColorType::Rgb8,
+        )
+        .map_err(ReportGenerationError::FailedToGenerateImage)?;
+    Ok(data)
+}
+
+/// Check the PNG signature and IHDR chunk of some data to determine if it is an 8-bit RGB PNG
+/// without transparency.
+fn is_rgb8_png(data: &[u8]) -> bool {
+    const SIGNATURE: &[u8] = b"\x89PNG\r\n\x1a\n";
+    const BIT_DEPTH: usize = 24;
+    const COLOUR_TYPE: usize = 25;
+    const COLOUR_TYPE_RGB: u8 = 2;
+
+    data.len() > COLOUR_TYPE
+        && data.starts_with(SIGNATURE)
+        && &data[12..16] == b"IHDR"
+        && data[BIT_DEPTH] == 8
+        && data[COLOUR_TYPE] == COLOUR_TYPE_RGB
+        && !has_trns_chunk(data)
+}
+
+/// Check the chunks of a PNG before its image data for a tRNS chunk, which gives an RGB image a
+/// transparent colour. Returns true if the chunks can't be read.
+fn has_trns_chunk(data: &[u8]) -> bool {
+    let mut offset = 8;
+    while let Some(header) = data.get(offset..).and_then(|rest| rest.get(..8)) {
+        let length = u32::from_be_bytes([header[0], header[1], header[2], header[3]]) as usize;
+        match &header[4..8] {
+            b"tRNS" => return true,
+            // tRNS must come before the image data.
+            b"IDAT" => return false,
+            _ => offset = offset.saturating_add(length).saturating_add(12),
+        }
+    }
+    true
+}
@@ -0,0 +1,247 @@
+use std::{
+    env,
+    fs::{self, File, OpenOptions},
+    io::{self, BufReader, BufWriter, Read, Seek, SeekFrom, Write},
+    path::{Path, PathBuf},
+    sync::atomic::{AtomicUsize, Ordering},
+};
+
+use testangel_ipc::prelude::*;
+
+use super::ReportGenerationError;
+use crate::engine_host::{read_frame, write_frame};
+
+/// Evidence being written to disk as it is produced, so that it doesn't need to be held in
+/// memory and isn't lost if execution stops part way through.
+///
+/// Each item is stored as a length-prefixed MessagePack message, so images are kept as raw
+/// bytes.
+#[derive(Debug)]
+pub struct EvidenceSpool {
+    path: PathBuf,
+    writer: BufWriter<File>,
+    count: usize,
+    /// The length of the spool in bytes.
+    length: u64,
+    temporary: bool,
+}
+
+impl EvidenceSpool {
+    /// Create a spool at the given path, replacing any file already there.
+    pub fn create<P: AsRef<Path>>(path: P) -> io::Result<Self> {
+        let path = path.as_ref().to_path_buf();
+        let writer = BufWriter::new(File::create(&path)?);
+        Ok(Self {
+            path,
+            writer,
+            count: 0,
+            length: 0,
+            temporary: false,
+        })
+    }
+
+    /// Reopen a spool to continue writing to it, keeping the first `count` items of evidence,
+    /// which take up the first `length` bytes, and discarding anything after them.
+    pub fn resume<P: AsRef<Path>>(path: P, count: usize, length: u64) -> io::Result<Self> {
+        let path = path.as_ref().to_path_buf();
+        let mut file = OpenOptions::new().write(true).open(&path)?;
+        if file.metadata()?.len() < length {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidData,
+                "the spool is shorter than expected",
+            ));
+        }
+        file.set_len(length)?;
+        file.seek(SeekFrom::End(0))?;
+        Ok(Self {
+            path,
+            writer: BufWriter::new(file),
+            count,
+            length,
+            temporary: false,
+        })
+    }
+
+    /// Create a spool in the temporary directory, which is deleted when it is no longer needed.
+    pub fn temporary() -> io::Result<Self> {
+        static NEXT: AtomicUsize = AtomicUsize::new(0);
+        let name = format!(
+            "testangel-{}-{}.taspool",
+            std::process::id(),
+            NEXT.fetch_add(1, Ordering::Relaxed)
+        );
+        let mut spool = Self::create(env::temp_dir().join(name))?;
+        spool.temporary = true;
+        Ok(spool)
+    }
+
+    /// Append evidence to the spool.
+    pub fn append(&mut self, evidence: &Evidence) -> io::Result<()> {
+        let data = rmp_serde::to_vec_named(evidence)
+            .map_err(|e| io::Error::new(io::ErrorKind::InvalidData, e))?;
+        write_frame(&mut self.writer, &data)?;
+        self.count += 1;
+        // Each frame is a four byte length followed by the message.
+        self.length += 4 + data.len() as u64;
+        Ok(())
+    }
+
+    /// Append all of the evidence given to the spool, emptying it, and make sure it has reached
+    /// the disk.
+    pub fn append_all(&mut self, evidence: &mut Vec<Evidence>) -> io::Result<()> {
+        for ev in evidence.drain(..) {
+            self.append(&ev)?;
+        }
+        self.writer.flush()
+    }
+
+    /// The number of items of evidence in this spool.
+    pub fn len(&self) -> usize {
+        self.count
+    }
+
+    /// Returns true if no evidence has been spooled.
+    pub fn is_empty(&self) -> bool {
+        self.count == 0
+    }
+
+    /// The path of the spool file.
+    pub fn path(&self) -> &Path {
+        &self.path
+    }
+
+    /// The length of this spool in bytes, which with [`EvidenceSpool::len`] is what
+    /// [`EvidenceSpool::resume`] needs to continue writing to it later.
+    pub fn byte_len(&self) -> u64 {
+        self.length
+    }
+
+    /// Finish writing to this spool, so that it can be read.
+    pub fn finish(mut self) -> io::Result<SpooledEvidence> {
+        self.writer.flush()?;
+        // Stop this spool deleting the file now that it has been handed over.
+        let temporary = std::mem::replace(&mut self.temporary, false);
+        Ok(SpooledEvidence {
+            path: self.path.clone(),
+            count: self.count,
+            temporary,
+        })
+    }
+}
+
+impl Drop for EvidenceSpool {
+    fn drop(&mut self) {
+        if self.temporary {
+            let _ = fs::remove_file(&self.path);
+        }
+    }
+}
+
+/// Evidence that has finished being spooled to disk, ready to be rendered into a report.
+#[derive(Debug)]
+pub struct SpooledEvidence {
+    path: PathBuf,
+    count: usize,
+    temporary: bool,
+}
+
+impl SpooledEvidence {
+    /// Open a spool that was written previously.
+    pub fn open<P: AsRef<Path>>(path: P) -> io::Result<Self> {
+        let path = path.as_ref().to_path_buf();
+        let count = count_frames(&path)?;
+        Ok(Self {
+            path,
+            count,
+            temporary: false,
+        })
+    }
+
+    /// The path of the spool file.
+    pub fn path(&self) -> &Path {
+        &self.path
+    }
+
+    /// The number of items of evidence in this spool.
+    pub fn len(&self) -> usize {
+        self.count
+    }
+
+    /// Returns true if no evidence has been spooled.
+    pub fn is_empty(&self) -> bool {
+        self.count == 0
+    }
+
+    /// Read the evidence back, one item at a time.
+    pub fn read(&self) -> io::Result<SpoolReader> {
+        SpoolReader::new(&self.path)
+    }
+
+    /// Delete the spool file.
+    pub fn remove(mut self) -> io::Result<()> {
+        self.temporary = false;
+        fs::remove_file(&self.path)
+    }
+}
+
+impl Drop for SpooledEvidence {
+    fn drop(&mut self) {
+        if self.temporary {
+            let _ = fs::remove_file(&self.path);
+        }
+    }
+}
+
+/// Count the items in a spool by skipping over each using its length, without reading them. A
+/// final item that was only partly written isn't counted, as it can't be read back.
+fn count_frames(path: &Path) -> io::Result<usize> {
+    let file = File::open(path)?;
+    let end = file.metadata()?.len();
+    let mut reader = BufReader::new(file);
+    let mut position = 0;
+    let mut count = 0;
+    loop {
+        let mut len = [0u8; 4];
+        match reader.read_exact(&mut len) {
+            Ok(()) => (),
+            Err(e) if e.kind() == io::ErrorKind::UnexpectedEof => return Ok(count),
+            Err(e) => return Err(e),
+        }
+        let len = u32::from_le_bytes(len);
+        position += 4 + u64::from(len);
+        if position > end {
+            return Ok(count);
+        }
+        reader.seek_relative(i64::from(len))?;
+        count += 1;
+    }
+}
+
+/// Reads evidence back from a spool in the order it was written.
+pub struct SpoolReader {
+    reader: BufReader<File>,
+}
+
+impl SpoolReader {
+    fn new(path: &Path) -> io::Result<Self> {
+        Ok(Self {
+            reader: BufReader::new(File::open(path)?),
+        })
+    }
+}
+
+impl Iterator for SpoolReader {
+    type Item = Result<Evidence, ReportGenerationError>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        match read_frame(&mut self.reader) {
+            Ok(data) => {
+                Some(rmp_serde::from_slice(&data).map_err(|_| ReportGenerationError::InvalidSpool))
+            }
+            // Either the end of the spool, or a final item that was only partly written
+            // because execution stopped.
+            Err(e) if e.kind() == io::ErrorKind::UnexpectedEof => None,
+            Err(e) => Some(Err(e.into())),
+        }
+    }
+}
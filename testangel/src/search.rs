@@ -0,0 +1,355 @@
+//! A search index of the steps that can be added to a flow or action, so that searching them
+//! doesn't need every step to be compared with the query.
+//!
+//! Each step is indexed by the trigrams (runs of three characters) of its lowercased label,
+//! description and group. A query matches a step if each of its words appears in that text, so
+//! only the steps with every trigram of the query need to be checked. As a query is typed, the
+//! steps that matched the query before are narrowed down instead.
+
+use std::{
+    collections::HashMap,
+    sync::atomic::{AtomicUsize, Ordering},
+};
+
+/// Used to give each index an ID, so that results are only narrowed by the index that found them.
+static NEXT_INDEX_ID: AtomicUsize = AtomicUsize::new(0);
+
+/// A step that can be found by searching.
+#[derive(Clone, Debug)]
+pub struct SearchStep {
+    /// The label shown in the results.
+    pub label: String,
+    /// The ID of the action or instruction.
+    pub value: String,
+    pub description: String,
+    pub group: String,
+    /// If true, the step is only found when hidden steps are shown.
+    pub hidden: bool,
+}
+
+/// A searchable list of steps.
+#[derive(Debug)]
+pub struct SearchIndex {
+    id: usize,
+    /// The steps, sorted by label.
+    entries: Vec<SearchEntry>,
+    /// A lookup from trigram to the steps whose text contains it, in ascending order.
+    trigrams: HashMap<[char; 3], Vec<u32>>,
+}
+
+#[derive(Debug)]
+struct SearchEntry {
+    label: String,
+    value: String,
+    hidden: bool,
+    /// The label, lowercased.
+    label_text: String,
+    /// The label, description and group, lowercased.
+    text: String,
+}
+
+/// The steps that matched a query.
+#[derive(Debug)]
+pub struct SearchResults {
+    index_id: usize,
+    /// The query, lowercased.
+    query: String,
+    show_hidden: bool,
+    /// Every step that matched, in the order of the index.
+    matches: Vec<u32>,
+    /// The label and value of the best matches, best first.
+    top: Vec<(String, String)>,
+}
+
+impl SearchResults {
+    /// The label and value of the best matches, best first.
+    pub fn top(&self) -> &[(String, String)] {
+        &self.top
+    }
+
+    /// The number of steps that matched, including those not in [`SearchResults::top`].
+    pub fn len(&self) -> usize {
+        self.matches.len()
+    }
+
+    /// Returns true if no steps matched.
+    pub fn is_empty(&self) -> bool {
+        self.matches.is_empty()
+    }
+}
+
+impl SearchIndex {
+    /// Build an index of steps.
+    pub fn new<I: IntoIterator<Item = SearchStep>>(steps: I) -> Self {
+        let mut entries: Vec<SearchEntry> = steps
+            .into_iter()
+            .map(|step| {
+                let label_text = step.label.to_lowercase();
+                let text = format!(
+                    "{label_text}\n{}\n{}",
+                    step.description.to_lowercase(),
+                    step.group.to_lowercase()
+                );
+                SearchEntry {
+                    label: step.label,
+                    value: step.value,
+                    hidden: step.hidden,
+                    label_text,
+                    text,
+                }
+            })
+            .collect();
+        entries.sort_by(|a, b| a.label.cmp(&b.label));
+
+        let mut trigrams: HashMap<[char; 3], Vec<u32>> = HashMap::new();
+        for (idx, entry) in entries.iter().enumerate() {
+            let chars: Vec<char> = entry.text.chars().collect();
+            for trigram in chars.windows(3) {
+                let postings = trigrams
+                    .entry([trigram[0], trigram[1], trigram[2]])
+                    .or_default();
+                // Entries are visited in order, so this only needs checking against the last.
+                if postings.last() != Some(&(idx as u32)) {
+                    postings.push(idx as u32);
+                }
+            }
+        }
+
+        Self {
+            id: NEXT_INDEX_ID.fetch_add(1, Ordering::Relaxed),
+            entries,
+            trigrams,
+        }
+    }
+
+    /// The number of steps in this index.
+    pub fn len(&self) -> usize {
+        self.entries.len()
+    }
+
+    /// Returns true if this index has no steps.
+    pub fn is_empty(&self) -> bool {
+        self.entries.is_empty()
+    }
+
+    /// Search for steps matching a query, returning at most `limit` of the best matches. An empty
+    /// query matches every step, and all of them are returned in order of label. If `previous`
+    /// are the results of an earlier query that this one extends, only the steps that matched it
+    /// are checked.
+    pub fn search(
+        &self,
+        query: &str,
+        show_hidden: bool,
+        previous: Option<&SearchResults>,
+        limit: usize,
+    ) -> SearchResults {
+        let query = query.to_lowercase();
+        let words: Vec<&str> = query.split_whitespace().collect();
+
+        let matches: Vec<u32> = match previous {
+            Some(previous)
+                if previous.index_id == self.id
+                    && previous.show_hidden == show_hidden
+                    && query.starts_with(&previous.query) =>
+            {
+                previous
+                    .matches
+                    .iter()
+                    .copied()
+                    .filter(|idx| self.is_match(*idx, &words, show_hidden))
+                    .collect()
+            }
+            _ => match self.candidates(&words) {
+                Some(candidates) => candidates
+                    .into_iter()
+                    .filter(|idx| self.is_match(*idx, &words, show_hidden))
+                    .collect(),
+                None => (0..self.entries.len() as u32)
+                    .filter(|idx| self.is_match(*idx, &words, show_hidden))
+                    .collect(),
+            },
+        };
+
+        let top = if words.is_empty() {
+            matches.clone()
+        } else {
+            // Rank the matches, keeping the order of the index between those ranked the same.
+            let mut ranked: Vec<(u8, u32)> = matches
+                .iter()
+                .map(|idx| (self.rank(*idx, &query, &words), *idx))
+                .collect();
+            if ranked.len() > limit {
+                ranked.select_nth_unstable(limit);
+                ranked.truncate(limit);
+            }
+            ranked.sort_unstable();
+            ranked.into_iter().map(|(_, idx)| idx).collect()
+        };
+        let top = top
+            .into_iter()
+            .map(|idx| {
+                let entry = &self.entries[idx as usize];
+                (entry.label.clone(), entry.value.clone())
+            })
+            .collect();
+
+        SearchResults {
+            index_id: self.id,
+            query,
+            show_hidden,
+            matches,
+            top,
+        }
+    }
+
+    /// The steps that have every trigram of the words of a query, or `None` if the words are too
+    /// short to have any trigrams.
+    fn candidates(&self, words: &[&str]) -> Option<Vec<u32>> {
+        let mut postings = vec![];
+        for word in words {
+            let chars: Vec<char> = word.chars().collect();
+            for trigram in chars.windows(3) {
+                match self.trigrams.get(&[trigram[0], trigram[1], trigram[2]]) {
+                    Some(list) => postings.push(list),
+                    None => return Some(vec![]),
+                }
+            }
+        }
+
+        // Intersect the lists, shortest first, so the candidates are narrowed quickest.
+        postings.sort_by_key(|list| list.len());
+        let (first, rest) = postings.split_first()?;
+        let mut candidates = first.to_vec();
+        for list in rest {
+            candidates.retain(|idx| list.binary_search(idx).is_ok());
+            if candidates.is_empty() {
+                break;
+            }
+        }
+        Some(candidates)
+    }
+
+    /// Returns true if every word of a query appears in the text of a step.
+    fn is_match(&self, idx: u32, words: &[&str], show_hidden: bool) -> bool {
+        let entry = &self.entries[idx as usize];
+        (show_hidden || !entry.hidden) && words.iter().all(|word| entry.text.contains(word))
+    }
+
+    /// Rank a matching step, lowest best: steps whose label starts with the query, then whose
+    /// label has the query at the start of a word, then has each word of the query at the start
+    /// of a word, then has each word anywhere, then any others.
+    fn rank(&self, idx: u32, query: &str, words: &[&str]) -> u8 {
+        let label = &self.entries[idx as usize].label_text;
+        let query = query.trim();
+        if label.starts_with(query) {
+            0
+        } else if starts_word(label, query) {
+            1
+        } else if words.iter().all(|word| starts_word(label, word)) {
+            2
+        } else if words.iter().all(|word| label.contains(word)) {
+            3
+        } else {
+            4
+        }
+    }
+}
+
+/// Returns true if `needle` appears in `text` at the start of a word.
+fn starts_word(text: &str, needle: &str) -> bool {
+    text.match_indices(needle)
+        .any(|(at, _)| !text[..at].ends_with(char::is_alphanumeric))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn index(labels: &[&str]) -> SearchIndex {
+        SearchIndex::new(labels.iter().map(|label| SearchStep {
+            label: label.to_string(),
+            value: label.to_lowercase(),
+            description: String::new(),
+            group: String::new(),
+            hidden: false,
+        }))
+    }
+
+    fn labels(results: &SearchResults) -> Vec<&str> {
+        results
+            .top()
+            .iter()
+            .map(|(label, _)| label.as_str())
+            .collect()
+    }
+
+    #[test]
+    fn empty_query_returns_every_step_in_order() {
+        let names: Vec<String> = (0..100).map(|n| format!("Step {n:03}")).collect();
+        let index = index(&names.iter().map(String::as_str).collect::<Vec<_>>());
+        let results = index.search("", false, None, 10);
+        assert_eq!(results.len(), 100);
+        assert_eq!(results.top().len(), 100);
+        assert_eq!(results.top()[0].0, "Step 000");
+        assert_eq!(results.top()[99].0, "Step 099");
+    }
+
+    #[test]
+    fn short_queries_check_every_step() {
+        let index = index(&["Add", "Divide", "Subtract"]);
+        assert_eq!(
+            labels(&index.search("d", false, None, 10)),
+            ["Divide", "Add"]
+        );
+        assert_eq!(labels(&index.search("ub", false, None, 10)), ["Subtract"]);
+    }
+
+    #[test]
+    fn queries_without_trigram_hits_match_nothing() {
+        let index = index(&["Add", "Divide", "Subtract"]);
+        let results = index.search("xyz", false, None, 10);
+        assert!(results.is_empty());
+        assert!(results.top().is_empty());
+        // A query with one known and one unknown trigram
+        assert!(index.search("adz", false, None, 10).is_empty());
+    }
+
+    #[test]
+    fn ties_keep_the_order_of_labels() {
+        let index = index(&["Log Out", "Log In", "Misc: Log", "Catalogue"]);
+        assert_eq!(
+            labels(&index.search("log", false, None, 10)),
+            ["Log In", "Log Out", "Misc: Log", "Catalogue"]
+        );
+        // The limit is applied after ranking
+        assert_eq!(
+            labels(&index.search("log", false, None, 2)),
+            ["Log In", "Log Out"]
+        );
+    }
+
+    #[test]
+    fn narrowing_matches_searching_afresh() {
+        let index = index(&["Add", "Add All", "Divide"]);
+        let first = index.search("ad", false, None, 10);
+        let narrowed = index.search("add a", false, Some(&first), 10);
+        assert_eq!(labels(&narrowed), ["Add All", "Add"]);
+        assert_eq!(
+            labels(&narrowed),
+            labels(&index.search("add a", false, None, 10))
+        );
+    }
+
+    #[test]
+    fn hidden_steps_are_only_found_when_shown() {
+        let index = SearchIndex::new([SearchStep {
+            label: String::from("Secret"),
+            value: String::from("secret"),
+            description: String::new(),
+            group: String::new(),
+            hidden: true,
+        }]);
+        assert!(index.search("sec", false, None, 10).is_empty());
+        assert_eq!(index.search("sec", true, None, 10).len(), 1);
+    }
+}
@@ -0,0 +1,225 @@
+//! Timing of flow execution, to show where the time is spent.
+//!
+//! Nothing is recorded until [`enable`] is called, and until then a span costs only a check of
+//! a flag, so tags are never formatted. Recorded spans can be written as a Chrome trace, which
+//! can be opened with `chrome://tracing` or Perfetto, or summarised for a report.
+
+use std::{
+    cell::Cell,
+    collections::HashMap,
+    fmt,
+    io::{self, Write},
+    sync::{
+        atomic::{AtomicBool, AtomicU64, Ordering},
+        Mutex, OnceLock,
+    },
+    time::{Duration, Instant},
+};
+
+use serde::Serialize;
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+static SPANS: Mutex<Vec<SpanRecord>> = Mutex::new(Vec::new());
+static EPOCH: OnceLock<Instant> = OnceLock::new();
+static NEXT_THREAD: AtomicU64 = AtomicU64::new(1);
+
+thread_local! {
+    /// The step being executed on this thread, which spans are tagged with.
+    static CURRENT_STEP: Cell<Option<usize>> = const { Cell::new(None) };
+    static THREAD: u64 = NEXT_THREAD.fetch_add(1, Ordering::Relaxed);
+}
+
+/// Start recording spans.
+pub fn enable() {
+    EPOCH.get_or_init(Instant::now);
+    ENABLED.store(true, Ordering::Relaxed);
+}
+
+/// Returns true if spans are being recorded.
+pub fn is_enabled() -> bool {
+    ENABLED.load(Ordering::Relaxed)
+}
+
+/// A span that has finished.
+#[derive(Clone, Debug)]
+pub struct SpanRecord {
+    pub name: &'static str,
+    pub engine: Option<String>,
+    pub instruction: Option<String>,
+    pub step: Option<usize>,
+    /// When this span started, since timing was enabled.
+    pub start: Duration,
+    pub duration: Duration,
+    thread: u64,
+}
+
+/// Start timing a span, which ends when it is dropped.
+pub fn span(name: &'static str) -> Span {
+    if !is_enabled() {
+        return Span(None);
+    }
+    Span(Some(ActiveSpan {
+        record: SpanRecord {
+            name,
+            engine: None,
+            instruction: None,
+            step: CURRENT_STEP.with(Cell::get),
+            start: Duration::ZERO,
+            duration: Duration::ZERO,
+            thread: THREAD.with(|t| *t),
+        },
+        started: Instant::now(),
+        previous_step: None,
+    }))
+}
+
+/// A span being timed.
+#[must_use]
+pub struct Span(Option<ActiveSpan>);
+
+struct ActiveSpan {
+    record: SpanRecord,
+    started: Instant,
+    /// If this span set the current step, the step to restore when it ends.
+    previous_step: Option<Option<usize>>,
+}
+
+impl Span {
+    /// Tag this span with an engine.
+    pub fn engine<D: fmt::Display>(mut self, engine: D) -> Self {
+        if let Some(active) = &mut self.0 {
+            active.record.engine = Some(engine.to_string());
+        }
+        self
+    }
+
+    /// Tag this span with the instructions it covers. This is only called if spans are being
+    /// recorded.
+    pub fn instruction<F: FnOnce() -> String>(mut self, instruction: F) -> Self {
+        if let Some(active) = &mut self.0 {
+            active.record.instruction = Some(instruction());
+        }
+        self
+    }
+
+    /// Tag this span with a step, and any spans started on this thread until it ends.
+    pub fn step(mut self, step: usize) -> Self {
+        if let Some(active) = &mut self.0 {
+            active.record.step = Some(step);
+            active.previous_step = Some(CURRENT_STEP.with(|s| s.replace(Some(step))));
+        }
+        self
+    }
+}
+
+impl Drop for Span {
+    fn drop(&mut self) {
+        let Some(mut active) = self.0.take() else {
+            return;
+        };
+        if let Some(previous) = active.previous_step {
+            CURRENT_STEP.with(|s| s.set(previous));
+        }
+        let epoch = *EPOCH.get_or_init(Instant::now);
+        active.record.start = active.started.saturating_duration_since(epoch);
+        active.record.duration = active.started.elapsed();
+        if let Ok(mut spans) = SPANS.lock() {
+            spans.push(active.record);
+        }
+    }
+}
+
+/// Get a copy of every span recorded so far.
+pub fn recorded() -> Vec<SpanRecord> {
+    SPANS.lock().map(|spans| spans.clone()).unwrap_or_default()
+}
+
+/// Take every span recorded so far.
+pub fn take() -> Vec<SpanRecord> {
+    SPANS
+        .lock()
+        .map(|mut spans| std::mem::take(&mut *spans))
+        .unwrap_or_default()
+}
+
+#[derive(Serialize)]
+struct TraceEvent<'a> {
+    name: &'static str,
+    cat: &'static str,
+    ph: &'static str,
+    ts: u128,
+    dur: u128,
+    pid: u32,
+    tid: u64,
+    args: TraceArgs<'a>,
+}
+
+#[derive(Serialize)]
+struct TraceArgs<'a> {
+    #[serde(skip_serializing_if = "Option::is_none")]
+    engine: Option<&'a str>,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    instruction: Option<&'a str>,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    step: Option<usize>,
+}
+
+/// Write spans in the Chrome trace event format.
+pub fn write_chrome_trace<W: Write>(writer: W, spans: &[SpanRecord]) -> io::Result<()> {
+    #[derive(Serialize)]
+    struct Trace<'a> {
+        #[serde(rename = "traceEvents")]
+        trace_events: Vec<TraceEvent<'a>>,
+    }
+
+    let trace = Trace {
+        trace_events: spans
+            .iter()
+            .map(|span| TraceEvent {
+                name: span.name,
+                cat: "testangel",
+                ph: "X",
+                ts: span.start.as_micros(),
+                dur: span.duration.as_micros(),
+                pid: std::process::id(),
+                tid: span.thread,
+                args: TraceArgs {
+                    engine: span.engine.as_deref(),
+                    instruction: span.instruction.as_deref(),
+                    // Steps are shown numbered from 1, as they are everywhere else.
+                    step: span.step.map(|s| s + 1),
+                },
+            })
+            .collect(),
+    };
+    serde_json::to_writer(writer, &trace).map_err(io::Error::from)
+}
+
+/// Summarise spans by name and engine, with the number of spans and their total and mean
+/// duration, longest first.
+pub fn summary(spans: &[SpanRecord]) -> String {
+    let mut totals: HashMap<(&str, Option<&str>), (usize, Duration)> = HashMap::new();
+    for span in spans {
+        let total = totals
+            .entry((span.name, span.engine.as_deref()))
+            .or_default();
+        total.0 += 1;
+        total.1 += span.duration;
+    }
+    let mut totals: Vec<_> = totals.into_iter().collect();
+    totals.sort_by(|a, b| b.1 .1.cmp(&a.1 .1));
+
+    let mut summary = String::new();
+    for ((name, engine), (count, total)) in totals {
+        let name = match engine {
+            Some(engine) => format!("{name} ({engine})"),
+            None => name.to_string(),
+        };
+        summary.push_str(&format!(
+            "{name}: {count} in {:.3} ms (mean {:.3} ms)\n",
+            total.as_secs_f64() * 1000.0,
+            total.as_secs_f64() * 1000.0 / count as f64,
+        ));
+    }
+    summary
+}
@@ -1,11 +1,11 @@
-use std::{collections::HashMap, fmt, sync::Arc};
+use std::{collections::HashMap, fmt};
 
 use serde::{Deserialize, Serialize};
 use testangel_ipc::prelude::*;
 
 use crate::{
-    action_loader::ActionMap,
-    ipc::{self, EngineList, IpcError},
+    execution_plan::{CompileError, CompiledAction, Memo},
+    ipc::{EngineSession, IpcError},
 };
 
 #[derive(Debug, Copy, Clone, Serialize, Deserialize)]
@@ -83,65 +83,20 @@ pub struct InstructionConfiguration {
     pub parameter_values: HashMap<String, ParameterValue>,
 }
 impl InstructionConfiguration {
-    pub fn execute(
-        &self,
-        engine_map: Arc<EngineList>,
-        action_parameters: &HashMap<usize, ParameterValue>,
-        previous_outputs: Vec<HashMap<String, ParameterValue>>,
-    ) -> Result<(HashMap<String, ParameterValue>, Vec<Evidence>), FlowError> {
-        // Get instruction
-        let engine = engine_map
-            .get_engine_by_instruction_id(&self.instruction_id)
-            .unwrap();
-
-        // Build input parameters
-        let mut parameters = HashMap::new();
-        for (id, src) in &self.parameter_sources {
-            let value = match src {
-                InstructionParameterSource::Literal => {
-                    self.parameter_values.get(id).unwrap().clone()
-                }
-                InstructionParameterSource::FromOutput(step, id) => previous_outputs
-                    .get(*step)
-                    .unwrap()
-                    .get(id)
-                    .unwrap()
-                    .clone(),
-                InstructionParameterSource::FromParameter(id) => {
-                    action_parameters.get(id).unwrap().clone()
-                }
-            };
-            parameters.insert(id.clone(), value);
-        }
-
-        // Make IPC call
-        let response = ipc::ipc_call(
-            engine,
-            Request::RunInstructions {
-                instructions: vec![InstructionWithParameters {
-                    instruction: self.instruction_id.clone(),
-                    parameters,
-                }],
-            },
-        )
-        .map_err(FlowError::IPCFailure)?;
-
-        // Generate output table and return
-        match response {
-            Response::ExecutionOutput { output, evidence } => {
-                Ok((output[0].clone(), evidence[0].clone()))
-            }
-            Response::Error { kind, reason } => Err(FlowError::FromInstruction {
-                error_kind: kind,
-                reason,
-            }),
-            _ => unreachable!(),
-        }
+    /// Check if this instruction's `run_if` or any of its parameters depend on the output of
+    /// a step at or after `first_step`.
+    pub(crate) fn depends_on_steps_from(&self, first_step: usize) -> bool {
+        std::iter::once(&self.run_if)
+            .chain(self.parameter_sources.values())
+            .any(|src| match src {
+                InstructionParameterSource::FromOutput(step, _) => *step >= first_step,
+                _ => false,
+            })
     }
 }
 
-impl From<Instruction> for InstructionConfiguration {
-    fn from(value: Instruction) -> Self {
+impl From<&Instruction> for InstructionConfiguration {
+    fn from(value: &Instruction) -> Self {
         let mut parameter_sources = HashMap::new();
         let mut parameter_values = HashMap::new();
         for (id, (_friendly_name, kind)) in value.parameters() {
@@ -187,12 +142,19 @@ pub enum FlowError {
         reason: String,
     },
     IPCFailure(IpcError),
+    Compile(CompileError),
 }
 
 impl fmt::Display for FlowError {
     fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
         match self {
+            Self::IPCFailure(IpcError::TimedOut) => write!(
+                f,
+                "An instruction didn't finish within the time allowed (TA_INSTRUCTION_TIMEOUT)."
+            ),
+            Self::IPCFailure(IpcError::Cancelled) => write!(f, "An instruction was cancelled."),
             Self::IPCFailure(e) => write!(f, "An IPC call failed ({e:?})."),
+            Self::Compile(e) => write!(f, "The flow couldn't be prepared: {e}"),
             Self::FromInstruction { error_kind, reason } => write!(
                 f,
                 "An instruction returned an error: {error_kind:?}: {reason}"
@@ -205,6 +167,17 @@ impl fmt::Display for FlowError {
 pub struct AutomationFlow {
     /// The version of this automation flow file
     version: usize,
+    /// The parameters this flow takes, with a friendly name. These are given values from a
+    /// dataset when the flow is data-driven, and have their default values otherwise.
+    #[serde(default)]
+    pub parameters: Vec<(String, ParameterKind)>,
+    /// The most steps of this flow to execute at once, each in its own engine session. Steps
+    /// are only executed at the same time if neither uses the outputs of the other. A step is
+    /// executed in the session of the latest step it uses the outputs of, so it sees the engine
+    /// state that step left, but not necessarily that of other steps. If this is 0 or 1, steps
+    /// are executed one at a time.
+    #[serde(default)]
+    pub parallel_steps: usize,
     /// The actions called by this flow
     pub actions: Vec<ActionConfiguration>,
 }
@@ -213,6 +186,8 @@ impl Default for AutomationFlow {
     fn default() -> Self {
         Self {
             version: 1,
+            parameters: vec![],
+            parallel_steps: 0,
             actions: vec![],
         }
     }
@@ -230,107 +205,52 @@ pub struct ActionConfiguration {
     pub action_id: String,
     pub parameter_sources: HashMap<usize, ActionParameterSource>,
     pub parameter_values: HashMap<usize, ParameterValue>,
+    /// If the flow executes steps in parallel, this step waits for every earlier step to finish,
+    /// and is then executed in every engine session, so every later step sees the engine state
+    /// it leaves. This is for steps that set up state later steps rely on.
+    #[serde(default)]
+    pub barrier: bool,
 }
 impl ActionConfiguration {
-    /// Execute this action
-    pub fn execute(
-        &self,
-        action_map: Arc<ActionMap>,
-        engine_map: Arc<EngineList>,
-        previous_action_outputs: Vec<HashMap<usize, ParameterValue>>,
-    ) -> Result<(HashMap<usize, ParameterValue>, Vec<Evidence>), FlowError> {
-        // Find action by ID
-        let action = action_map.get_action_by_id(&self.action_id).unwrap();
-        // Build action parameters
-        let mut action_parameters = HashMap::new();
-        for (id, src) in &self.parameter_sources {
-            let value = match src {
-                ActionParameterSource::Literal => self.parameter_values.get(id).unwrap().clone(),
-                ActionParameterSource::FromOutput(step, id) => previous_action_outputs
-                    .get(*step)
-                    .unwrap()
-                    .get(id)
-                    .unwrap()
-                    .clone(),
-            };
-            action_parameters.insert(*id, value);
-        }
-        Self::execute_directly(engine_map, &action, action_parameters).map_err(|(_step, err)| err)
-    }
-
-    #[allow(clippy::type_complexity)]
-    /// Directly execute an action with a set of parameters.
+    /// Directly execute a compiled action with a set of parameters within a session. Parameters
+    /// that aren't given have their default values. The evidence produced is appended to
+    /// `evidence` as each instruction completes, so it is kept even if a later instruction
+    /// fails.
     pub fn execute_directly(
-        engine_map: Arc<EngineList>,
-        action: &Action,
+        session: &EngineSession,
+        action: &CompiledAction,
         action_parameters: HashMap<usize, ParameterValue>,
-    ) -> Result<(HashMap<usize, ParameterValue>, Vec<Evidence>), (usize, FlowError)> {
-        // Iterate through instructions
-        let mut instruction_outputs: Vec<HashMap<String, ParameterValue>> = Vec::new();
-        let mut evidence = Vec::new();
-        for (step, instruction_config) in action.instructions.iter().enumerate() {
-            // Check if we execute instruction
-            if !match &instruction_config.run_if {
-                InstructionParameterSource::Literal => true,
-                InstructionParameterSource::FromParameter(p_idx) => {
-                    action_parameters.get(p_idx).unwrap().value_bool()
-                }
-                InstructionParameterSource::FromOutput(step, output_name) => instruction_outputs
-                    .get(*step)
-                    .unwrap()
-                    .get(output_name)
-                    .unwrap()
-                    .value_bool(),
-            } {
-                log::debug!("Instruction skipped");
-                instruction_outputs.push(HashMap::new());
-                continue;
-            }
-
-            // Execute instruction
-            let (outputs, ev) = instruction_config
-                .execute(
-                    engine_map.clone(),
-                    &action_parameters,
-                    instruction_outputs.clone(),
-                )
-                .map_err(|err| (step, err))?;
-            instruction_outputs.push(outputs);
-            evidence = [evidence, ev].concat();
-        }
-
-        // Generate output map
-        let mut output = HashMap::new();
-        for (index, (_friendly_name, kind, src)) in action.outputs.iter().enumerate() {
-            let value = match src {
-                InstructionParameterSource::Literal => panic!("Output set to literal."),
-                InstructionParameterSource::FromOutput(step, id) => instruction_outputs
-                    .get(*step)
-                    .unwrap()
-                    .get(id)
-                    .unwrap_or(&kind.default_value())
-                    .clone(),
-                InstructionParameterSource::FromParameter(id) => {
-                    action_parameters.get(id).unwrap().clone()
-                }
-            };
-            output.insert(index, value);
-        }
-
-        Ok((output, evidence))
+        evidence: &mut Vec<Evidence>,
+    ) -> Result<HashMap<usize, ParameterValue>, (usize, FlowError)> {
+        let parameters = action
+            .parameter_kinds()
+            .iter()
+            .enumerate()
+            .map(|(idx, kind)| {
+                action_parameters
+                    .get(&idx)
+                    .cloned()
+                    .unwrap_or_else(|| kind.default_value())
+            })
+            .collect();
+        let outputs = action.execute(session, &Memo::default(), parameters, evidence)?;
+        Ok(outputs.into_iter().enumerate().collect())
     }
 
     /// Update this action configuration to match the inputs and outputs of the provided action.
     /// This will panic if the action's ID doesn't match the ID of this configuration already set.
     /// Return true if this configuration has changed.
-    pub fn update(&mut self, action: Action) -> bool {
+    pub fn update(&mut self, action: &Action) -> bool {
         if self.action_id != action.id {
             panic!("ActionConfiguration tried to be updated with a different action!");
         }
 
         // If number of parameters has changed
         if self.parameter_sources.len() != action.parameters.len() {
-            *self = Self::from(action);
+            *self = Self {
+                barrier: self.barrier,
+                ..Self::from(action)
+            };
             return true;
         }
 
@@ -338,7 +258,10 @@ impl ActionConfiguration {
             let (_, action_param_kind) = &action.parameters[*n];
             if value.kind() != *action_param_kind {
                 // Reset parameters
-                *self = Self::from(action);
+                *self = Self {
+                    barrier: self.barrier,
+                    ..Self::from(action)
+                };
                 return true;
             }
         }
@@ -347,8 +270,8 @@ impl ActionConfiguration {
     }
 }
 
-impl From<Action> for ActionConfiguration {
-    fn from(value: Action) -> Self {
+impl From<&Action> for ActionConfiguration {
+    fn from(value: &Action) -> Self {
         let mut parameter_sources = HashMap::new();
         let mut parameter_values = HashMap::new();
         for (id, (_friendly_name, kind)) in value.parameters.iter().enumerate() {
@@ -359,6 +282,7 @@ impl From<Action> for ActionConfiguration {
             action_id: value.id.clone(),
             parameter_sources,
             parameter_values,
+            barrier: false,
         }
     }
 }
@@ -368,6 +292,7 @@ pub enum ActionParameterSource {
     #[default]
     Literal,
     FromOutput(usize, usize),
+    FromFlowParameter(usize),
 }
 
 impl fmt::Display for ActionParameterSource {
@@ -376,6 +301,9 @@ impl fmt::Display for ActionParameterSource {
             Self::FromOutput(step, id) => {
                 write!(f, "From Step {}: Output {}", step + 1, id + 1)
             }
+            Self::FromFlowParameter(id) => {
+                write!(f, "Flow Parameter {}", id + 1)
+            }
             Self::Literal => write!(f, "Literal"),
         }
     }
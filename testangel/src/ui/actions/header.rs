@@ -7,7 +7,9 @@ use relm4::{
 use testangel::{action_loader::ActionMap, ipc::EngineList};
 
 use crate::ui::{
-    components::add_step_factory::{AddStepInit, AddStepResult, AddStepTrait},
+    components::add_step_factory::{
+        AddStepInit, AddStepResult, AddStepTrait, StepSearch, StepSearchOutput, SEARCH_RESULT_LIMIT,
+    },
     lang,
 };
 
@@ -18,6 +20,9 @@ pub struct ActionsHeader {
     add_button: gtk::MenuButton,
     action_open: bool,
     search_results: FactoryVecDeque<AddStepResult<ActionsHeaderInput>>,
+    search: StepSearch,
+    /// If true, add the top result once the search in progress has finished.
+    add_top_when_shown: bool,
 }
 
 #[derive(Debug)]
@@ -33,6 +38,7 @@ pub enum ActionsHeaderOutput {
 #[derive(Debug)]
 pub enum ActionsHeaderInput {
     ActionsMapChanged(Arc<ActionMap>),
+    EngineListChanged(Arc<EngineList>),
     /// Add the step with the instruction ID given
     AddStep(String),
     /// Trigger a search for the steps provided
@@ -56,7 +62,7 @@ impl Component for ActionsHeader {
     type Init = (Arc<EngineList>, Arc<ActionMap>);
     type Input = ActionsHeaderInput;
     type Output = ActionsHeaderOutput;
-    type CommandOutput = ();
+    type CommandOutput = StepSearchOutput;
 
     view! {
         #[root]
@@ -117,6 +123,8 @@ impl Component for ActionsHeader {
             action_open: false,
             add_button: gtk::MenuButton::default(),
             search_results: FactoryVecDeque::new(gtk::Box::default(), sender.input_sender()),
+            search: StepSearch::default(),
+            add_top_when_shown: false,
         };
         // Reset search results
         sender.input(ActionsHeaderInput::SearchForSteps(String::new()));
@@ -145,6 +153,11 @@ impl Component for ActionsHeader {
             ActionsHeaderInput::ActionsMapChanged(new_map) => {
                 self.action_map = new_map;
             }
+            ActionsHeaderInput::EngineListChanged(new_list) => {
+                self.engine_list = new_list;
+                self.search.reset();
+                sender.input(ActionsHeaderInput::SearchForSteps(String::new()));
+            }
             ActionsHeaderInput::AddStep(step_id) => {
                 // close popover
                 self.add_button.popdown();
@@ -154,7 +167,10 @@ impl Component for ActionsHeader {
                     .unwrap();
             }
             ActionsHeaderInput::AddTopSearchResult => {
-                if let Some(result) = self.search_results.get(0) {
+                if self.search.is_pending() {
+                    // Wait for the results of the query being searched for
+                    self.add_top_when_shown = true;
+                } else if let Some(result) = self.search_results.get(0) {
                     widgets.menu_popover.popdown();
                     let id = result.value();
                     // unwrap rationale: the receiver will never be disconnected
@@ -162,65 +178,48 @@ impl Component for ActionsHeader {
                 }
             }
             ActionsHeaderInput::SearchForSteps(query) => {
-                let mut results = self.search_results.guard();
-                results.clear();
-
-                // Reset scroll
-                let adj = widgets.menu_scrolled_area.vadjustment();
-                adj.set_value(adj.lower());
-
-                // Collect results
-                if query.is_empty() {
-                    // List all alphabetically
-                    let mut unsorted_results = vec![];
-                    for engine in self.engine_list.inner() {
-                        for instruction in &engine.instructions {
-                            unsorted_results.push((
-                                format!("{}: {}", engine.name, instruction.friendly_name()),
-                                engine.name.clone(),
-                                instruction.clone(),
-                            ));
-                        }
-                    }
-
-                    // Sort
-                    unsorted_results.sort_by(|(a, _, _), (b, _, _)| a.cmp(b));
-                    for (_, engine_name, ins) in unsorted_results {
-                        results.push_back(AddStepInit {
-                            label: format!("{engine_name}: {}", ins.friendly_name()),
-                            value: ins.id().clone(),
-                        });
-                    }
-                } else {
-                    let mut unsorted_results = vec![];
-                    use fuzzy_matcher::{skim::SkimMatcherV2, FuzzyMatcher};
-                    let matcher = SkimMatcherV2::default();
-                    for engine in self.engine_list.inner() {
-                        for instruction in &engine.instructions {
-                            if let Some(score) = matcher.fuzzy_match(
-                                &format!("{}: {}", engine.name, instruction.friendly_name()),
-                                &query,
-                            ) {
-                                unsorted_results.push((
-                                    score,
-                                    engine.name.clone(),
-                                    instruction.clone(),
-                                ));
-                            }
-                        }
-                    }
-
-                    // Sort
-                    unsorted_results.sort_by(|(a, _, _), (b, _, _)| a.cmp(b));
-                    for (_, engine_name, ins) in unsorted_results {
-                        results.push_back(AddStepInit {
-                            label: format!("{engine_name}: {}", ins.friendly_name()),
-                            value: ins.id().clone(),
-                        });
-                    }
-                }
+                let engine_list = self.engine_list.clone();
+
+                self.search.start(&sender, query, move |query, previous| {
+                    engine_list
+                        .search_index()
+                        .search(query, false, previous, SEARCH_RESULT_LIMIT)
+                });
             }
         }
         self.update_view(widgets, sender);
     }
+
+    fn update_cmd_with_view(
+        &mut self,
+        widgets: &mut Self::Widgets,
+        output: Self::CommandOutput,
+        sender: ComponentSender<Self>,
+        _root: &Self::Root,
+    ) {
+        let Some(found) = self.search.finish(output) else {
+            return;
+        };
+
+        let mut results = self.search_results.guard();
+        results.clear();
+
+        // Reset scroll
+        let adj = widgets.menu_scrolled_area.vadjustment();
+        adj.set_value(adj.lower());
+
+        for (label, value) in found.top() {
+            results.push_back(AddStepInit {
+                label: label.clone(),
+                value: value.clone(),
+            });
+        }
+        drop(results);
+
+        if self.add_top_when_shown {
+            self.add_top_when_shown = false;
+            sender.input(ActionsHeaderInput::AddTopSearchResult);
+        }
+        self.update_view(widgets, sender);
+    }
 }
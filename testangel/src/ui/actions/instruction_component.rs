@@ -1,4 +1,4 @@
-use std::{collections::HashMap, ffi};
+use std::{cell::Cell, collections::HashMap, ffi, rc::Rc};
 
 use adw::prelude::*;
 use relm4::{
@@ -23,11 +23,14 @@ pub struct InstructionComponentInitialiser {
     pub possible_outputs: Vec<(String, ParameterKind, InstructionParameterSource)>,
     pub config: InstructionConfiguration,
     pub instruction: Instruction,
+    /// The step of the first component in the list, which the index of this one is from.
+    pub first_step: Rc<Cell<usize>>,
 }
 
 #[derive(Debug)]
 pub struct InstructionComponent {
     step: DynamicIndex,
+    first_step: Rc<Cell<usize>>,
     config: InstructionConfiguration,
     instruction: Instruction,
     visible: bool,
@@ -110,7 +113,7 @@ impl FactoryComponent for InstructionComponent {
                     "action-step-label",
                     {
                         let mut map = HashMap::new();
-                        map.insert("step", (self.step.current_index() + 1).into());
+                        map.insert("step", (self.first_step.get() + self.step.current_index() + 1).into());
                         map.insert("name", self.instruction.friendly_name().clone().into());
                         map
                     }
@@ -163,10 +166,11 @@ impl FactoryComponent for InstructionComponent {
                         set_valign: gtk::Align::Start,
                         set_height_request: 30,
 
-                        connect_clicked[sender, index, config] => move |_| {
-                            if index.clone().current_index() != 0 {
+                        connect_clicked[sender, index, config, first_step] => move |_| {
+                            let step = first_step.get() + index.current_index();
+                            if step != 0 {
                                 sender.output(InstructionComponentOutput::Cut(index.clone()));
-                                sender.output(InstructionComponentOutput::Paste((index.clone().current_index() - 1).max(0), config.clone()));
+                                sender.output(InstructionComponentOutput::Paste(step - 1, config.clone()));
                             }
                         },
                     },
@@ -176,9 +180,10 @@ impl FactoryComponent for InstructionComponent {
                         set_valign: gtk::Align::Start,
                         set_height_request: 30,
 
-                        connect_clicked[sender, index, config] => move |_| {
+                        connect_clicked[sender, index, config, first_step] => move |_| {
+                            let step = first_step.get() + index.current_index();
                             sender.output(InstructionComponentOutput::Cut(index.clone()));
-                            sender.output(InstructionComponentOutput::Paste(index.clone().current_index() + 1, config.clone()));
+                            sender.output(InstructionComponentOutput::Paste(step + 1, config.clone()));
                         },
                     },
                     gtk::Button::builder().css_classes(["flat"]).build() {
@@ -282,6 +287,7 @@ impl FactoryComponent for InstructionComponent {
             possible_outputs,
             instruction,
             config,
+            first_step,
         } = init;
 
         let possible_run_conditions = [
@@ -325,6 +331,7 @@ impl FactoryComponent for InstructionComponent {
 
         Self {
             step: index.clone(),
+            first_step,
             possible_outputs,
             possible_run_conditions,
             run_condition_index,
@@ -348,6 +355,7 @@ impl FactoryComponent for InstructionComponent {
         sender: relm4::FactorySender<Self>,
     ) -> Self::Widgets {
         let config = self.config.clone();
+        let first_step = self.first_step.clone();
 
         {
             // initialise rows
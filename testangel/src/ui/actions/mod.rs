@@ -12,7 +12,7 @@ use testangel::{
 };
 use testangel_ipc::prelude::ParameterKind;
 
-use super::{file_filters, lang};
+use super::{components::step_window::StepWindow, file_filters, lang, STEP_RENDER_BATCH};
 
 pub mod header;
 mod instruction_component;
@@ -71,6 +71,8 @@ pub enum ActionInputs {
     NoOp,
     /// The map of actions has changed and should be updated
     ActionsMapChanged(Arc<ActionMap>),
+    /// The list of engines has changed and should be updated
+    EngineListChanged(Arc<EngineList>),
     /// Create a new action
     NewAction,
     /// Actually create the new action
@@ -97,6 +99,11 @@ pub enum ActionInputs {
     AddStep(String),
     /// Update the UI steps from the open action. This will clear first and overwrite any changes!
     UpdateStepsFromModel,
+    /// Create the widgets of more steps, as the list of steps has been scrolled to the end.
+    RenderMoreSteps,
+    /// Create the widgets of earlier steps again, as the list of steps has been scrolled up past
+    /// the first step with widgets.
+    RenderEarlierSteps,
     /// Remove the step with the provided index, resetting all references to it.
     RemoveStep(DynamicIndex),
     /// Remove the step with the provided index, but change references to it to a temporary value (`usize::MAX`)
@@ -145,6 +152,11 @@ pub struct ActionsModel {
     parameters: Controller<params::ActionParams>,
     outputs: Controller<outputs::ActionOutputs>,
     live_instructions_list: FactoryVecDeque<instruction_component::InstructionComponent>,
+    /// The steps to create widgets for. Only some of the steps of a large action are rendered,
+    /// depending on where the list is scrolled to.
+    window: StepWindow,
+    /// The first step whose widgets no longer match the open action, if any.
+    first_changed_step: Option<usize>,
 }
 
 impl ActionsModel {
@@ -186,6 +198,7 @@ impl ActionsModel {
         self.open_path = None;
         self.needs_saving = true;
         self.open_action = Some(Action::default());
+        self.window.reset();
         self.header
             .emit(header::ActionsHeaderInput::ChangeActionOpen(
                 self.open_action.is_some(),
@@ -229,6 +242,7 @@ impl ActionsModel {
         }
 
         self.open_action = Some(action.clone());
+        self.window.reset();
         self.header
             .emit(header::ActionsHeaderInput::ChangeActionOpen(
                 self.open_action.is_some(),
@@ -248,6 +262,108 @@ impl ActionsModel {
         Ok(())
     }
 
+    /// Mark the widgets of a step, and every step after it, as needing to be rebuilt.
+    fn steps_changed_from(&mut self, step: usize) {
+        self.first_changed_step = Some(self.first_changed_step.map_or(step, |s| s.min(step)));
+    }
+
+    /// Create widgets for the steps up to `end`, dropping the widgets of the steps at the start
+    /// of the window if there are too many.
+    fn extend_window(&mut self, end: usize) {
+        let rendered = self.live_instructions_list.len();
+        let dropped = self
+            .window
+            .extend(self.live_instructions_list.widget(), rendered, end);
+        let mut live_list = self.live_instructions_list.guard();
+        for _ in 0..dropped {
+            live_list.pop_front();
+        }
+    }
+
+    /// Bring the widgets of the steps up to date with the open action. Widgets are rebuilt from
+    /// the first step that has changed, and created for steps up to the end of the window. The
+    /// widgets of earlier steps are left alone.
+    fn render_steps(&mut self) {
+        let mut live_list = self.live_instructions_list.guard();
+        let Some(action) = &self.open_action else {
+            live_list.clear();
+            return;
+        };
+
+        let mut changed = self.first_changed_step.take();
+        if self.window.clamp(action.instructions.len()) {
+            changed = Some(0);
+        }
+        // Widgets are only kept from the start of the window, so rebuild them from there if an
+        // earlier step has changed.
+        let start = self.window.start();
+        let first = changed
+            .unwrap_or(usize::MAX)
+            .max(start)
+            .min(start + live_list.len());
+        while start + live_list.len() > first {
+            live_list.pop_back();
+        }
+        let target = self.window.end(action.instructions.len());
+        if first >= target && changed.is_none() {
+            return;
+        }
+
+        let mut possible_outputs = vec![];
+        // Populate possible outputs with parameters
+        for (idx, (name, kind)) in action.parameters.iter().enumerate() {
+            possible_outputs.push((
+                lang::lookup_with_args("source-from-param", {
+                    let mut map = HashMap::new();
+                    map.insert("param", name.clone().into());
+                    map
+                }),
+                *kind,
+                InstructionParameterSource::FromParameter(idx),
+            ));
+        }
+
+        for (step, config) in action.instructions.iter().enumerate() {
+            // The outputs of every step are only needed if the steps have changed.
+            if step >= target && changed.is_none() {
+                break;
+            }
+            // rationale: we have already checked the instructions are here when the file is opened
+            let instruction = self
+                .engine_list
+                .get_instruction_by_id(&config.instruction_id)
+                .unwrap();
+            if step >= first && step < target {
+                live_list.push_back(instruction_component::InstructionComponentInitialiser {
+                    possible_outputs: possible_outputs.clone(),
+                    config: config.clone(),
+                    instruction: instruction.clone(),
+                    first_step: self.window.shared_start(),
+                });
+            }
+            // add possible outputs to list AFTER processing this step
+            for (output_id, (name, kind)) in instruction.outputs().iter() {
+                possible_outputs.push((
+                    lang::lookup_with_args("source-from-step", {
+                        let mut map = HashMap::new();
+                        map.insert("step", (step + 1).into());
+                        map.insert("name", name.clone().into());
+                        map
+                    }),
+                    *kind,
+                    InstructionParameterSource::FromOutput(step, output_id.clone()),
+                ));
+            }
+        }
+
+        if changed.is_some() {
+            self.outputs
+                .emit(outputs::ActionOutputsInput::SetPossibleSources(
+                    possible_outputs,
+                ));
+        }
+    }
+
     /// Ask the user if they want to save this file. If they response yes, this will also trigger the save function.
     /// This function will only ask the user if needed, otherwise it will emit immediately.
     fn prompt_to_save(&self, sender: &relm4::Sender<ActionInputs>, then: ActionInputs) {
@@ -333,6 +449,8 @@ impl ActionsModel {
         self.open_path = None;
         self.needs_saving = false;
         self.live_instructions_list.guard().clear();
+        self.first_changed_step = None;
+        self.window.reset();
         self.header
             .emit(header::ActionsHeaderInput::ChangeActionOpen(
                 self.open_action.is_some(),
@@ -350,10 +468,17 @@ impl Component for ActionsModel {
     view! {
         #[root]
         toast_target = adw::ToastOverlay {
+            #[name = "scroller"]
             gtk::ScrolledWindow {
                 set_vexpand: true,
                 set_hscrollbar_policy: gtk::PolicyType::Never,
 
+                connect_edge_reached[sender] => move |_, pos| {
+                    if pos == gtk::PositionType::Bottom {
+                        sender.input(ActionInputs::RenderMoreSteps);
+                    }
+                },
+
                 if model.open_action.is_none() {
                     adw::StatusPage {
                         set_title: &lang::lookup("nothing-open"),
@@ -379,6 +504,9 @@ impl Component for ActionsModel {
                             set_orientation: gtk::Orientation::Horizontal,
                         },
 
+                        #[local_ref]
+                        spacer -> gtk::Box {},
+
                         #[local_ref]
                         live_instructions_list -> gtk::Box {
                             set_orientation: gtk::Orientation::Vertical,
@@ -425,6 +553,8 @@ impl Component for ActionsModel {
                 gtk::Box::default(),
                 sender.input_sender(),
             ),
+            window: StepWindow::default(),
+            first_changed_step: None,
             metadata: metadata_component::Metadata::builder()
                 .launch(())
                 .forward(sender.input_sender(), |msg| {
@@ -464,8 +594,16 @@ impl Component for ActionsModel {
         sender.input(ActionInputs::UpdateStepsFromModel);
 
         let live_instructions_list = model.live_instructions_list.widget();
+        let spacer = model.window.spacer();
         let widgets = view_output!();
 
+        let sender_c = sender.clone();
+        model
+            .window
+            .connect_scrolled_up(&widgets.scroller, move || {
+                sender_c.input(ActionInputs::RenderEarlierSteps);
+            });
+
         ComponentParts { model, widgets }
     }
 
@@ -502,14 +640,14 @@ impl Component for ActionsModel {
 
             ActionInputs::SetComment(step, new_comment) => {
                 if let Some(action) = self.open_action.as_mut() {
-                    action.instructions[step.current_index()].comment = new_comment;
+                    action.instructions[self.window.step(&step)].comment = new_comment;
                     self.needs_saving = true;
                 }
             }
 
             ActionInputs::ChangeRunCondition(step, new_condition) => {
                 if let Some(action) = self.open_action.as_mut() {
-                    action.instructions[step.current_index()].run_if = new_condition;
+                    action.instructions[self.window.step(&step)].run_if = new_condition;
                     self.needs_saving = true;
                 }
             }
@@ -584,11 +722,16 @@ impl Component for ActionsModel {
                 self.header
                     .emit(header::ActionsHeaderInput::ActionsMapChanged(new_map));
             }
+            ActionInputs::EngineListChanged(new_list) => {
+                self.engine_list = new_list.clone();
+                self.header
+                    .emit(header::ActionsHeaderInput::EngineListChanged(new_list));
+            }
             ActionInputs::ConfigUpdate(step, new_config) => {
                 // unwrap rationale: config updates can't happen if nothing is open
                 if let Some(action) = self.open_action.as_mut() {
                     self.needs_saving = true;
-                    action.instructions[step.current_index()] = new_config;
+                    action.instructions[self.window.step(&step)] = new_config;
                 }
             }
             ActionInputs::NewAction => {
@@ -704,71 +847,42 @@ impl Component for ActionsModel {
                 action.instructions.push(InstructionConfiguration::from(
                     self.engine_list.get_instruction_by_id(&step_id).unwrap(),
                 ));
+                let step = action.instructions.len() - 1;
+                // Show the new step if every step before it is shown
+                if self.window.start() + self.live_instructions_list.len() == step {
+                    self.extend_window(step + 1);
+                }
                 self.needs_saving = true;
-                // Trigger UI steps refresh
-                sender.input(ActionInputs::UpdateStepsFromModel);
+                self.steps_changed_from(step);
+                self.render_steps();
             }
 
             ActionInputs::UpdateStepsFromModel => {
-                let mut live_list = self.live_instructions_list.guard();
-                live_list.clear();
-                if let Some(action) = &self.open_action {
-                    let mut possible_outputs = vec![];
-                    // Populate possible outputs with parameters
-                    for (idx, (name, kind)) in action.parameters.iter().enumerate() {
-                        possible_outputs.push((
-                            lang::lookup_with_args("source-from-param", {
-                                let mut map = HashMap::new();
-                                map.insert("param", name.clone().into());
-                                map
-                            }),
-                            *kind,
-                            InstructionParameterSource::FromParameter(idx),
-                        ));
-                    }
+                self.steps_changed_from(0);
+                self.render_steps();
+            }
 
-                    for (step, config) in action.instructions.iter().enumerate() {
-                        live_list.push_back(
-                            instruction_component::InstructionComponentInitialiser {
-                                possible_outputs: possible_outputs.clone(),
-                                config: config.clone(),
-                                instruction: self
-                                    .engine_list
-                                    .get_instruction_by_id(&config.instruction_id)
-                                    .unwrap(), // rationale: we have already checked the actions are here when the file is opened
-                            },
-                        );
-                        // add possible outputs to list AFTER processing this step
-                        // unwrap rationale: actions are check to exist prior to opening.
-                        for (output_id, (name, kind)) in self
-                            .engine_list
-                            .get_instruction_by_id(&config.instruction_id)
-                            .unwrap()
-                            .outputs()
-                            .iter()
-                        {
-                            possible_outputs.push((
-                                lang::lookup_with_args("source-from-step", {
-                                    let mut map = HashMap::new();
-                                    map.insert("step", (step + 1).into());
-                                    map.insert("name", name.clone().into());
-                                    map
-                                }),
-                                *kind,
-                                InstructionParameterSource::FromOutput(step, output_id.clone()),
-                            ));
-                        }
-                    }
+            ActionInputs::RenderMoreSteps => {
+                let rendered = self.window.start() + self.live_instructions_list.len();
+                if self
+                    .open_action
+                    .as_ref()
+                    .is_some_and(|action| rendered < action.instructions.len())
+                {
+                    self.extend_window(rendered + STEP_RENDER_BATCH);
+                    self.render_steps();
+                }
+            }
 
-                    self.outputs
-                        .emit(outputs::ActionOutputsInput::SetPossibleSources(
-                            possible_outputs,
-                        ));
+            ActionInputs::RenderEarlierSteps => {
+                if self.window.move_back() {
+                    self.steps_changed_from(self.window.start());
+                    self.render_steps();
                 }
             }
 
             ActionInputs::RemoveStep(step_idx) => {
-                let idx = step_idx.current_index();
+                let idx = self.window.step(&step_idx);
                 let action = self.open_action.as_mut().unwrap();
 
                 // This is needed as sometimes, if a menu item lines up above the delete step button,
@@ -813,11 +927,12 @@ impl Component for ActionsModel {
 
                 self.needs_saving = true;
 
-                // Trigger UI steps refresh
-                sender.input(ActionInputs::UpdateStepsFromModel);
+                // Refresh the UI of the steps that have moved
+                self.steps_changed_from(idx);
+                self.render_steps();
             }
             ActionInputs::CutStep(step_idx) => {
-                let idx = step_idx.current_index();
+                let idx = self.window.step(&step_idx);
                 let action = self.open_action.as_mut().unwrap();
                 log::info!("Cut step {}", idx + 1);
 
@@ -856,6 +971,8 @@ impl Component for ActionsModel {
                         }
                     }
                 }
+
+                self.steps_changed_from(idx);
             }
             ActionInputs::PasteStep(idx, config) => {
                 let action = self.open_action.as_mut().unwrap();
@@ -900,14 +1017,15 @@ impl Component for ActionsModel {
 
                 self.needs_saving = true;
 
-                // Trigger UI steps refresh
-                sender.input(ActionInputs::UpdateStepsFromModel);
+                // Refresh the UI of the steps that have moved
+                self.steps_changed_from(idx);
+                self.render_steps();
             }
             ActionInputs::MoveStep(from, to, offset) => {
-                let current_from = from.current_index();
+                let current_from = self.window.step(&from);
                 let step = self.open_action.as_ref().unwrap().instructions[current_from].clone();
                 sender.input(ActionInputs::CutStep(from));
-                let mut to = (to.current_index() as isize + offset).max(0) as usize;
+                let mut to = (self.window.step(&to) as isize + offset).max(0) as usize;
                 if to > current_from && to > 0 {
                     to -= 1;
                 }
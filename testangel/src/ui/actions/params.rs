@@ -174,6 +174,14 @@ static PARAM_KINDS: once_cell::sync::Lazy<Vec<(String, ParameterKind)>> =
             (lang::lookup("kind-integer"), ParameterKind::Integer),
             (lang::lookup("kind-decimal"), ParameterKind::Decimal),
             (lang::lookup("kind-boolean"), ParameterKind::Boolean),
+            (
+                lang::lookup("kind-integer-list"),
+                ParameterKind::IntegerList,
+            ),
+            (
+                lang::lookup("kind-decimal-list"),
+                ParameterKind::DecimalList,
+            ),
         ]
     });
 
@@ -1,9 +1,89 @@
 use std::fmt::Debug;
 use std::marker::PhantomData;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::thread;
+use std::time::Duration;
 
 use gtk::prelude::*;
 use relm4::gtk;
 use relm4::prelude::*;
+use testangel::search::SearchResults;
+
+/// The most results shown when searching for a step to add.
+pub const SEARCH_RESULT_LIMIT: usize = 50;
+/// How long to wait after the search query changes before searching, so that searches aren't
+/// started for each key pressed while typing.
+pub const SEARCH_DEBOUNCE: Duration = Duration::from_millis(100);
+
+/// The output of a search started by [`StepSearch::start`]: the generation of the search and its
+/// results.
+pub type StepSearchOutput = (usize, SearchResults);
+
+/// The searches for a step to add. Searches run in the background after the debounce, and only
+/// the results of the latest search are kept.
+#[derive(Debug, Default)]
+pub struct StepSearch {
+    /// Incremented for each search, so that the results of earlier searches are discarded.
+    generation: Arc<AtomicUsize>,
+    /// The generation of the search whose results are shown.
+    shown_generation: usize,
+    /// The results shown, which the next search narrows if it extends the same query.
+    last: Option<Arc<SearchResults>>,
+}
+
+impl StepSearch {
+    /// Start a search as a command of a component. An empty query is searched straight away,
+    /// otherwise the search waits for [`SEARCH_DEBOUNCE`] and is skipped if another search has
+    /// been started since. `search` is given the query and the results it can be narrowed from.
+    pub fn start<C, F>(&self, sender: &ComponentSender<C>, query: String, search: F)
+    where
+        C: Component<CommandOutput = StepSearchOutput>,
+        F: FnOnce(&str, Option<&SearchResults>) -> SearchResults + Send + 'static,
+    {
+        let generation = self.generation.fetch_add(1, Ordering::Relaxed) + 1;
+        let latest_generation = self.generation.clone();
+        let previous = self.last.clone();
+
+        sender.spawn_command(move |out| {
+            // Wait in case the query is still being typed, so only the last is searched
+            if !query.is_empty() {
+                thread::sleep(SEARCH_DEBOUNCE);
+            }
+            if latest_generation.load(Ordering::Relaxed) != generation {
+                return;
+            }
+            let results = search(&query, previous.as_deref());
+            let _ = out.send((generation, results));
+        });
+    }
+
+    /// Receive the results of a search, returning them to be shown if they are from the latest
+    /// search.
+    pub fn finish(
+        &mut self,
+        (generation, results): StepSearchOutput,
+    ) -> Option<Arc<SearchResults>> {
+        if generation != self.generation.load(Ordering::Relaxed) {
+            return None;
+        }
+        self.shown_generation = generation;
+        let results = Arc::new(results);
+        self.last = Some(results.clone());
+        Some(results)
+    }
+
+    /// Returns true if a search has been started whose results aren't shown yet.
+    pub fn is_pending(&self) -> bool {
+        self.shown_generation != self.generation.load(Ordering::Relaxed)
+    }
+
+    /// Forget the results shown, so the next search isn't narrowed from them. This is needed
+    /// when the steps being searched change.
+    pub fn reset(&mut self) {
+        self.last = None;
+    }
+}
 
 pub trait AddStepTrait {
     fn add_step(value: String) -> Self;
@@ -22,6 +22,7 @@ pub enum LiteralInputWidgets {
     Integer { entry: gtk::SpinButton },
     Decimal { entry: gtk::SpinButton },
     Boolean { entry: gtk::CheckButton },
+    List { entry: gtk::Entry },
 }
 
 impl SimpleComponent for LiteralInput {
@@ -120,6 +121,28 @@ impl SimpleComponent for LiteralInput {
                 root.set_child(Some(&entry));
                 LiteralInputWidgets::Boolean { entry }
             }
+            ParameterValue::IntegerList(_) | ParameterValue::DecimalList(_) => {
+                let entry = gtk::Entry::builder()
+                    .text(init.to_string())
+                    .placeholder_text(lang::lookup("value-list"))
+                    .build();
+                let kind = init.kind();
+                let sender_c = sender.clone();
+                entry.connect_changed(move |etry| {
+                    // Only pass on the list once every value in it is valid.
+                    match ParameterValue::parse_list(kind, &etry.text()) {
+                        Some(value) => {
+                            etry.remove_css_class("error");
+                            let _ = sender_c
+                                .clone()
+                                .output(LiteralInputOutput::ValueChanged(value));
+                        }
+                        None => etry.add_css_class("error"),
+                    }
+                });
+                root.set_child(Some(&entry));
+                LiteralInputWidgets::List { entry }
+            }
         };
 
         relm4::ComponentParts { model, widgets }
@@ -2,5 +2,7 @@
 pub mod add_step_factory;
 /// A reusable input component.
 pub mod literal_input;
+/// The window of steps whose widgets are kept while a long list is scrolled.
+pub mod step_window;
 /// A reusable row for input variables
 pub mod variable_row;
@@ -0,0 +1,151 @@
+use std::{cell::Cell, rc::Rc};
+
+use gtk::prelude::*;
+use relm4::{gtk, prelude::DynamicIndex};
+
+use crate::ui::{STEP_RENDER_BATCH, STEP_RENDER_WINDOW};
+
+/// The steps of a flow or action that have widgets, from [`StepWindow::start`] up to
+/// [`StepWindow::end`]. The widgets of the steps before the window are dropped, and replaced by a
+/// spacer as tall as they were, so that the list doesn't move when they are.
+#[derive(Debug)]
+pub struct StepWindow {
+    /// The first step with widgets. This is shared with the widgets of the steps, so they can
+    /// tell which step they are from their index in the list.
+    start: Rc<Cell<usize>>,
+    /// The step to create widgets up to, if there are that many.
+    end: usize,
+    /// Stands in for the widgets of the steps before the window.
+    spacer: gtk::Box,
+    /// The height the widgets of each step before the window were when they were dropped.
+    dropped_heights: Vec<i32>,
+}
+
+impl Default for StepWindow {
+    fn default() -> Self {
+        Self {
+            start: Rc::default(),
+            end: STEP_RENDER_BATCH,
+            spacer: gtk::Box::default(),
+            dropped_heights: vec![],
+        }
+    }
+}
+
+impl StepWindow {
+    /// The first step with widgets.
+    pub fn start(&self) -> usize {
+        self.start.get()
+    }
+
+    /// The first step with widgets, shared so that it can be read by the widgets of the steps.
+    pub fn shared_start(&self) -> Rc<Cell<usize>> {
+        self.start.clone()
+    }
+
+    /// The step to create widgets up to for a list of `len` steps.
+    pub fn end(&self, len: usize) -> usize {
+        self.end.min(len).min(self.start() + STEP_RENDER_WINDOW)
+    }
+
+    /// The spacer to put above the widgets of the steps.
+    pub fn spacer(&self) -> &gtk::Box {
+        &self.spacer
+    }
+
+    /// Get the step of the widgets at an index of the list.
+    pub fn step(&self, index: &DynamicIndex) -> usize {
+        self.start() + index.current_index()
+    }
+
+    /// Go back to creating widgets for the first batch of steps.
+    pub fn reset(&mut self) {
+        self.start.set(0);
+        self.end = STEP_RENDER_BATCH;
+        self.dropped_heights.clear();
+        self.update_spacer();
+    }
+
+    /// Create widgets up to `end`, where `container` holds the `rendered` widgets in the window.
+    /// If that makes the window too large, the widgets at the start of the window are dropped.
+    /// Returns how many of them to remove from the list.
+    pub fn extend(&mut self, container: &gtk::Box, rendered: usize, end: usize) -> usize {
+        self.end = self.end.max(end);
+        let dropped = self
+            .end
+            .saturating_sub(self.start())
+            .saturating_sub(STEP_RENDER_WINDOW)
+            .min(rendered);
+        let mut row = container.first_child();
+        for _ in 0..dropped {
+            let height = row.as_ref().map_or(0, |row| {
+                row.height() + row.margin_top() + row.margin_bottom() + container.spacing()
+            });
+            self.dropped_heights.push(height);
+            row = row.and_then(|row| row.next_sibling());
+        }
+        self.start.set(self.start() + dropped);
+        self.update_spacer();
+        dropped
+    }
+
+    /// Move the window back a batch of steps, after the list has been scrolled up to the spacer.
+    /// The widgets of the new window then need creating from its start. Returns false if the
+    /// window already starts at the first step.
+    pub fn move_back(&mut self) -> bool {
+        if self.start() == 0 {
+            return false;
+        }
+        let start = self.start().saturating_sub(STEP_RENDER_BATCH);
+        self.move_to(start);
+        true
+    }
+
+    /// Make sure the window starts within a list of `len` steps, moving it back to the last batch
+    /// of steps if not. Returns true if it was moved, so the widgets of the window need creating
+    /// from its start.
+    pub fn clamp(&mut self, len: usize) -> bool {
+        if self.start() == 0 || self.start() < len {
+            return false;
+        }
+        self.move_to(len.saturating_sub(STEP_RENDER_BATCH));
+        true
+    }
+
+    /// Call `scrolled_up` whenever `scroller` is scrolled up far enough to show the spacer.
+    pub fn connect_scrolled_up<F: Fn() + 'static>(
+        &self,
+        scroller: &gtk::ScrolledWindow,
+        scrolled_up: F,
+    ) {
+        let spacer = self.spacer.downgrade();
+        let scroller_weak = scroller.downgrade();
+        scroller.vadjustment().connect_value_changed(move |_| {
+            let (Some(spacer), Some(scroller)) = (spacer.upgrade(), scroller_weak.upgrade()) else {
+                return;
+            };
+            let height = spacer.height_request();
+            if height == 0 {
+                return;
+            }
+            // The position of the spacer from the top of what can be seen
+            if let Some((_, y)) = spacer.translate_coordinates(&scroller, 0.0, 0.0) {
+                if y + f64::from(height) > 0.0 {
+                    scrolled_up();
+                }
+            }
+        });
+    }
+
+    fn move_to(&mut self, start: usize) {
+        self.dropped_heights.truncate(start);
+        self.start.set(start);
+        self.end = self.end.min(start + STEP_RENDER_WINDOW);
+        self.update_spacer();
+    }
+
+    fn update_spacer(&self) {
+        self.spacer
+            .set_height_request(self.dropped_heights.iter().sum());
+    }
+}
@@ -108,6 +108,8 @@ where
                             ParameterKind::Integer => "kind-integer",
                             ParameterKind::Decimal => "kind-decimal",
                             ParameterKind::Boolean => "kind-boolean",
+                            ParameterKind::IntegerList => "kind-integer-list",
+                            ParameterKind::DecimalList => "kind-decimal-list",
                         }).into());
                         map.insert("source", self.source.to_string().into());
                         map.insert("value", self.value.to_string().into());
@@ -124,6 +126,8 @@ where
                             ParameterKind::Integer => "kind-integer",
                             ParameterKind::Decimal => "kind-decimal",
                             ParameterKind::Boolean => "kind-boolean",
+                            ParameterKind::IntegerList => "kind-integer-list",
+                            ParameterKind::DecimalList => "kind-decimal-list",
                         }).into());
                         map
                     }
@@ -1,4 +1,4 @@
-use std::{collections::HashMap, ffi};
+use std::{cell::Cell, collections::HashMap, ffi, rc::Rc, sync::Arc};
 
 use adw::prelude::*;
 use relm4::{
@@ -22,14 +22,17 @@ use crate::ui::{
 pub struct ActionComponentInitialiser {
     pub possible_outputs: Vec<(String, ParameterKind, ActionParameterSource)>,
     pub config: ActionConfiguration,
-    pub action: Action,
+    pub action: Arc<Action>,
+    /// The step of the first component in the list, which the index of this one is from.
+    pub first_step: Rc<Cell<usize>>,
 }
 
 #[derive(Debug)]
 pub struct ActionComponent {
     step: DynamicIndex,
+    first_step: Rc<Cell<usize>>,
     config: ActionConfiguration,
-    action: Action,
+    action: Arc<Action>,
     visible: bool,
 
     possible_outputs: Vec<(String, ParameterKind, ActionParameterSource)>,
@@ -104,7 +107,7 @@ impl FactoryComponent for ActionComponent {
                     "flow-step-label",
                     {
                         let mut map = HashMap::new();
-                        map.insert("step", (self.step.current_index() + 1).into());
+                        map.insert("step", (self.first_step.get() + self.step.current_index() + 1).into());
                         map.insert("name", self.action.friendly_name.clone().into());
                         map
                     }
@@ -123,10 +126,11 @@ impl FactoryComponent for ActionComponent {
                         set_valign: gtk::Align::Start,
                         set_height_request: 30,
 
-                        connect_clicked[sender, index, config] => move |_| {
-                            if index.clone().current_index() != 0 {
+                        connect_clicked[sender, index, config, first_step] => move |_| {
+                            let step = first_step.get() + index.current_index();
+                            if step != 0 {
                                 sender.output(ActionComponentOutput::Cut(index.clone()));
-                                sender.output(ActionComponentOutput::Paste((index.clone().current_index() - 1).max(0), config.clone()));
+                                sender.output(ActionComponentOutput::Paste(step - 1, config.clone()));
                             }
                         },
                     },
@@ -136,9 +140,10 @@ impl FactoryComponent for ActionComponent {
                         set_valign: gtk::Align::Start,
                         set_height_request: 30,
 
-                        connect_clicked[sender, index, config] => move |_| {
+                        connect_clicked[sender, index, config, first_step] => move |_| {
+                            let step = first_step.get() + index.current_index();
                             sender.output(ActionComponentOutput::Cut(index.clone()));
-                            sender.output(ActionComponentOutput::Paste(index.clone().current_index() + 1, config.clone()));
+                            sender.output(ActionComponentOutput::Paste(step + 1, config.clone()));
                         },
                     },
                     gtk::Button::builder().css_classes(["flat"]).build() {
@@ -242,10 +247,12 @@ impl FactoryComponent for ActionComponent {
             possible_outputs,
             action,
             config,
+            first_step,
         } = init;
 
         Self {
             step: index.clone(),
+            first_step,
             possible_outputs,
             config,
             action,
@@ -267,6 +274,7 @@ impl FactoryComponent for ActionComponent {
         sender: relm4::FactorySender<Self>,
     ) -> Self::Widgets {
         let config = self.config.clone();
+        let first_step = self.first_step.clone();
 
         {
             // initialise rows
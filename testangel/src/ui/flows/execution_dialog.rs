@@ -1,24 +1,46 @@
-use std::{collections::HashMap, sync::Arc};
+use std::{
+    collections::HashMap,
+    sync::{
+        atomic::{AtomicBool, Ordering},
+        Arc,
+    },
+    time::Duration,
+};
 
 use adw::prelude::*;
 use relm4::{adw, gtk, Component, ComponentParts, RelmWidgetExt};
 use testangel::{
     action_loader::ActionMap,
-    ipc::EngineList,
-    report_generation::{self, ReportGenerationError},
+    execution_plan::CompiledFlow,
+    ipc::{EngineList, IpcError},
+    report_generation::{
+        self, EvidenceSpool, ReportFormat, ReportGenerationError, SpooledEvidence,
+    },
     types::{AutomationFlow, FlowError},
 };
-use testangel_ipc::prelude::{Evidence, EvidenceContent, ParameterValue};
+use testangel_ipc::prelude::{Evidence, EvidenceContent};
 
 use crate::ui::{file_filters, lang};
 
 #[derive(Debug)]
 pub enum ExecutionDialogCommandOutput {
+    /// The given step has started executing
+    StepStarted(usize),
+
+    /// The given step finished after the given time, producing evidence with these labels
+    StepFinished(usize, Duration, Vec<String>),
+
     /// Execution completed with the resulting evidence
-    Complete(Vec<Evidence>),
+    Complete(SpooledEvidence),
 
     /// Execution failed at the given step and for the given reason
-    Failed(usize, FlowError, Vec<Evidence>),
+    Failed(usize, FlowError, SpooledEvidence),
+
+    /// Execution was cancelled before the given step
+    Cancelled(usize, SpooledEvidence),
+
+    /// The evidence couldn't be written to its spool
+    FailedToSpoolEvidence(std::io::Error),
 }
 
 #[derive(Debug)]
@@ -31,12 +53,23 @@ pub struct ExecutionDialogInit {
 #[derive(Debug)]
 pub enum ExecutionDialogInput {
     Close,
+    Cancel,
     FailedToGenerateReport(ReportGenerationError),
-    SaveEvidence(Vec<Evidence>),
+    SaveEvidence(Arc<SpooledEvidence>),
 }
 
 #[derive(Debug)]
-pub struct ExecutionDialog;
+pub struct ExecutionDialog {
+    /// Set to stop execution before the next step starts
+    cancel: Arc<AtomicBool>,
+    /// Whether the flow is still executing
+    running: bool,
+    status: String,
+    /// A row in the timeline for each step that has started, in the order they started
+    timeline: gtk::ListBox,
+    rows: HashMap<usize, adw::ActionRow>,
+    step_names: Vec<String>,
+}
 
 impl ExecutionDialog {
     /// Create the absolute barebones of a message dialog, allowing for custom button and response mapping.
@@ -51,6 +84,140 @@ impl ExecutionDialog {
             .modal(true)
             .build()
     }
+
+    /// Show a message that the flow didn't complete, offering to save the evidence collected.
+    fn offer_partial_evidence(
+        &self,
+        title: String,
+        message: String,
+        evidence: SpooledEvidence,
+        sender: &relm4::ComponentSender<Self>,
+        root: &adw::Window,
+    ) {
+        let dialog = self.create_message_dialog(title, message);
+        dialog.set_transient_for(Some(root));
+        if !evidence.is_empty() {
+            dialog.add_response("save", &lang::lookup("flow-execution-save-evidence-anyway"));
+        }
+        dialog.add_response("ok", &lang::lookup("ok"));
+        dialog.set_default_response(Some("ok"));
+        let evidence = Arc::new(evidence);
+        let sender_c = sender.clone();
+        dialog.connect_response(None, move |dlg, response| {
+            if response == "save" {
+                sender_c.input(ExecutionDialogInput::SaveEvidence(evidence.clone()));
+            }
+            sender_c.input(ExecutionDialogInput::Close);
+            dlg.close();
+        });
+        dialog.set_visible(true);
+    }
+
+    /// Update the status for the step now running.
+    fn set_running_status(&mut self, step: usize) {
+        self.status = lang::lookup_with_args("flow-execution-running-step", {
+            let mut map = HashMap::new();
+            map.insert("step", (step + 1).into());
+            map.insert("total", self.step_names.len().into());
+            map
+        });
+    }
+}
+
+/// Execute a flow, sending progress as each step starts and finishes, and stopping before the
+/// next step if `cancel` is set. Instructions that are running when `cancel` is set are
+/// cancelled too. The evidence is spooled as each step finishes.
+fn execute_flow(
+    init: &ExecutionDialogInit,
+    cancel: &Arc<AtomicBool>,
+    out: &relm4::Sender<ExecutionDialogCommandOutput>,
+) -> ExecutionDialogCommandOutput {
+    let mut evidence = Vec::new();
+    let mut spool = match EvidenceSpool::temporary() {
+        Ok(spool) => spool,
+        Err(e) => return ExecutionDialogCommandOutput::FailedToSpoolEvidence(e),
+    };
+
+    let compiled =
+        match CompiledFlow::compile(&init.flow, &init.action_map, init.engine_list.clone()) {
+            Ok(compiled) => compiled,
+            Err(e) => {
+                return match spool.finish() {
+                    Ok(spool) => ExecutionDialogCommandOutput::Failed(
+                        e.step() + 1,
+                        FlowError::Compile(e),
+                        spool,
+                    ),
+                    Err(e) => ExecutionDialogCommandOutput::FailedToSpoolEvidence(e),
+                };
+            }
+        };
+
+    let sessions: Vec<_> = compiled
+        .open_sessions()
+        .into_iter()
+        .map(|session| session.with_cancel(cancel.clone()))
+        .collect();
+    if sessions
+        .iter()
+        .any(|session| session.reset_state().is_err())
+    {
+        evidence.push(Evidence {
+            label: String::from("WARNING: State Warning"),
+            content: EvidenceContent::Textual(String::from("For this test execution, the state couldn't be correctly reset. Some results may not be accurate."))
+        });
+    }
+
+    if let Err(e) = spool.append_all(&mut evidence) {
+        return ExecutionDialogCommandOutput::FailedToSpoolEvidence(e);
+    }
+
+    let mut spool_error = None;
+    let result = compiled.execute_scheduled(
+        &sessions,
+        compiled.new_registers(),
+        0,
+        Some(cancel.as_ref()),
+        |step| {
+            log::debug!("Executing step {}", step + 1);
+            let _ = out.send(ExecutionDialogCommandOutput::StepStarted(step));
+        },
+        |step, duration, mut step_evidence, outputs| {
+            let labels = step_evidence.iter().map(|ev| ev.label.clone()).collect();
+            if spool_error.is_none() {
+                spool_error = spool.append_all(&mut step_evidence).err();
+            }
+            if outputs.is_some() {
+                let _ = out.send(ExecutionDialogCommandOutput::StepFinished(
+                    step, duration, labels,
+                ));
+            }
+        },
+    );
+    if let Some(e) = spool_error {
+        return ExecutionDialogCommandOutput::FailedToSpoolEvidence(e);
+    }
+    let stopped = match result {
+        Ok(()) => None,
+        Err((step, FlowError::IPCFailure(IpcError::Cancelled))) => {
+            log::info!("Execution cancelled at step {}", step + 1);
+            Some((step + 1, None))
+        }
+        Err((step, e)) => Some((step + 1, Some(e))),
+    };
+
+    let spool = match spool
+        .append_all(&mut evidence)
+        .and_then(|()| spool.finish())
+    {
+        Ok(spool) => spool,
+        Err(e) => return ExecutionDialogCommandOutput::FailedToSpoolEvidence(e),
+    };
+    match stopped {
+        Some((step, Some(e))) => ExecutionDialogCommandOutput::Failed(step, e, spool),
+        Some((step, None)) => ExecutionDialogCommandOutput::Cancelled(step, spool),
+        None => ExecutionDialogCommandOutput::Complete(spool),
+    }
 }
 
 #[relm4::component(pub)]
@@ -65,17 +232,38 @@ impl Component for ExecutionDialog {
         adw::Window {
             set_modal: true,
             set_resizable: false,
+            set_default_width: 450,
 
             gtk::Box {
                 set_orientation: gtk::Orientation::Vertical,
                 set_spacing: 5,
-                set_margin_all: 50,
+                set_margin_all: 20,
 
                 gtk::Spinner {
-                    set_spinning: true,
+                    #[watch]
+                    set_spinning: model.running,
                 },
                 gtk::Label {
-                    set_label: &lang::lookup("flow-execution-running"),
+                    #[watch]
+                    set_label: &model.status,
+                },
+
+                gtk::ScrolledWindow {
+                    set_hscrollbar_policy: gtk::PolicyType::Never,
+                    set_min_content_height: 250,
+
+                    #[local_ref]
+                    timeline -> gtk::ListBox {
+                        set_selection_mode: gtk::SelectionMode::None,
+                        add_css_class: "boxed-list",
+                    },
+                },
+
+                gtk::Button {
+                    set_label: &lang::lookup("flow-execution-cancel"),
+                    #[watch]
+                    set_sensitive: model.running && !model.cancel.load(Ordering::Relaxed),
+                    connect_clicked => ExecutionDialogInput::Cancel,
                 },
             },
         },
@@ -86,45 +274,32 @@ impl Component for ExecutionDialog {
         root: &Self::Root,
         sender: relm4::ComponentSender<Self>,
     ) -> relm4::ComponentParts<Self> {
-        let model = ExecutionDialog;
+        let step_names = init
+            .flow
+            .actions
+            .iter()
+            .map(|step| {
+                init.action_map
+                    .get_action_by_id(&step.action_id)
+                    .map(|action| action.friendly_name.clone())
+                    .unwrap_or_else(|| step.action_id.clone())
+            })
+            .collect();
+        let model = ExecutionDialog {
+            cancel: Arc::new(AtomicBool::new(false)),
+            running: true,
+            status: lang::lookup("flow-execution-running"),
+            timeline: gtk::ListBox::default(),
+            rows: HashMap::new(),
+            step_names,
+        };
+        let timeline = &model.timeline;
         let widgets = view_output!();
-        let flow = init.flow;
-        let engine_list = init.engine_list.clone();
-        let action_map = init.action_map.clone();
-
-        sender.spawn_oneshot_command(move || {
-            let mut outputs: Vec<HashMap<usize, ParameterValue>> = Vec::new();
-            let mut evidence = Vec::new();
-
-            for engine in engine_list.inner() {
-                if engine.reset_state().is_err() {
-                    evidence.push(Evidence {
-                        label: String::from("WARNING: State Warning"),
-                        content: EvidenceContent::Textual(String::from("For this test execution, the state couldn't be correctly reset. Some results may not be accurate."))
-                    });
-                }
-            }
-
-            for (step, action_config) in flow.actions.iter().enumerate() {
-                log::debug!("Output state: {outputs:?}");
-                log::debug!("Evidence state: {evidence:?}");
-                log::debug!("Executing: {action_config:?}");
-                match action_config.execute(
-                    action_map.clone(),
-                    engine_list.clone(),
-                    outputs.clone(),
-                ) {
-                    Ok((output, ev)) => {
-                        outputs.push(output);
-                        evidence = [evidence, ev].concat();
-                    }
-                    Err(e) => {
-                        return ExecutionDialogCommandOutput::Failed(step + 1, e, evidence);
-                    }
-                }
-            }
 
-            ExecutionDialogCommandOutput::Complete(evidence)
+        let cancel = model.cancel.clone();
+        sender.spawn_command(move |out| {
+            let result = execute_flow(&init, &cancel, &out);
+            let _ = out.send(result);
         });
 
         ComponentParts { model, widgets }
@@ -137,7 +312,14 @@ impl Component for ExecutionDialog {
         root: &Self::Root,
     ) {
         match message {
-            ExecutionDialogInput::Close => root.destroy(),
+            ExecutionDialogInput::Close => {
+                self.cancel.store(true, Ordering::Relaxed);
+                root.destroy();
+            }
+            ExecutionDialogInput::Cancel => {
+                self.cancel.store(true, Ordering::Relaxed);
+                self.status = lang::lookup("flow-execution-cancelling");
+            }
             ExecutionDialogInput::FailedToGenerateReport(reason) => {
                 let dialog = self.create_message_dialog(
                     lang::lookup("report-failed"),
@@ -178,7 +360,8 @@ impl Component for ExecutionDialog {
                             let path = file.path().unwrap();
                             if let Err(e) = report_generation::save_report(
                                 path.with_extension("pdf"),
-                                evidence.clone(),
+                                ReportFormat::Pdf,
+                                &evidence,
                             ) {
                                 // Failed to generate report
                                 sender_c.input(ExecutionDialogInput::FailedToGenerateReport(e));
@@ -201,14 +384,78 @@ impl Component for ExecutionDialog {
         root: &Self::Root,
     ) {
         match message {
+            ExecutionDialogCommandOutput::StepStarted(step) => {
+                if !self.cancel.load(Ordering::Relaxed) {
+                    self.set_running_status(step);
+                }
+                let row = adw::ActionRow::builder()
+                    .title(lang::lookup_with_args("flow-step-label", {
+                        let mut map = HashMap::new();
+                        map.insert("step", (step + 1).into());
+                        map.insert("name", self.step_names[step].clone().into());
+                        map
+                    }))
+                    .subtitle(lang::lookup("flow-execution-step-running"))
+                    .build();
+                self.timeline.append(&row);
+                self.rows.insert(step, row);
+            }
+
+            ExecutionDialogCommandOutput::StepFinished(step, duration, labels) => {
+                log::debug!("Step {} finished in {duration:?}", step + 1);
+                if let Some(row) = self.rows.get(&step) {
+                    row.set_subtitle(&lang::lookup_with_args("flow-execution-step-finished", {
+                        let mut map = HashMap::new();
+                        map.insert("time", duration.as_millis().to_string().into());
+                        map.insert("evidence", labels.len().into());
+                        map
+                    }));
+                    if !labels.is_empty() {
+                        row.set_tooltip_text(Some(labels.join("\n").as_str()));
+                    }
+                }
+            }
+
             ExecutionDialogCommandOutput::Complete(evidence) => {
                 log::info!("Execution complete.");
-                sender.input(ExecutionDialogInput::SaveEvidence(evidence));
+                self.running = false;
+                sender.input(ExecutionDialogInput::SaveEvidence(Arc::new(evidence)));
+            }
+
+            ExecutionDialogCommandOutput::FailedToSpoolEvidence(e) => {
+                log::error!("Failed to spool evidence: {e}");
+                self.running = false;
+                sender.input(ExecutionDialogInput::FailedToGenerateReport(e.into()));
+            }
+
+            ExecutionDialogCommandOutput::Cancelled(step, evidence) => {
+                log::info!("Execution cancelled.");
+                self.running = false;
+                self.status = lang::lookup("flow-execution-cancelled");
+                self.offer_partial_evidence(
+                    lang::lookup("flow-execution-cancelled"),
+                    lang::lookup_with_args("flow-execution-cancelled-message", {
+                        let mut map = HashMap::new();
+                        map.insert("step", step.into());
+                        map
+                    }),
+                    evidence,
+                    &sender,
+                    root,
+                );
             }
 
             ExecutionDialogCommandOutput::Failed(step, reason, evidence) => {
-                log::warn!("Execution failed. Evidence: {evidence:?}");
-                let dialog = self.create_message_dialog(
+                log::warn!(
+                    "Execution failed. {} item(s) of evidence were collected.",
+                    evidence.len()
+                );
+                self.running = false;
+                self.status = lang::lookup("flow-execution-failed");
+                if let Some(row) = self.rows.get(&(step - 1)) {
+                    row.set_subtitle(&lang::lookup("flow-execution-step-failed"));
+                }
+                self.offer_partial_evidence(
                     lang::lookup("flow-execution-failed"),
                     lang::lookup_with_args("flow-execution-failed-message", {
                         let mut map = HashMap::new();
@@ -216,23 +463,10 @@ impl Component for ExecutionDialog {
                         map.insert("reason", reason.to_string().into());
                         map
                     }),
+                    evidence,
+                    &sender,
+                    root,
                 );
-                dialog.set_transient_for(Some(root));
-                if !evidence.is_empty() {
-                    dialog
-                        .add_response("save", &lang::lookup("flow-execution-save-evidence-anyway"));
-                }
-                dialog.add_response("ok", &lang::lookup("ok"));
-                dialog.set_default_response(Some("ok"));
-                let sender_c = sender.clone();
-                dialog.connect_response(None, move |dlg, response| {
-                    if response == "save" {
-                        sender_c.input(ExecutionDialogInput::SaveEvidence(evidence.clone()));
-                    }
-                    sender_c.input(ExecutionDialogInput::Close);
-                    dlg.close();
-                });
-                dialog.set_visible(true);
             }
         }
     }
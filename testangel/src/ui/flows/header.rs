@@ -7,7 +7,9 @@ use relm4::{
 use testangel::action_loader::ActionMap;
 
 use crate::ui::{
-    components::add_step_factory::{AddStepInit, AddStepResult, AddStepTrait},
+    components::add_step_factory::{
+        AddStepInit, AddStepResult, AddStepTrait, StepSearch, StepSearchOutput, SEARCH_RESULT_LIMIT,
+    },
     lang,
 };
 
@@ -17,6 +19,9 @@ pub struct FlowsHeader {
     add_button: gtk::MenuButton,
     flow_open: bool,
     search_results: FactoryVecDeque<AddStepResult<FlowsHeaderInput>>,
+    search: StepSearch,
+    /// If true, add the top result once the search in progress has finished.
+    add_top_when_shown: bool,
 }
 
 #[derive(Debug)]
@@ -56,7 +61,7 @@ impl Component for FlowsHeader {
     type Init = Arc<ActionMap>;
     type Input = FlowsHeaderInput;
     type Output = FlowsHeaderOutput;
-    type CommandOutput = ();
+    type CommandOutput = StepSearchOutput;
 
     view! {
         #[root]
@@ -126,6 +131,8 @@ impl Component for FlowsHeader {
             flow_open: false,
             add_button: gtk::MenuButton::default(),
             search_results: FactoryVecDeque::new(gtk::Box::default(), sender.input_sender()),
+            search: StepSearch::default(),
+            add_top_when_shown: false,
         };
         // Reset search results
         sender.input(FlowsHeaderInput::SearchForSteps(String::new()));
@@ -153,6 +160,7 @@ impl Component for FlowsHeader {
             }
             FlowsHeaderInput::ActionsMapChanged(new_map) => {
                 self.action_map = new_map;
+                self.search.reset();
                 sender.input(FlowsHeaderInput::SearchForSteps(String::new()));
             }
             FlowsHeaderInput::AddStep(step_id) => {
@@ -162,7 +170,10 @@ impl Component for FlowsHeader {
                 sender.output(FlowsHeaderOutput::AddStep(step_id)).unwrap();
             }
             FlowsHeaderInput::AddTopSearchResult => {
-                if let Some(result) = self.search_results.get(0) {
+                if self.search.is_pending() {
+                    // Wait for the results of the query being searched for
+                    self.add_top_when_shown = true;
+                } else if let Some(result) = self.search_results.get(0) {
                     widgets.menu_popover.popdown();
                     let id = result.value();
                     // unwrap rationale: the receiver will never be disconnected
@@ -170,65 +181,54 @@ impl Component for FlowsHeader {
                 }
             }
             FlowsHeaderInput::SearchForSteps(query) => {
-                let mut results = self.search_results.guard();
-                results.clear();
-
-                // Reset scroll
-                let adj = widgets.menu_scrolled_area.vadjustment();
-                adj.set_value(adj.lower());
-
+                let action_map = self.action_map.clone();
                 let show_hidden = std::env::var("TA_SHOW_HIDDEN_ACTIONS")
                     .unwrap_or("no".to_string())
                     .eq_ignore_ascii_case("yes");
-                // Collect results
-                if query.is_empty() {
-                    // List all alphabetically
-                    let mut unsorted_results = vec![];
-                    for (group, actions) in self.action_map.get_by_group() {
-                        for action in actions {
-                            if action.visible || show_hidden {
-                                unsorted_results
-                                    .push((format!("{group}: {}", action.friendly_name), action));
-                            }
-                        }
-                    }
-
-                    // Sort
-                    unsorted_results.sort_by(|(a, _a), (b, _b)| a.cmp(b));
-                    for (_, a) in unsorted_results {
-                        results.push_back(AddStepInit {
-                            label: format!("{}: {}", a.group, a.friendly_name),
-                            value: a.id,
-                        });
-                    }
-                } else {
-                    let mut unsorted_results = vec![];
-                    use fuzzy_matcher::{skim::SkimMatcherV2, FuzzyMatcher};
-                    let matcher = SkimMatcherV2::default();
-                    for (group, actions) in self.action_map.get_by_group() {
-                        for action in actions {
-                            if action.visible || show_hidden {
-                                if let Some(score) = matcher.fuzzy_match(
-                                    &format!("{group}: {}", action.friendly_name),
-                                    &query,
-                                ) {
-                                    unsorted_results.push((score, action));
-                                }
-                            }
-                        }
-                    }
-
-                    // Sort
-                    unsorted_results.sort_by(|(a, _a), (b, _b)| a.cmp(b));
-                    for (_, a) in unsorted_results {
-                        results.push_back(AddStepInit {
-                            label: format!("{}: {}", a.group, a.friendly_name),
-                            value: a.id,
-                        });
-                    }
-                }
+
+                self.search.start(&sender, query, move |query, previous| {
+                    action_map.search_index().search(
+                        query,
+                        show_hidden,
+                        previous,
+                        SEARCH_RESULT_LIMIT,
+                    )
+                });
             }
         }
         self.update_view(widgets, sender);
     }
+
+    fn update_cmd_with_view(
+        &mut self,
+        widgets: &mut Self::Widgets,
+        output: Self::CommandOutput,
+        sender: ComponentSender<Self>,
+        _root: &Self::Root,
+    ) {
+        let Some(found) = self.search.finish(output) else {
+            return;
+        };
+
+        let mut results = self.search_results.guard();
+        results.clear();
+
+        // Reset scroll
+        let adj = widgets.menu_scrolled_area.vadjustment();
+        adj.set_value(adj.lower());
+
+        for (label, value) in found.top() {
+            results.push_back(AddStepInit {
+                label: label.clone(),
+                value: value.clone(),
+            });
+        }
+        drop(results);
+
+        if self.add_top_when_shown {
+            self.add_top_when_shown = false;
+            sender.input(FlowsHeaderInput::AddTopSearchResult);
+        }
+        self.update_view(widgets, sender);
+    }
 }
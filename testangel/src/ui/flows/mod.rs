@@ -11,7 +11,7 @@ use testangel::{
     types::{ActionConfiguration, ActionParameterSource, AutomationFlow, VersionedFile},
 };
 
-use super::{file_filters, lang};
+use super::{components::step_window::StepWindow, file_filters, lang, STEP_RENDER_BATCH};
 
 mod action_component;
 mod execution_dialog;
@@ -68,6 +68,8 @@ pub enum FlowInputs {
     NoOp,
     /// The map of actions has changed and should be updated
     ActionsMapChanged(Arc<ActionMap>),
+    /// The list of engines has changed and should be updated
+    EngineListChanged(Arc<EngineList>),
     /// Create a new flow
     NewFlow,
     /// Actually create the new flow
@@ -94,6 +96,11 @@ pub enum FlowInputs {
     AddStep(String),
     /// Update the UI steps from the open flow. This will clear first and overwrite any changes!
     UpdateStepsFromModel,
+    /// Create the widgets of more steps, as the list of steps has been scrolled to the end.
+    RenderMoreSteps,
+    /// Create the widgets of earlier steps again, as the list of steps has been scrolled up past
+    /// the first step with widgets.
+    RenderEarlierSteps,
     /// Remove the step with the provided index, resetting all references to it.
     RemoveStep(DynamicIndex),
     /// Remove the step with the provided index, but change references to it to a temporary value (`usize::MAX`)
@@ -125,6 +132,11 @@ pub struct FlowsModel {
     needs_saving: bool,
     header: Rc<Controller<header::FlowsHeader>>,
     live_actions_list: FactoryVecDeque<action_component::ActionComponent>,
+    /// The steps to create widgets for. Only some of the steps of a large flow are rendered,
+    /// depending on where the list is scrolled to.
+    window: StepWindow,
+    /// The first step whose widgets no longer match the open flow, if any.
+    first_changed_step: Option<usize>,
 
     execution_dialog: Option<Connector<execution_dialog::ExecutionDialog>>,
 }
@@ -168,6 +180,7 @@ impl FlowsModel {
         self.open_path = None;
         self.needs_saving = true;
         self.open_flow = Some(AutomationFlow::default());
+        self.window.reset();
         self.header.emit(header::FlowsHeaderInput::ChangeFlowOpen(
             self.open_flow.is_some(),
         ));
@@ -199,13 +212,14 @@ impl FlowsModel {
                 }
                 Some(action) => {
                     // Check that action parameters haven't changed. If they have, reset values.
-                    if ac.update(action) {
+                    if ac.update(&action) {
                         steps_reset.push(step + 1);
                     }
                 }
             }
         }
         self.open_flow = Some(flow);
+        self.window.reset();
         self.header.emit(header::FlowsHeaderInput::ChangeFlowOpen(
             self.open_flow.is_some(),
         ));
@@ -216,6 +230,94 @@ impl FlowsModel {
         Ok(steps_reset)
     }
 
+    /// Mark the widgets of a step, and every step after it, as needing to be rebuilt.
+    fn steps_changed_from(&mut self, step: usize) {
+        self.first_changed_step = Some(self.first_changed_step.map_or(step, |s| s.min(step)));
+    }
+
+    /// Create widgets for the steps up to `end`, dropping the widgets of the steps at the start
+    /// of the window if there are too many.
+    fn extend_window(&mut self, end: usize) {
+        let rendered = self.live_actions_list.len();
+        let dropped = self
+            .window
+            .extend(self.live_actions_list.widget(), rendered, end);
+        let mut live_list = self.live_actions_list.guard();
+        for _ in 0..dropped {
+            live_list.pop_front();
+        }
+    }
+
+    /// Bring the widgets of the steps up to date with the open flow. Widgets are rebuilt from the
+    /// first step that has changed, and created for steps up to the end of the window. The
+    /// widgets of earlier steps are left alone.
+    fn render_steps(&mut self) {
+        let mut live_list = self.live_actions_list.guard();
+        let Some(flow) = &self.open_flow else {
+            live_list.clear();
+            return;
+        };
+
+        let mut changed = self.first_changed_step.take();
+        if self.window.clamp(flow.actions.len()) {
+            changed = Some(0);
+        }
+        // Widgets are only kept from the start of the window, so rebuild them from there if an
+        // earlier step has changed.
+        let start = self.window.start();
+        let first = changed
+            .unwrap_or(usize::MAX)
+            .max(start)
+            .min(start + live_list.len());
+        while start + live_list.len() > first {
+            live_list.pop_back();
+        }
+        let target = self.window.end(flow.actions.len());
+        if first >= target && changed.is_none() {
+            return;
+        }
+
+        let mut possible_outputs = vec![];
+        // Populate possible outputs with flow parameters
+        for (idx, (name, kind)) in flow.parameters.iter().enumerate() {
+            possible_outputs.push((
+                lang::lookup_with_args("source-from-param", {
+                    let mut map = HashMap::new();
+                    map.insert("param", name.clone().into());
+                    map
+                }),
+                *kind,
+                ActionParameterSource::FromFlowParameter(idx),
+            ));
+        }
+
+        for (step, config) in flow.actions.iter().enumerate().take(target) {
+            // rationale: we have already checked the actions are here when the file is opened
+            let action = self.action_map.get_action_by_id(&config.action_id).unwrap();
+            if step >= first {
+                live_list.push_back(action_component::ActionComponentInitialiser {
+                    possible_outputs: possible_outputs.clone(),
+                    config: config.clone(),
+                    action: action.clone(),
+                    first_step: self.window.shared_start(),
+                });
+            }
+            // add possible outputs to list AFTER processing this step
+            for (output_idx, (name, kind, _)) in action.outputs.iter().enumerate() {
+                possible_outputs.push((
+                    lang::lookup_with_args("source-from-step", {
+                        let mut map = HashMap::new();
+                        map.insert("step", (step + 1).into());
+                        map.insert("name", name.clone().into());
+                        map
+                    }),
+                    *kind,
+                    ActionParameterSource::FromOutput(step, output_idx),
+                ));
+            }
+        }
+    }
+
     /// Ask the user if they want to save this file. If they response yes, this will also trigger the save function.
     /// This function will only ask the user if needed, otherwise it will emit immediately.
     fn prompt_to_save(&self, sender: &relm4::Sender<FlowInputs>, then: FlowInputs) {
@@ -301,6 +403,8 @@ impl FlowsModel {
         self.open_path = None;
         self.needs_saving = false;
         self.live_actions_list.guard().clear();
+        self.first_changed_step = None;
+        self.window.reset();
         self.header.emit(header::FlowsHeaderInput::ChangeFlowOpen(
             self.open_flow.is_some(),
         ));
@@ -317,10 +421,17 @@ impl Component for FlowsModel {
     view! {
         #[root]
         toast_target = adw::ToastOverlay {
+            #[name = "scroller"]
             gtk::ScrolledWindow {
                 set_vexpand: true,
                 set_hscrollbar_policy: gtk::PolicyType::Never,
 
+                connect_edge_reached[sender] => move |_, pos| {
+                    if pos == gtk::PositionType::Bottom {
+                        sender.input(FlowInputs::RenderMoreSteps);
+                    }
+                },
+
                 gtk::Box {
                     set_orientation: gtk::Orientation::Vertical,
                     set_margin_all: 5,
@@ -334,6 +445,9 @@ impl Component for FlowsModel {
                         set_vexpand: true,
                     },
 
+                    #[local_ref]
+                    spacer -> gtk::Box {},
+
                     #[local_ref]
                     live_actions_list -> gtk::Box {
                         set_orientation: gtk::Orientation::Vertical,
@@ -372,14 +486,24 @@ impl Component for FlowsModel {
             execution_dialog: None,
             header,
             live_actions_list: FactoryVecDeque::new(gtk::Box::default(), sender.input_sender()),
+            window: StepWindow::default(),
+            first_changed_step: None,
         };
 
         // Trigger update actions from model
         sender.input(FlowInputs::UpdateStepsFromModel);
 
         let live_actions_list = model.live_actions_list.widget();
+        let spacer = model.window.spacer();
         let widgets = view_output!();
 
+        let sender_c = sender.clone();
+        model
+            .window
+            .connect_scrolled_up(&widgets.scroller, move || {
+                sender_c.input(FlowInputs::RenderEarlierSteps);
+            });
+
         ComponentParts { model, widgets }
     }
 
@@ -392,6 +516,9 @@ impl Component for FlowsModel {
     ) {
         match message {
             FlowInputs::NoOp => (),
+            FlowInputs::EngineListChanged(new_list) => {
+                self.engine_list = new_list;
+            }
             FlowInputs::ActionsMapChanged(new_map) => {
                 self.action_map = new_map.clone();
                 self.header
@@ -408,7 +535,7 @@ impl Component for FlowsModel {
                             }
                             Some(action) => {
                                 // Check that action parameters haven't changed. If they have, reset values.
-                                if ac.update(action) {
+                                if ac.update(&action) {
                                     steps_reset.push(step);
                                 }
                             }
@@ -441,8 +568,9 @@ impl Component for FlowsModel {
             }
             FlowInputs::ConfigUpdate(step, new_config) => {
                 // unwrap rationale: config updates can't happen if nothing is open
+                let step = self.window.step(&step);
                 let flow = self.open_flow.as_mut().unwrap();
-                flow.actions[step.current_index()] = new_config;
+                flow.actions[step] = new_config;
                 self.needs_saving = true;
             }
             FlowInputs::NewFlow => {
@@ -589,51 +717,44 @@ impl Component for FlowsModel {
                 let flow = self.open_flow.as_mut().unwrap();
                 // unwrap rationale: the header can't ask to add an action that doesn't exist
                 flow.actions.push(ActionConfiguration::from(
-                    self.action_map.get_action_by_id(&step_id).unwrap(),
+                    &*self.action_map.get_action_by_id(&step_id).unwrap(),
                 ));
+                let step = flow.actions.len() - 1;
+                // Show the new step if every step before it is shown
+                if self.window.start() + self.live_actions_list.len() == step {
+                    self.extend_window(step + 1);
+                }
                 self.needs_saving = true;
-                // Trigger UI steps refresh
-                sender.input(FlowInputs::UpdateStepsFromModel);
+                self.steps_changed_from(step);
+                self.render_steps();
             }
 
             FlowInputs::UpdateStepsFromModel => {
-                let mut live_list = self.live_actions_list.guard();
-                live_list.clear();
-                if let Some(flow) = &self.open_flow {
-                    let mut possible_outputs = vec![];
-                    for (step, config) in flow.actions.iter().enumerate() {
-                        live_list.push_back(action_component::ActionComponentInitialiser {
-                            possible_outputs: possible_outputs.clone(),
-                            config: config.clone(),
-                            action: self.action_map.get_action_by_id(&config.action_id).unwrap(), // rationale: we have already checked the actions are here when the file is opened
-                        });
-                        // add possible outputs to list AFTER processing this step
-                        // unwrap rationale: actions are check to exist prior to opening.
-                        for (output_idx, (name, kind, _)) in self
-                            .action_map
-                            .get_action_by_id(&config.action_id)
-                            .unwrap()
-                            .outputs
-                            .iter()
-                            .enumerate()
-                        {
-                            possible_outputs.push((
-                                lang::lookup_with_args("source-from-step", {
-                                    let mut map = HashMap::new();
-                                    map.insert("step", (step + 1).into());
-                                    map.insert("name", name.clone().into());
-                                    map
-                                }),
-                                *kind,
-                                ActionParameterSource::FromOutput(step, output_idx),
-                            ));
-                        }
-                    }
+                self.steps_changed_from(0);
+                self.render_steps();
+            }
+
+            FlowInputs::RenderMoreSteps => {
+                let rendered = self.window.start() + self.live_actions_list.len();
+                if self
+                    .open_flow
+                    .as_ref()
+                    .is_some_and(|flow| rendered < flow.actions.len())
+                {
+                    self.extend_window(rendered + STEP_RENDER_BATCH);
+                    self.render_steps();
+                }
+            }
+
+            FlowInputs::RenderEarlierSteps => {
+                if self.window.move_back() {
+                    self.steps_changed_from(self.window.start());
+                    self.render_steps();
                 }
             }
 
             FlowInputs::RemoveStep(step_idx) => {
-                let idx = step_idx.current_index();
+                let idx = self.window.step(&step_idx);
                 let flow = self.open_flow.as_mut().unwrap();
 
                 // This is needed as sometimes, if a menu item lines up above the delete step button,
@@ -664,11 +785,12 @@ impl Component for FlowsModel {
 
                 self.needs_saving = true;
 
-                // Trigger UI steps refresh
-                sender.input(FlowInputs::UpdateStepsFromModel);
+                // Refresh the UI of the steps that have moved
+                self.steps_changed_from(idx);
+                self.render_steps();
             }
             FlowInputs::CutStep(step_idx) => {
-                let idx = step_idx.current_index();
+                let idx = self.window.step(&step_idx);
                 let flow = self.open_flow.as_mut().unwrap();
                 log::info!("Cut step {}", idx + 1);
 
@@ -695,6 +817,7 @@ impl Component for FlowsModel {
                 }
 
                 self.needs_saving = true;
+                self.steps_changed_from(idx);
             }
             FlowInputs::PasteStep(idx, config) => {
                 let flow = self.open_flow.as_mut().unwrap();
@@ -722,14 +845,15 @@ impl Component for FlowsModel {
 
                 self.needs_saving = true;
 
-                // Trigger UI steps refresh
-                sender.input(FlowInputs::UpdateStepsFromModel);
+                // Refresh the UI of the steps that have moved
+                self.steps_changed_from(idx);
+                self.render_steps();
             }
             FlowInputs::MoveStep(from, to, offset) => {
-                let current_from = from.current_index();
+                let current_from = self.window.step(&from);
                 let step = self.open_flow.as_ref().unwrap().actions[current_from].clone();
                 sender.input(FlowInputs::CutStep(from));
-                let mut to = (to.current_index() as isize + offset).max(0) as usize;
+                let mut to = (self.window.step(&to) as isize + offset).max(0) as usize;
                 if to > current_from && to > 0 {
                     to -= 1;
                 }
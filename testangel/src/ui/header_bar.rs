@@ -20,6 +20,7 @@ pub enum HeaderBarInput {
     ChangedView(String),
     OpenAboutDialog,
     ActionsMapChanged(Arc<ActionMap>),
+    EngineListChanged(Arc<EngineList>),
     NewFile,
     OpenFile,
     SaveFile,
@@ -192,6 +193,7 @@ impl Component for HeaderBarModel {
     ) {
         match message {
             HeaderBarInput::ActionsMapChanged(new_map) => self.action_map = new_map,
+            HeaderBarInput::EngineListChanged(new_list) => self.engine_list = new_list,
             HeaderBarInput::OpenAboutDialog => {
                 crate::ui::about::AppAbout::builder()
                     .transient_for(root)
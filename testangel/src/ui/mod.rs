@@ -20,6 +20,15 @@ mod flows;
 mod header_bar;
 pub(crate) mod lang;
 
+/// The number of steps of a flow or action whose widgets are created at once. The widgets of
+/// later steps are only created once the list of steps is scrolled down to them.
+const STEP_RENDER_BATCH: usize = 50;
+
+/// The most steps of a flow or action to keep the widgets of. Once more have been created, the
+/// widgets of the steps furthest above them are dropped, and created again when the list is
+/// scrolled back up.
+const STEP_RENDER_WINDOW: usize = 3 * STEP_RENDER_BATCH;
+
 /// Initialise and open the UI.
 pub fn initialise_ui() {
     log::info!("Starting Next UI...");
@@ -27,9 +36,7 @@ pub fn initialise_ui() {
     relm4_icons::initialize_icons();
     initialise_icons();
 
-    let engines = Arc::new(ipc::get_engines());
-    let actions = Arc::new(action_loader::get_actions(engines.clone()));
-    app.run::<AppModel>(AppInit { engines, actions });
+    app.run::<AppModel>(());
 }
 
 fn initialise_icons() {
@@ -41,11 +48,6 @@ fn initialise_icons() {
     theme.add_resource_path("/uk/hpkns/testangel/icons");
 }
 
-pub struct AppInit {
-    engines: Arc<EngineList>,
-    actions: Arc<ActionMap>,
-}
-
 #[derive(Debug)]
 enum AppInput {
     /// The view has changed and should be read from visible_child_name, then components updated as needed.
@@ -58,6 +60,14 @@ enum AppInput {
     AttachFileActionGroup(RelmActionGroup<header_bar::FileActionGroup>),
 }
 
+#[derive(Debug)]
+enum AppCommandOutput {
+    /// The engines have been loaded in the background
+    EnginesLoaded(Arc<EngineList>),
+    /// The actions have been loaded in the background
+    ActionsLoaded(Arc<ActionMap>),
+}
+
 #[derive(Debug)]
 struct AppModel {
     stack: Rc<adw::ViewStack>,
@@ -68,14 +78,22 @@ struct AppModel {
 
     engines_list: Arc<EngineList>,
     actions_map: Arc<ActionMap>,
+    /// What is being loaded in the background, if anything.
+    loading: Option<String>,
+    /// The file actions of the header bar, held back until the engines and actions have loaded,
+    /// so that nothing can be opened or saved before then.
+    file_actions: Option<RelmActionGroup<header_bar::FileActionGroup>>,
+    /// Whether the actions have been reloaded, so the actions loaded in the background are out of
+    /// date when they arrive.
+    actions_reloaded: bool,
 }
 
 #[relm4::component]
 impl Component for AppModel {
-    type Init = AppInit;
+    type Init = ();
     type Input = AppInput;
     type Output = ();
-    type CommandOutput = ();
+    type CommandOutput = AppCommandOutput;
 
     view! {
         main_window = adw::Window {
@@ -90,6 +108,13 @@ impl Component for AppModel {
 
                 model.header.widget(),
 
+                adw::Banner {
+                    #[watch]
+                    set_title: model.loading.as_deref().unwrap_or_default(),
+                    #[watch]
+                    set_revealed: model.loading.is_some(),
+                },
+
                 #[local_ref]
                 stack -> adw::ViewStack {
                     connect_visible_child_name_notify[sender] => move |st| {
@@ -101,16 +126,27 @@ impl Component for AppModel {
     }
 
     fn init(
-        init: Self::Init,
+        _init: Self::Init,
         root: &Self::Root,
         sender: relm4::ComponentSender<Self>,
     ) -> relm4::ComponentParts<Self> {
+        // Load the engines and actions in the background, so the window can open straight away.
+        // The pages are populated as each finishes.
+        sender.spawn_command(|out| {
+            let engines = Arc::new(ipc::get_engines());
+            let _ = out.send(AppCommandOutput::EnginesLoaded(engines.clone()));
+            let actions = Arc::new(action_loader::get_actions(engines));
+            let _ = out.send(AppCommandOutput::ActionsLoaded(actions));
+        });
+        let engines = Arc::new(EngineList::default());
+        let actions_map = Arc::new(ActionMap::default());
+
         // Initialise the sub-components (pages)
         let flows = flows::FlowsModel::builder()
-            .launch((init.actions.clone(), init.engines.clone()))
+            .launch((actions_map.clone(), engines.clone()))
             .forward(sender.input_sender(), |msg| match msg {});
         let actions = actions::ActionsModel::builder()
-            .launch((init.actions.clone(), init.engines.clone()))
+            .launch((actions_map.clone(), engines.clone()))
             .forward(sender.input_sender(), |msg| match msg {
                 actions::ActionOutputs::ReloadActions => AppInput::ReloadActionsMap,
             });
@@ -124,8 +160,8 @@ impl Component for AppModel {
                 actions.model().header_controller_rc(),
                 flows.model().header_controller_rc(),
                 stack.clone(),
-                init.engines.clone(),
-                init.actions.clone(),
+                engines.clone(),
+                actions_map.clone(),
             ))
             .forward(sender.input_sender(), |msg| match msg {
                 header_bar::HeaderBarOutput::AttachGeneralActionGroup(group) => {
@@ -138,14 +174,21 @@ impl Component for AppModel {
 
         // Build model
         let model = AppModel {
-            actions_map: init.actions,
-            engines_list: init.engines,
+            actions_map,
+            engines_list: engines,
             stack,
             header,
             flows,
             actions,
+            loading: Some(lang::lookup("loading-engines")),
+            file_actions: None,
+            actions_reloaded: false,
         };
 
+        // Nothing can be edited until the engines and actions it uses have loaded.
+        model.set_flows_sensitive(false);
+        model.set_actions_sensitive(false);
+
         // Render window parts
         let stack = &*model.stack;
 
@@ -190,25 +233,96 @@ impl Component for AppModel {
                 group.register_for_widget(root);
             }
             AppInput::AttachFileActionGroup(group) => {
-                group.register_for_widget(root);
+                if self.loading.is_some() {
+                    self.file_actions = Some(group);
+                } else {
+                    group.register_for_widget(root);
+                }
             }
             AppInput::ChangedView(new_view) => {
                 self.header
                     .emit(HeaderBarInput::ChangedView(new_view.unwrap_or_default()));
             }
             AppInput::ReloadActionsMap => {
-                self.actions_map = Arc::new(action_loader::get_actions(self.engines_list.clone()));
-                self.flows.emit(flows::FlowInputs::ActionsMapChanged(
-                    self.actions_map.clone(),
+                self.actions_map = Arc::new(action_loader::reload_actions(
+                    self.engines_list.clone(),
+                    &self.actions_map,
                 ));
-                self.actions.emit(actions::ActionInputs::ActionsMapChanged(
-                    self.actions_map.clone(),
+                self.actions_reloaded = true;
+                self.actions_map_changed();
+            }
+        }
+    }
+
+    fn update_cmd(
+        &mut self,
+        message: Self::CommandOutput,
+        _sender: relm4::ComponentSender<Self>,
+        root: &Self::Root,
+    ) {
+        match message {
+            AppCommandOutput::EnginesLoaded(engines) => {
+                self.engines_list = engines;
+                self.flows.emit(flows::FlowInputs::EngineListChanged(
+                    self.engines_list.clone(),
+                ));
+                self.actions.emit(actions::ActionInputs::EngineListChanged(
+                    self.engines_list.clone(),
                 ));
                 self.header
-                    .emit(header_bar::HeaderBarInput::ActionsMapChanged(
-                        self.actions_map.clone(),
-                    ))
+                    .emit(header_bar::HeaderBarInput::EngineListChanged(
+                        self.engines_list.clone(),
+                    ));
+                self.set_actions_sensitive(true);
+                self.loading = Some(lang::lookup("loading-actions"));
+            }
+            AppCommandOutput::ActionsLoaded(actions) => {
+                if !self.actions_reloaded {
+                    self.actions_map = actions;
+                    self.actions_map_changed();
+                }
+                self.set_flows_sensitive(true);
+                self.loading = None;
+                if let Some(group) = self.file_actions.take() {
+                    group.register_for_widget(root);
+                }
             }
         }
     }
 }
+
+impl AppModel {
+    /// Pass the actions map to every page, after it has changed.
+    fn actions_map_changed(&self) {
+        self.flows.emit(flows::FlowInputs::ActionsMapChanged(
+            self.actions_map.clone(),
+        ));
+        self.actions.emit(actions::ActionInputs::ActionsMapChanged(
+            self.actions_map.clone(),
+        ));
+        self.header
+            .emit(header_bar::HeaderBarInput::ActionsMapChanged(
+                self.actions_map.clone(),
+            ));
+    }
+
+    /// Set whether the flow editor and its header can be used.
+    fn set_flows_sensitive(&self, sensitive: bool) {
+        self.flows.widget().set_sensitive(sensitive);
+        self.flows
+            .model()
+            .header_controller_rc()
+            .widget()
+            .set_sensitive(sensitive);
+    }
+
+    /// Set whether the action editor and its header can be used.
+    fn set_actions_sensitive(&self, sensitive: bool) {
+        self.actions.widget().set_sensitive(sensitive);
+        self.actions
+            .model()
+            .header_controller_rc()
+            .widget()
+            .set_sensitive(sensitive);
+    }
+}
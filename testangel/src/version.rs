@@ -1,4 +1,18 @@
-use std::env;
+use std::{
+    env, fs,
+    path::{Path, PathBuf},
+    time::{Duration, SystemTime},
+};
+
+use crate::ipc;
+
+/// How long to wait for the latest release before giving up, so a check behind a proxy or
+/// offline doesn't wait for the network to time out.
+const VERSION_CHECK_TIMEOUT: Duration = Duration::from_secs(5);
+/// How long the latest version found is reused for before checking again.
+const VERSION_CACHE_AGE: Duration = Duration::from_secs(24 * 60 * 60);
+/// The name of the file the latest version found is cached in, within the engine directory.
+const VERSION_CACHE_FILE: &str = ".tacache-version";
 
 pub async fn check_is_latest() -> bool {
     log::debug!("Checking version");
@@ -15,38 +29,85 @@ pub async fn check_is_latest() -> bool {
         return true;
     }
 
-    log::debug!("Getting latest release");
-    if let Ok(latest_release) = octocrab::instance()
-        .repos("lilopkins", "testangel")
-        .releases()
-        .get_latest()
-        .await
-    {
-        if let Ok(tag) = semver::Version::parse(&latest_release.tag_name) {
-            if let Ok(current) = semver::Version::parse(env!("CARGO_PKG_VERSION")) {
-                log::info!("Latest version: {tag} Current version: {current}");
-                tag <= current
-            } else {
+    let latest = match cached_latest_version() {
+        Some(latest) => {
+            log::debug!("Using cached latest release");
+            latest
+        }
+        None => match fetch_latest_version().await {
+            Some(latest) => {
+                if let Err(e) = fs::write(version_cache_path(), &latest) {
+                    log::warn!("Couldn't cache latest version: {e}");
+                }
+                latest
+            }
+            None => {
+                // Probably offline
                 log::warn!(
-                    "Couldn't parse current version: '{}'",
+                    "Couldn't fetch latest release for version check! Current version: {}",
                     env!("CARGO_PKG_VERSION")
                 );
-                false
+                return true;
             }
+        },
+    };
+
+    if let Ok(tag) = semver::Version::parse(&latest) {
+        if let Ok(current) = semver::Version::parse(env!("CARGO_PKG_VERSION")) {
+            log::info!("Latest version: {tag} Current version: {current}");
+            tag <= current
         } else {
             log::warn!(
-                "Couldn't parse remote version: '{}'. Current version: {}",
-                latest_release.tag_name,
+                "Couldn't parse current version: '{}'",
                 env!("CARGO_PKG_VERSION")
             );
             false
         }
     } else {
-        // Probably offline
         log::warn!(
-            "Couldn't fetch latest release for version check! Current version: {}",
+            "Couldn't parse remote version: '{}'. Current version: {}",
+            latest,
             env!("CARGO_PKG_VERSION")
         );
-        true
+        false
+    }
+}
+
+/// Get the tag of the latest release from GitHub.
+async fn fetch_latest_version() -> Option<String> {
+    log::debug!("Getting latest release");
+    let result = tokio::time::timeout(
+        VERSION_CHECK_TIMEOUT,
+        octocrab::instance()
+            .repos("lilopkins", "testangel")
+            .releases()
+            .get_latest(),
+    )
+    .await;
+    match result {
+        Ok(Ok(latest_release)) => Some(latest_release.tag_name),
+        Ok(Err(_)) => None,
+        Err(_) => {
+            log::warn!("Timed out fetching latest release.");
+            None
+        }
+    }
+}
+
+/// The path of the file the latest version found is cached in, alongside the engine cache.
+fn version_cache_path() -> PathBuf {
+    Path::new(&ipc::engine_dir()).join(VERSION_CACHE_FILE)
+}
+
+/// Get the latest version found by an earlier check, if it was found recently enough.
+fn cached_latest_version() -> Option<String> {
+    let path = version_cache_path();
+    let modified = fs::metadata(&path).ok()?.modified().ok()?;
+    let age = SystemTime::now().duration_since(modified).ok()?;
+    if age > VERSION_CACHE_AGE {
+        return None;
     }
+    let latest = fs::read_to_string(&path).ok()?;
+    let latest = latest.trim();
+    (!latest.is_empty()).then(|| latest.to_string())
 }